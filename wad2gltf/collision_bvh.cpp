@@ -0,0 +1,274 @@
+#include "collision_bvh.hpp"
+
+#include <algorithm>
+#include <format>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+
+/**
+ * Number of bins along each axis that we try splitting at
+ */
+constexpr auto NumBins = 16u;
+
+/**
+ * Cost of testing a node's bounds, relative to testing one triangle
+ */
+constexpr auto TraversalCost = 1.0f;
+
+struct Bounds {
+    glm::vec3 min = glm::vec3{std::numeric_limits<float>::max()};
+    glm::vec3 max = glm::vec3{std::numeric_limits<float>::lowest()};
+
+    void add(const glm::vec3& point) {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+
+    void add(const Bounds& other) {
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+
+    /**
+     * Half the surface area, which is all the heuristic needs since it only compares areas
+     */
+    float get_half_area() const {
+        if (min.x > max.x) {
+            return 0;
+        }
+
+        const auto size = max - min;
+        return size.x * size.y + size.y * size.z + size.z * size.x;
+    }
+};
+
+/**
+ * A triangle's bounds and centroid, which is all that building the tree looks at
+ */
+struct BuildTriangle {
+    Bounds bounds;
+    glm::vec3 centroid;
+};
+
+struct Bin {
+    Bounds bounds;
+    uint32_t count = 0;
+};
+
+/**
+ * Where a node's triangles are best split, if anywhere
+ */
+struct Split {
+    uint32_t axis = 0;
+    uint32_t bin = 0;
+    float cost = std::numeric_limits<float>::max();
+};
+
+uint32_t get_bin(const float centroid, const float min, const float scale) {
+    return std::min(static_cast<uint32_t>((centroid - min) * scale), NumBins - 1);
+}
+
+Split find_best_split(
+    const std::vector<BuildTriangle>& build_triangles, const std::vector<uint32_t>& order, const uint32_t first,
+    const uint32_t count, const Bounds& centroid_bounds
+) {
+    auto best_split = Split{};
+    for (auto axis = 0u; axis < 3; axis++) {
+        const auto min = centroid_bounds.min[axis];
+        const auto extent = centroid_bounds.max[axis] - min;
+        if (extent <= 0) {
+            continue;
+        }
+        const auto scale = NumBins / extent;
+
+        auto bins = std::array<Bin, NumBins>{};
+        for (auto i = first; i < first + count; i++) {
+            const auto& triangle = build_triangles[order[i]];
+            auto& bin = bins[get_bin(triangle.centroid[axis], min, scale)];
+            bin.bounds.add(triangle.bounds);
+            bin.count++;
+        }
+
+        // Sweep from the right to get the cost of everything right of each split, then from the left to finish it
+        auto right_areas = std::array<float, NumBins>{};
+        auto right_counts = std::array<uint32_t, NumBins>{};
+        auto right_bounds = Bounds{};
+        auto right_count = 0u;
+        for (auto bin = NumBins - 1; bin > 0; bin--) {
+            right_bounds.add(bins[bin].bounds);
+            right_count += bins[bin].count;
+            right_areas[bin] = right_bounds.get_half_area();
+            right_counts[bin] = right_count;
+        }
+
+        auto left_bounds = Bounds{};
+        auto left_count = 0u;
+        for (auto bin = 1u; bin < NumBins; bin++) {
+            left_bounds.add(bins[bin - 1].bounds);
+            left_count += bins[bin - 1].count;
+            if (left_count == 0 || right_counts[bin] == 0) {
+                continue;
+            }
+
+            const auto cost = left_bounds.get_half_area() * static_cast<float>(left_count) +
+                              right_areas[bin] * static_cast<float>(right_counts[bin]);
+            if (cost < best_split.cost) {
+                best_split = Split{.axis = axis, .bin = bin, .cost = cost};
+            }
+        }
+    }
+
+    return best_split;
+}
+
+std::filesystem::path get_bvh_path(const std::filesystem::path& gltf_path) {
+    return std::filesystem::path{gltf_path}.replace_extension(".bvh");
+}
+
+CollisionBvh CollisionBvh::build(std::vector<CollisionTriangle> triangles) {
+    auto bvh = CollisionBvh{};
+    if (triangles.empty()) {
+        return bvh;
+    }
+
+    auto build_triangles = std::vector<BuildTriangle>{};
+    build_triangles.reserve(triangles.size());
+    for (const auto& triangle : triangles) {
+        auto& build_triangle = build_triangles.emplace_back();
+        for (const auto& vertex : triangle.vertices) {
+            build_triangle.bounds.add(vertex);
+        }
+        build_triangle.centroid = (triangle.vertices[0] + triangle.vertices[1] + triangle.vertices[2]) * (1.f / 3.f);
+    }
+
+    auto order = std::vector<uint32_t>(triangles.size());
+    for (auto i = 0u; i < order.size(); i++) {
+        order[i] = i;
+    }
+
+    // A binary tree with one triangle per leaf has 2n - 1 nodes, and our leaves never have fewer triangles than that
+    bvh.nodes.reserve(triangles.size() * 2 - 1);
+    // Each node's bounds are filled in when it's taken off the stack
+    bvh.nodes.emplace_back(
+        CollisionBvhNode{
+            .min = glm::vec3{0},
+            .first = 0,
+            .max = glm::vec3{0},
+            .triangle_count = static_cast<uint32_t>(triangles.size()),
+        }
+    );
+
+    auto pending_nodes = std::vector<uint32_t>{0};
+    while (!pending_nodes.empty()) {
+        const auto node_index = pending_nodes.back();
+        pending_nodes.pop_back();
+
+        const auto first = bvh.nodes[node_index].first;
+        const auto count = bvh.nodes[node_index].triangle_count;
+
+        auto bounds = Bounds{};
+        auto centroid_bounds = Bounds{};
+        for (auto i = first; i < first + count; i++) {
+            const auto& triangle = build_triangles[order[i]];
+            bounds.add(triangle.bounds);
+            centroid_bounds.add(triangle.centroid);
+        }
+        bvh.nodes[node_index].min = bounds.min;
+        bvh.nodes[node_index].max = bounds.max;
+
+        // Nothing can be cheaper than a single triangle, and a node with no area can't be split usefully
+        if (count <= 1 || bounds.get_half_area() <= 0) {
+            continue;
+        }
+
+        // Testing every triangle in the node costs count triangle tests. A split costs two node tests, plus each
+        // child's triangles weighted by how likely a ray that hits this node is to hit the child
+        const auto split = find_best_split(build_triangles, order, first, count, centroid_bounds);
+        const auto leaf_cost = static_cast<float>(count);
+        const auto split_cost = 2 * TraversalCost + split.cost / bounds.get_half_area();
+        if (split.cost == std::numeric_limits<float>::max() || split_cost >= leaf_cost) {
+            continue;
+        }
+
+        const auto min = centroid_bounds.min[split.axis];
+        const auto scale = NumBins / (centroid_bounds.max[split.axis] - min);
+        const auto middle = std::partition(
+            order.begin() + first, order.begin() + first + count, [&](const uint32_t triangle_index) {
+                return get_bin(build_triangles[triangle_index].centroid[split.axis], min, scale) < split.bin;
+            }
+        );
+        const auto left_count = static_cast<uint32_t>(middle - (order.begin() + first));
+
+        const auto left_index = static_cast<uint32_t>(bvh.nodes.size());
+        bvh.nodes.emplace_back(
+            CollisionBvhNode{
+                .min = glm::vec3{0},
+                .first = first,
+                .max = glm::vec3{0},
+                .triangle_count = left_count,
+            }
+        );
+        bvh.nodes.emplace_back(
+            CollisionBvhNode{
+                .min = glm::vec3{0},
+                .first = first + left_count,
+                .max = glm::vec3{0},
+                .triangle_count = count - left_count,
+            }
+        );
+
+        bvh.nodes[node_index].first = left_index;
+        bvh.nodes[node_index].triangle_count = 0;
+
+        pending_nodes.emplace_back(left_index + 1);
+        pending_nodes.emplace_back(left_index);
+    }
+
+    // Put the triangles in the order that the leaves refer to them
+    bvh.triangles.reserve(triangles.size());
+    for (const auto triangle_index : order) {
+        bvh.triangles.emplace_back(triangles[triangle_index]);
+    }
+
+    return bvh;
+}
+
+bool CollisionBvh::empty() const {
+    return nodes.empty();
+}
+
+void CollisionBvh::write(const std::filesystem::path& path) const {
+    auto header = CollisionBvhHeader{
+        .node_count = get_num_nodes(),
+        .triangle_count = get_num_triangles(),
+        .node_offset = sizeof(CollisionBvhHeader),
+        .triangle_offset = sizeof(CollisionBvhHeader) + nodes.size() * sizeof(CollisionBvhNode),
+    };
+
+    auto file = std::ofstream{path, std::ios::binary};
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(
+        reinterpret_cast<const char*>(nodes.data()), static_cast<std::streamsize>(nodes.size() * sizeof(CollisionBvhNode))
+    );
+    file.write(
+        reinterpret_cast<const char*>(triangles.data()),
+        static_cast<std::streamsize>(triangles.size() * sizeof(CollisionTriangle))
+    );
+    if (!file) {
+        throw std::runtime_error{std::format("Could not write BVH to file {}", path.string())};
+    }
+}
+
+uint32_t CollisionBvh::get_num_nodes() const {
+    return static_cast<uint32_t>(nodes.size());
+}
+
+uint32_t CollisionBvh::get_num_triangles() const {
+    return static_cast<uint32_t>(triangles.size());
+}
+
+uint64_t CollisionBvh::get_file_size() const {
+    return sizeof(CollisionBvhHeader) + nodes.size() * sizeof(CollisionBvhNode) +
+           triangles.size() * sizeof(CollisionTriangle);
+}
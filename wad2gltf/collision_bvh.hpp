@@ -0,0 +1,107 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+/**
+ * \file collision_bvh.hpp
+ *
+ * A bounding volume hierarchy over a map's triangles, for raycasts and point queries at runtime
+ *
+ * The BVH is written to a binary file that can be memory-mapped and used as-is. All values are little-endian, and
+ * positions are in map units, before the map node's transform. The file is:
+ *
+ * - A CollisionBvhHeader
+ * - header.node_count CollisionBvhNodes, starting at header.node_offset. Node 0 is the root
+ * - header.triangle_count CollisionTriangles, starting at header.triangle_offset, in the order the leaves use them
+ */
+
+enum class SurfaceType : uint32_t {
+    Wall = 0,
+    Floor = 1,
+    Ceiling = 2,
+};
+
+struct CollisionTriangle {
+    std::array<glm::vec3, 3> vertices;
+
+    uint32_t sector;
+
+    /**
+     * The linedef that a wall belongs to. NoLinedef for floors and ceilings
+     */
+    uint32_t linedef;
+
+    SurfaceType surface;
+
+    constexpr static inline uint32_t NoLinedef = UINT32_MAX;
+};
+
+/**
+ * \brief A node of the BVH
+ *
+ * Leaves have a triangle_count, and their triangles start at first. Inner nodes have a triangle_count of 0, and their
+ * children are the nodes at first and first + 1
+ */
+struct CollisionBvhNode {
+    glm::vec3 min;
+    uint32_t first;
+    glm::vec3 max;
+    uint32_t triangle_count;
+};
+
+struct CollisionBvhHeader {
+    std::array<char, 4> magic = {'W', 'B', 'V', 'H'};
+    uint32_t version = 1;
+    uint32_t node_count = 0;
+    uint32_t triangle_count = 0;
+    uint64_t node_offset = 0;
+    uint64_t triangle_offset = 0;
+};
+
+static_assert(sizeof(CollisionTriangle) == 48);
+static_assert(sizeof(CollisionBvhNode) == 32);
+static_assert(sizeof(CollisionBvhHeader) == 32);
+
+/**
+ * Where the BVH for a glTF file goes: next to it, with the extension .bvh
+ */
+std::filesystem::path get_bvh_path(const std::filesystem::path& gltf_path);
+
+class CollisionBvh {
+public:
+    /**
+     * \brief Builds a BVH with the surface area heuristic
+     *
+     * Each split is chosen from a few bins along each axis, whichever makes the children cheapest to test. A node
+     * becomes a leaf when no split is cheaper than testing all of its triangles
+     */
+    static CollisionBvh build(std::vector<CollisionTriangle> triangles);
+
+    bool empty() const;
+
+    /**
+     * \brief Writes the BVH in the layout described in collision_bvh.hpp
+     *
+     * \throws std::runtime_error if the file can't be written
+     */
+    void write(const std::filesystem::path& path) const;
+
+    uint32_t get_num_nodes() const;
+
+    uint32_t get_num_triangles() const;
+
+    /**
+     * Size of the file that write() writes, in bytes
+     */
+    uint64_t get_file_size() const;
+
+private:
+    std::vector<CollisionBvhNode> nodes;
+
+    std::vector<CollisionTriangle> triangles;
+};
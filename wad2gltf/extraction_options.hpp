@@ -3,6 +3,35 @@
 #include <filesystem>
 #include <string>
 
+/**
+ * \brief Which faces share a glTF Primitive
+ *
+ * Every Primitive is a draw call, and viewers spend a lot of time loading the accessors of thousands of small ones. The
+ * larger scopes merge all the faces that use the same texture into one Primitive, so each Mesh has one Primitive per
+ * texture
+ */
+enum class MeshBatching {
+    /**
+     * One Primitive for each wall, and one each for the floor and ceiling of each sector
+     */
+    None,
+
+    /**
+     * One Primitive per texture in each sector's Mesh
+     */
+    Sector,
+
+    /**
+     * One Mesh for the sectors in each square chunk of the map, with one Primitive per texture
+     */
+    Chunk,
+
+    /**
+     * One Mesh for the whole map, with one Primitive per texture
+     */
+    Map,
+};
+
  /**
   * \brief Options for how to extract a map
   */
@@ -41,4 +70,59 @@ struct MapExtractionOptions {
      * \brief Index of the colormap to apply when exporting textures
      */
     uint32_t colormap_index = 0;
+
+    /**
+     * \brief Whether to accept maps that go past vanilla DOOM's limits, such as maps with more than 32767 sidedefs
+     *
+     * Without this, we reject those maps instead of reading indices the way vanilla DOOM would
+     */
+    bool extended_limits = false;
+
+    /**
+     * \brief Whether to triangulate floors and ceilings from each sector's line loops instead of from the map's nodes
+     *
+     * By default we use the convex subsectors from the map's GL nodes or regular nodes, and only fall back to the line
+     * loops for maps without nodes. The line loops don't need nodes, but they can't handle sectors that aren't closed
+     */
+    bool earcut_flats = false;
+
+    /**
+     * \brief Whether to write a BVH of the map's walls and flats next to the glTF file
+     *
+     * The BVH is for raycasts and point queries at runtime. Its triangles are tagged with their sector and linedef, and
+     * it's laid out so that it can be memory-mapped and used without any preprocessing. See collision_bvh.hpp
+     */
+    bool export_bvh = false;
+
+    /**
+     * \brief Whether to leave the triangles and vertices of each sector in the order they were built in
+     *
+     * By default we reorder them for the GPU's vertex cache, for overdraw, and for vertex fetch, which doesn't change
+     * how the map looks. See mesh_optimization.hpp
+     */
+    bool skip_mesh_optimization = false;
+
+    /**
+     * \brief Whether to write positions, normals, and texcoords as small integers with KHR_mesh_quantization
+     *
+     * This halves the size of the vertex data, but only loaders that support the extension can load the file. See
+     * mesh_quantization.hpp
+     */
+    bool quantize_meshes = false;
+
+    /**
+     * \brief Which faces share a glTF Primitive
+     *
+     * With Chunk or Map, sectors don't have Meshes of their own. Each batch's Node has extras that say which of its
+     * vertices belong to which sector
+     */
+    MeshBatching mesh_batching = MeshBatching::None;
+
+    /**
+     * \brief Whether to draw all the Things with the same sprite as instances of one Mesh, with EXT_mesh_gpu_instancing
+     *
+     * Each sprite gets one Node, whose instances are the Things. Their types and flags are in a custom instance
+     * attribute instead of in extras
+     */
+    bool instance_things = false;
 };
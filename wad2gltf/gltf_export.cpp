@@ -1,6 +1,12 @@
 #include "gltf_export.hpp"
 
+#include <algorithm>
+#include <cstddef>
 #include <format>
+#include <iostream>
+#include <limits>
+#include <span>
+#include <unordered_map>
 #include <stb_image_write.h>
 #include <glm/ext/quaternion_trigonometric.hpp>
 #include <glm/gtc/quaternion.hpp>
@@ -8,207 +14,118 @@
 
 #include "gltf_extras.hpp"
 
+/**
+ * Points a glTF buffer at an array, without copying it
+ */
 template <typename DataType>
-void write_data_to_buffer(std::vector<uint8_t>& buffer, const std::span<const DataType> data) {
-    const auto dest_offset = buffer.size();
-    const auto num_bytes = data.size() * sizeof(DataType);
-    buffer.resize(buffer.size() + num_bytes);
-    auto* dest_ptr = buffer.data() + dest_offset;
-    std::memcpy(dest_ptr, data.data(), num_bytes);
+fastgltf::sources::ByteView view_buffer_data(const std::span<const DataType> data) {
+    return fastgltf::sources::ByteView{.bytes = {reinterpret_cast<const std::byte*>(data.data()), data.size_bytes()}};
 }
 
-void add_face(
-    const Face& face, fastgltf::Asset& model, std::vector<uint8_t>& positions, std::vector<uint8_t>& normals,
-    std::vector<uint8_t>& texcoords, std::vector<uint8_t>& indices, fastgltf::Mesh& mesh
-) {
-    auto& primitive = mesh.primitives.emplace_back();
-    primitive.type = fastgltf::PrimitiveType::Triangles;
-
-    // Positions
-    primitive.attributes.emplace_back("POSITION", model.accessors.size());
-    auto& position_accessor = model.accessors.emplace_back();
-    position_accessor.bufferViewIndex = 1;
-    position_accessor.byteOffset = positions.size();
-    position_accessor.componentType = fastgltf::ComponentType::Float;
-    position_accessor.count = 4;
-    position_accessor.type = fastgltf::AccessorType::Vec3;
-
-    const auto min_x = glm::min(
-        glm::min(face.vertices[0].position.x, face.vertices[1].position.x),
-        glm::min(face.vertices[2].position.x, face.vertices[3].position.x)
-    );
-    const auto min_y = glm::min(
-        glm::min(face.vertices[0].position.y, face.vertices[1].position.y),
-        glm::min(face.vertices[2].position.y, face.vertices[3].position.y)
-    );
-    const auto min_z = glm::min(
-        glm::min(face.vertices[0].position.z, face.vertices[1].position.z),
-        glm::min(face.vertices[2].position.z, face.vertices[3].position.z)
-    );
-    const auto max_x = glm::max(
-        glm::max(face.vertices[0].position.x, face.vertices[1].position.x),
-        glm::max(face.vertices[2].position.x, face.vertices[3].position.x)
-    );
-    const auto max_y = glm::max(
-        glm::max(face.vertices[0].position.y, face.vertices[1].position.y),
-        glm::max(face.vertices[2].position.y, face.vertices[3].position.y)
-    );
-    const auto max_z = glm::max(
-        glm::max(face.vertices[0].position.z, face.vertices[1].position.z),
-        glm::max(face.vertices[2].position.z, face.vertices[3].position.z)
-    );
-
-    position_accessor.min = FASTGLTF_STD_PMR_NS::vector<double>{min_x, min_y, min_z};
-    position_accessor.max = FASTGLTF_STD_PMR_NS::vector<double>{max_x, max_y, max_z};
-
-    write_data_to_buffer<glm::vec3>(
-        positions, std::array{
-            face.vertices[0].position,
-            face.vertices[1].position,
-            face.vertices[2].position,
-            face.vertices[3].position,
-        }
-    );
-
-    // Normals
-    primitive.attributes.emplace_back("NORMAL", model.accessors.size());
-    auto& normal_accessor = model.accessors.emplace_back();
-    normal_accessor.bufferViewIndex = 2;
-    normal_accessor.byteOffset = normals.size();
-    normal_accessor.componentType = fastgltf::ComponentType::Float;
-    normal_accessor.count = 4;
-    normal_accessor.type = fastgltf::AccessorType::Vec3;
-
-    write_data_to_buffer<glm::vec3>(
-        normals, std::array{
-            face.normal,
-            face.normal,
-            face.normal,
-            face.normal,
-        }
-    );
-
-    // Texcoords
-    primitive.attributes.emplace_back("TEXCOORD_0", model.accessors.size());
-    auto& texcoord_accessor = model.accessors.emplace_back();
-    texcoord_accessor.bufferViewIndex = 3;
-    texcoord_accessor.byteOffset = texcoords.size();
-    texcoord_accessor.componentType = fastgltf::ComponentType::Float;
-    texcoord_accessor.count = 4;
-    texcoord_accessor.type = fastgltf::AccessorType::Vec2;
+fastgltf::ComponentType get_index_component_type(const uint32_t index_size) {
+    if (index_size == sizeof(uint8_t)) {
+        return fastgltf::ComponentType::UnsignedByte;
+    }
+    if (index_size == sizeof(uint16_t)) {
+        return fastgltf::ComponentType::UnsignedShort;
+    }
 
-    write_data_to_buffer<glm::vec2>(
-        texcoords, std::array{
-            face.vertices[0].texcoord,
-            face.vertices[1].texcoord,
-            face.vertices[2].texcoord,
-            face.vertices[3].texcoord,
-        }
-    );
-
-    // Indices
-    primitive.indicesAccessor = model.accessors.size();
-    auto& indices_accessor = model.accessors.emplace_back();
-    indices_accessor.bufferViewIndex = 0;
-    indices_accessor.byteOffset = indices.size();
-    indices_accessor.componentType = fastgltf::ComponentType::UnsignedShort;
-    indices_accessor.count = 6;
-    indices_accessor.type = fastgltf::AccessorType::Scalar;
-
-    // 0 1 2 3 2 1
-    // Same for all faces
-    write_data_to_buffer<uint16_t>(indices, std::array<uint16_t, 6>{0, 1, 2, 3, 2, 1});
-
-    // Material. We create one material for each unique MapTexture, so there's a 1:1 relationship between
-    // MapTexture indices and material indices
-    primitive.materialIndex = face.texture_index;
+    return fastgltf::ComponentType::UnsignedInt;
 }
 
-void add_flat(
-    const Flat& flat, const glm::vec3& normal, fastgltf::Asset& model, std::vector<uint8_t>& positions_out,
-    std::vector<uint8_t>& normals_out, std::vector<uint8_t>& texcoords_out, std::vector<uint8_t>& indices_out,
+/**
+ * Adds accessors for one mesh in the map's buffers. The buffer views are in the same order as the buffers: indices,
+ * positions, normals, then texcoords
+ *
+ * \param quantized The quantized vertex attributes, or nullptr if the float ones are exported
+ */
+void add_mesh(
+    const MeshBuffers& buffers, const QuantizedMeshBuffers* quantized, const MeshRange& range, fastgltf::Asset& model,
     fastgltf::Mesh& mesh
 ) {
-    auto& primitive = mesh.primitives.emplace_back();
-    primitive.type = fastgltf::PrimitiveType::Triangles;
-
-    // Positions
-    primitive.attributes.emplace_back("POSITION", model.accessors.size());
+    // All the primitives share one set of vertex attributes
+    const auto position_accessor_index = model.accessors.size();
     auto& position_accessor = model.accessors.emplace_back();
     position_accessor.bufferViewIndex = 1;
-    position_accessor.byteOffset = positions_out.size();
-    position_accessor.componentType = fastgltf::ComponentType::Float;
-    position_accessor.count = flat.vertices.size();
+    position_accessor.count = range.vertex_count;
     position_accessor.type = fastgltf::AccessorType::Vec3;
-
-    auto texcoords = std::vector<glm::vec2>{};
-    texcoords.reserve(flat.vertices.size());
-    auto aabb_min = glm::vec3{FLT_MAX};
-    auto aabb_max = glm::vec3{-FLT_MAX};
-    for (const auto& pos : flat.vertices) {
-        aabb_min.x = glm::min(aabb_min.x, pos.x);
-        aabb_min.y = glm::min(aabb_min.y, pos.y);
-        aabb_min.z = glm::min(aabb_min.z, pos.z);
-
-        aabb_max.x = glm::max(aabb_max.x, pos.x);
-        aabb_max.y = glm::max(aabb_max.y, pos.y);
-        aabb_max.z = glm::max(aabb_max.z, pos.z);
-
-        // Ceiling flats are aligned to a 64x64 grid
-        texcoords.emplace_back(pos.x / 64.f, pos.y / 64.f);
+    if (quantized != nullptr) {
+        // Sectors are offset and sprites aren't, so the bounds come from the quantized positions themselves
+        auto min = FASTGLTF_STD_PMR_NS::vector<int64_t>(3, std::numeric_limits<int16_t>::max());
+        auto max = FASTGLTF_STD_PMR_NS::vector<int64_t>(3, std::numeric_limits<int16_t>::min());
+        for (auto vertex = range.first_vertex; vertex < range.first_vertex + range.vertex_count; vertex++) {
+            for (auto axis = 0u; axis < 3; axis++) {
+                min[axis] = std::min(min[axis], int64_t{quantized->positions[vertex][axis]});
+                max[axis] = std::max(max[axis], int64_t{quantized->positions[vertex][axis]});
+            }
+        }
+        position_accessor.byteOffset = range.first_vertex * sizeof(quantized->positions[0]);
+        position_accessor.componentType = fastgltf::ComponentType::Short;
+        position_accessor.min = std::move(min);
+        position_accessor.max = std::move(max);
+    } else {
+        position_accessor.byteOffset = range.first_vertex * sizeof(glm::vec3);
+        position_accessor.componentType = fastgltf::ComponentType::Float;
+        position_accessor.min = FASTGLTF_STD_PMR_NS::vector<double>{range.min.x, range.min.y, range.min.z};
+        position_accessor.max = FASTGLTF_STD_PMR_NS::vector<double>{range.max.x, range.max.y, range.max.z};
     }
 
-    position_accessor.min = FASTGLTF_STD_PMR_NS::vector<double>{aabb_min.x, aabb_min.y, aabb_min.z};
-    position_accessor.max = FASTGLTF_STD_PMR_NS::vector<double>{aabb_max.x, aabb_max.y, aabb_max.z};
-
-    write_data_to_buffer<glm::vec3>(positions_out, flat.vertices);
-
-    // Normals
-    primitive.attributes.emplace_back("NORMAL", model.accessors.size());
+    const auto normal_accessor_index = model.accessors.size();
     auto& normal_accessor = model.accessors.emplace_back();
     normal_accessor.bufferViewIndex = 2;
-    normal_accessor.byteOffset = normals_out.size();
-    normal_accessor.componentType = fastgltf::ComponentType::Float;
-    normal_accessor.count = flat.vertices.size();
+    normal_accessor.count = range.vertex_count;
     normal_accessor.type = fastgltf::AccessorType::Vec3;
+    if (quantized != nullptr) {
+        normal_accessor.byteOffset = range.first_vertex * sizeof(quantized->normals[0]);
+        normal_accessor.componentType = fastgltf::ComponentType::Byte;
+        normal_accessor.normalized = true;
+    } else {
+        normal_accessor.byteOffset = range.first_vertex * sizeof(glm::vec3);
+        normal_accessor.componentType = fastgltf::ComponentType::Float;
+    }
 
-    const auto normals = std::vector(flat.vertices.size(), normal);
-
-    write_data_to_buffer<glm::vec3>(normals_out, normals);
-
-    // Texcoords
-    primitive.attributes.emplace_back("TEXCOORD_0", model.accessors.size());
+    const auto texcoord_accessor_index = model.accessors.size();
     auto& texcoord_accessor = model.accessors.emplace_back();
     texcoord_accessor.bufferViewIndex = 3;
-    texcoord_accessor.byteOffset = texcoords_out.size();
-    texcoord_accessor.componentType = fastgltf::ComponentType::Float;
-    texcoord_accessor.count = texcoords.size();
+    texcoord_accessor.count = range.vertex_count;
     texcoord_accessor.type = fastgltf::AccessorType::Vec2;
+    if (quantized != nullptr && !quantized->texcoords.empty()) {
+        texcoord_accessor.byteOffset = range.first_vertex * sizeof(quantized->texcoords[0]);
+        texcoord_accessor.componentType = fastgltf::ComponentType::Short;
+    } else {
+        texcoord_accessor.byteOffset = range.first_vertex * sizeof(glm::vec2);
+        texcoord_accessor.componentType = fastgltf::ComponentType::Float;
+    }
 
-    write_data_to_buffer<glm::vec2>(texcoords_out, texcoords);
-
-    // Indices
-    primitive.indicesAccessor = model.accessors.size();
-    auto& indices_accessor = model.accessors.emplace_back();
-    indices_accessor.bufferViewIndex = 0;
-    indices_accessor.byteOffset = indices_out.size();
-    indices_accessor.componentType = fastgltf::ComponentType::UnsignedShort;
-    indices_accessor.count = flat.indices.size();
-    indices_accessor.type = fastgltf::AccessorType::Scalar;
-
-    write_data_to_buffer<uint16_t>(indices_out, flat.indices);
-
-    // Material. We create one material for each unique MapTexture, so there's a 1:1 relationship between
-    // MapTexture indices and material indices
-    primitive.materialIndex = flat.texture_index;
+    const auto primitive_ranges = std::span{buffers.primitives}.subspan(range.first_primitive, range.primitive_count);
+    for (const auto& primitive_range : primitive_ranges) {
+        auto& primitive = mesh.primitives.emplace_back();
+        primitive.type = fastgltf::PrimitiveType::Triangles;
+        primitive.attributes.emplace_back("POSITION", position_accessor_index);
+        primitive.attributes.emplace_back("NORMAL", normal_accessor_index);
+        primitive.attributes.emplace_back("TEXCOORD_0", texcoord_accessor_index);
+
+        primitive.indicesAccessor = model.accessors.size();
+        auto& indices_accessor = model.accessors.emplace_back();
+        indices_accessor.bufferViewIndex = 0;
+        indices_accessor.byteOffset = primitive_range.index_offset;
+        indices_accessor.componentType = get_index_component_type(primitive_range.index_size);
+        indices_accessor.count = primitive_range.index_count;
+        indices_accessor.type = fastgltf::AccessorType::Scalar;
+
+        // Material. We create one material for each unique MapTexture, so there's a 1:1 relationship between
+        // MapTexture indices and material indices
+        primitive.materialIndex = primitive_range.texture_index;
+    }
 }
 
 ExportedWad export_to_gltf(const std::string_view name, const Map& map, const MapExtractionOptions& options) {
-    auto model = fastgltf::Asset{};
+    auto exported_wad = ExportedWad{};
+    auto& model = exported_wad.asset;
     model.defaultScene = 0;
     model.assetInfo = fastgltf::AssetInfo{.gltfVersion = "2.0", .generator = "wad2gltf"};
 
-    model.nodes.reserve(map.sectors.size() + map.things.size());
+    model.nodes.reserve(map.sectors.size() + map.sector_batches.size() + map.things.size() + 1);
 
     auto node_extras = std::vector<std::optional<std::string>>{};
     node_extras.reserve(model.nodes.size());
@@ -216,6 +133,48 @@ ExportedWad export_to_gltf(const std::string_view name, const Map& map, const Ma
     auto& scene = model.scenes.emplace_back();
     scene.name = std::string{name};
 
+    auto scene_extras = std::vector<std::optional<std::string>>{};
+    if (!map.collision_bvh.empty()) {
+        // The BVH is written next to the glTF file, so its URI is relative like the images'
+        const nlohmann::json scene_extra = SceneExtra{
+            .collision_bvh = CollisionBvhExtra{
+                .uri = get_bvh_path(options.output_file).filename().string(),
+                .version = CollisionBvhHeader{}.version,
+                .node_count = map.collision_bvh.get_num_nodes(),
+                .triangle_count = map.collision_bvh.get_num_triangles(),
+                .byte_length = map.collision_bvh.get_file_size(),
+            },
+        };
+        scene_extras.emplace_back(scene_extra.dump());
+    } else {
+        scene_extras.emplace_back(std::nullopt);
+    }
+
+    // The materials and nodes depend on the scales that quantizing picks, so it goes first
+    const QuantizedMeshBuffers* quantized = nullptr;
+    auto position_offset = glm::vec3{0};
+    auto position_scale = 1.f;
+    auto is_texcoord_quantized = false;
+    if (options.quantize_meshes) {
+        exported_wad.quantized_geometry = quantize_mesh_buffers(map);
+        quantized = &exported_wad.quantized_geometry;
+        position_offset = quantized->position_offset;
+        position_scale = quantized->position_scale;
+        is_texcoord_quantized = !quantized->texcoords.empty();
+
+        model.extensionsUsed.emplace_back("KHR_mesh_quantization");
+        model.extensionsRequired.emplace_back("KHR_mesh_quantization");
+        if (is_texcoord_quantized) {
+            model.extensionsUsed.emplace_back("KHR_texture_transform");
+            model.extensionsRequired.emplace_back("KHR_texture_transform");
+        } else {
+            std::cout << std::format(
+                "WARNING: The texcoords of map {} span too many repeats to quantize precisely, so they're written as "
+                "floats\n", name
+            );
+        }
+    }
+
     auto& sampler = model.samplers.emplace_back();
     sampler.magFilter = fastgltf::Filter::Nearest;
     sampler.minFilter = fastgltf::Filter::NearestMipMapNearest;
@@ -237,6 +196,14 @@ ExportedWad export_to_gltf(const std::string_view name, const Map& map, const Ma
         gltf_material.pbrData.baseColorTexture = fastgltf::TextureInfo{
             .textureIndex = model.textures.size(), .texCoordIndex = 0
         };
+        if (is_texcoord_quantized) {
+            const auto texcoord_scale = 1.f / quantized->texcoord_scale;
+            gltf_material.pbrData.baseColorTexture->transform = std::make_unique<fastgltf::TextureTransform>(
+                fastgltf::TextureTransform{
+                    .rotation = 0, .uvOffset = {0, 0}, .uvScale = {texcoord_scale, texcoord_scale}
+                }
+            );
+        }
 
         auto& gltf_texture = model.textures.emplace_back();
         gltf_texture.name = gltf_material.name;
@@ -253,18 +220,9 @@ ExportedWad export_to_gltf(const std::string_view name, const Map& map, const Ma
         };
     }
 
-    auto positions = std::vector<uint8_t>{};
-    positions.reserve(666 * 4 * sizeof(glm::vec3));
-    auto normals = std::vector<uint8_t>{};
-    normals.reserve(666 * 4 * sizeof(glm::vec3));
-    auto texcoords = std::vector<uint8_t>{};
-    texcoords.reserve(666 * 4 * sizeof(glm::vec2));
-    auto indices = std::vector<uint8_t>{};
-    indices.reserve(666 * 6 * sizeof(uint16_t));
-
-    // Don't create buffer views for the buffers yet. We'll have buffer views that cover the whole
-    // buffer, so we need to know the final size of the buffer
-    // The views will be in the same order as the buffers, so we can construct the accessors
+    // The map's geometry is already laid out in one array per attribute. Each array becomes a buffer with a buffer
+    // view that covers all of it, and each mesh's accessors point into those views
+    const auto& geometry = map.geometry;
 
     // Set up a top-level node to apply a DOOM -> 3D transform
     const auto parent_node_idx = model.nodes.size();
@@ -272,13 +230,17 @@ ExportedWad export_to_gltf(const std::string_view name, const Map& map, const Ma
     auto& parent_node = model.nodes.emplace_back();
     node_extras.emplace_back(std::nullopt);
     parent_node.name = name;
+    // Quantized positions are moved by position_offset and scaled by position_scale, which the parent node undoes.
+    // Things' positions are in the parent node's space, so they're moved and scaled to match
     const auto rotation_quat = glm::angleAxis(glm::radians(-90.f), glm::vec3{1, 0, 0});
+    const auto map_scale = glm::vec3{0.833f / 64.f, 0.833f / 64.f, 1.f / 64.f};
+    const auto map_translation = rotation_quat * (map_scale * position_offset);
     parent_node.transform = fastgltf::TRS{
-        .translation = {0, 0, 0},
+        .translation = {map_translation.x, map_translation.y, map_translation.z},
         .rotation = {rotation_quat.x, rotation_quat.y, rotation_quat.z, rotation_quat.w},
-        .scale = {0.833f / 64.f, 0.833f / 64.f, 1.f / 64.f},
+        .scale = {map_scale.x / position_scale, map_scale.y / position_scale, map_scale.z / position_scale},
     };
-    parent_node.children.reserve(map.sectors.size() + map.things.size());
+    parent_node.children.reserve(map.sectors.size() + map.sector_batches.size() + map.things.size());
 
     auto sector_index = 0;
     for (const auto& sector : map.sectors) {
@@ -300,7 +262,7 @@ ExportedWad export_to_gltf(const std::string_view name, const Map& map, const Ma
         node_extras.emplace_back(sector_extra.dump());
 
         // Don't emit a mesh for empty sectors. Their nodes will define them
-        if (sector.faces.empty() && sector.ceiling.indices.empty() && sector.floor.indices.empty()) {
+        if (sector.mesh.primitive_count == 0) {
             sector_index++;
             continue;
         }
@@ -310,23 +272,153 @@ ExportedWad export_to_gltf(const std::string_view name, const Map& map, const Ma
         auto& mesh = model.meshes.emplace_back();
         mesh.name = std::format("{} Sector {}", name, sector_index);
 
-        for (const auto& face : sector.faces) {
-            add_face(face, model, positions, normals, texcoords, indices, mesh);
+        add_mesh(geometry, quantized, sector.mesh, model, mesh);
+
+        sector_index++;
+    }
+
+    // Batches hold the geometry of sectors that don't have their own meshes. Their extras say which of the mesh's
+    // vertices belong to which sector
+    auto batch_index = 0;
+    for (const auto& batch : map.sector_batches) {
+        model.nodes[parent_node_idx].children.emplace_back(model.nodes.size());
+
+        auto& node = model.nodes.emplace_back();
+        node.name = std::format("{} Batch {}", name, batch_index);
+        node.transform = fastgltf::TRS{
+            .translation = {0, 0, 0},
+            .rotation = {0, 0, 0, 1},
+            .scale = {1, 1, 1},
+        };
+        node.meshIndex = model.meshes.size();
+
+        auto& mesh = model.meshes.emplace_back();
+        mesh.name = node.name;
+
+        add_mesh(geometry, quantized, batch.mesh, model, mesh);
+
+        const nlohmann::json batch_extra = SectorBatchExtra{.type = Type::SectorBatch, .data = batch};
+        node_extras.emplace_back(batch_extra.dump());
+
+        batch_index++;
+    }
+
+    // Things with the same sprite share its quad, so they can share its Mesh too. The quad's first vertex identifies it
+    auto sprite_meshes = std::unordered_map<uint32_t, size_t>{};
+    const auto get_sprite_mesh = [&](const MeshRange& sprite) {
+        const auto [itr, is_new] = sprite_meshes.emplace(sprite.first_vertex, model.meshes.size());
+        if (is_new) {
+            const auto texture_index = geometry.primitives[sprite.first_primitive].texture_index;
+
+            auto& mesh = model.meshes.emplace_back();
+            mesh.name = std::format("Sprite {}", map.textures[texture_index].name.to_string());
+            add_mesh(geometry, quantized, sprite, model, mesh);
+
+            model.materials[texture_index].doubleSided = true;
+        }
+
+        return itr->second;
+    };
+
+    if (options.export_things && options.instance_things) {
+        // Put all the Things at the end, as one Node per sprite. Each sprite's instances are next to each other, in the
+        // order of its Things, and the sprites are in the order they're first used
+        auto sprite_groups = std::unordered_map<uint32_t, uint32_t>{};
+        auto group_sprites = std::vector<MeshRange>{};
+        auto thing_groups = std::vector<uint32_t>{};
+        thing_groups.reserve(map.things.size());
+        for (const auto& thing : map.things) {
+            const auto [itr, is_new] = sprite_groups.emplace(
+                thing.sprite.first_vertex, static_cast<uint32_t>(group_sprites.size())
+            );
+            if (is_new) {
+                group_sprites.emplace_back(thing.sprite);
+            }
+            thing_groups.emplace_back(itr->second);
         }
 
-        // Add the floor and ceiling primitives
-        // The floor or ceiling may be empty for F_SKYn (where the sky should be drawn)
-        if (!sector.ceiling.indices.empty()) {
-            add_flat(sector.ceiling, glm::vec3{0, 0, -1}, model, positions, normals, texcoords, indices, mesh);
+        auto group_offsets = std::vector<uint32_t>(group_sprites.size() + 1, 0);
+        for (const auto group : thing_groups) {
+            group_offsets[group + 1]++;
         }
-        if (!sector.floor.indices.empty()) {
-            add_flat(sector.floor, glm::vec3{0, 0, 1}, model, positions, normals, texcoords, indices, mesh);
+        for (auto group = 0u; group < group_sprites.size(); group++) {
+            group_offsets[group + 1] += group_offsets[group];
         }
 
-        sector_index++;
-    }
+        auto& instances = exported_wad.thing_instances;
+        instances.resize(map.things.size());
+        auto next_instances = std::vector<uint32_t>(group_offsets.begin(), group_offsets.end() - 1);
+        for (auto thing_index = 0u; thing_index < map.things.size(); thing_index++) {
+            const auto& thing = map.things[thing_index];
+            const auto thing_position = (thing.position - position_offset) * position_scale;
+            const auto thing_rotation = glm::angleAxis(thing.angle, glm::vec3{0, 0, 1});
+            instances[next_instances[thing_groups[thing_index]]++] = ThingInstance{
+                .translation = {thing_position.x, thing_position.y, thing_position.z},
+                .rotation = {thing_rotation.x, thing_rotation.y, thing_rotation.z, thing_rotation.w},
+                .type = static_cast<uint16_t>(thing.type),
+                .flags = thing.flags,
+            };
+        }
 
-    if (options.export_things) {
+        if (!instances.empty()) {
+            model.extensionsUsed.emplace_back("EXT_mesh_gpu_instancing");
+            model.extensionsRequired.emplace_back("EXT_mesh_gpu_instancing");
+        }
+
+        for (auto group = 0u; group < group_sprites.size(); group++) {
+            const auto& sprite = group_sprites[group];
+            const auto& texture = map.textures[geometry.primitives[sprite.first_primitive].texture_index];
+
+            model.nodes[parent_node_idx].children.emplace_back(model.nodes.size());
+
+            auto& node = model.nodes.emplace_back();
+            node.name = std::format("Things {}", texture.name.to_string());
+            node.transform = fastgltf::TRS{
+                .translation = {0, 0, 0},
+                .rotation = {0, 0, 0, 1},
+                .scale = {1, 1, 1},
+            };
+            node.meshIndex = get_sprite_mesh(sprite);
+
+            // The instances are interleaved in buffer view 4
+            const auto first_instance = group_offsets[group];
+            const auto num_instances = group_offsets[group + 1] - first_instance;
+            const auto add_instance_accessor = [&](
+                const size_t member_offset, const fastgltf::AccessorType type,
+                const fastgltf::ComponentType component_type
+            ) {
+                const auto accessor_index = model.accessors.size();
+                auto& accessor = model.accessors.emplace_back();
+                accessor.bufferViewIndex = 4;
+                accessor.byteOffset = first_instance * sizeof(ThingInstance) + member_offset;
+                accessor.componentType = component_type;
+                accessor.count = num_instances;
+                accessor.type = type;
+                return accessor_index;
+            };
+            node.instancingAttributes.emplace_back(
+                "TRANSLATION",
+                add_instance_accessor(
+                    offsetof(ThingInstance, translation), fastgltf::AccessorType::Vec3, fastgltf::ComponentType::Float
+                )
+            );
+            node.instancingAttributes.emplace_back(
+                "ROTATION",
+                add_instance_accessor(
+                    offsetof(ThingInstance, rotation), fastgltf::AccessorType::Vec4, fastgltf::ComponentType::Float
+                )
+            );
+            node.instancingAttributes.emplace_back(
+                "_THING",
+                add_instance_accessor(
+                    offsetof(ThingInstance, type), fastgltf::AccessorType::Vec2,
+                    fastgltf::ComponentType::UnsignedShort
+                )
+            );
+
+            node_extras.emplace_back(std::nullopt);
+        }
+    } else if (options.export_things) {
         // Put all the Things at the end
         auto thing_counter = 0u;
         for (const auto& thing : map.things) {
@@ -335,21 +427,15 @@ ExportedWad export_to_gltf(const std::string_view name, const Map& map, const Ma
             auto& node = model.nodes.emplace_back();
             node.name = std::format("Thing {}", thing_counter);
 
+            const auto thing_position = (thing.position - position_offset) * position_scale;
             const auto thing_rotation = glm::angleAxis(thing.angle, glm::vec3{0, 0, 1});
             node.transform = fastgltf::TRS{
-                .translation = {thing.position.x, thing.position.y, thing.position.z},
+                .translation = {thing_position.x, thing_position.y, thing_position.z},
                 .rotation = {thing_rotation.x, thing_rotation.y, thing_rotation.z, thing_rotation.w},
                 .scale = {1, 1, 1},
             };
 
-            node.meshIndex = model.meshes.size();
-
-            auto& mesh = model.meshes.emplace_back();
-            mesh.name = node.name;
-
-            add_face(thing.sprite, model, positions, normals, texcoords, indices, mesh);
-
-            model.materials[thing.sprite.texture_index].doubleSided = true;
+            node.meshIndex = get_sprite_mesh(thing.sprite);
 
             const nlohmann::json thing_json = ThingExtra{.type = Type::Thing, .data = thing};
             node_extras.emplace_back(thing_json.dump());
@@ -362,54 +448,84 @@ ExportedWad export_to_gltf(const std::string_view name, const Map& map, const Ma
     indices_buffer_view.name = "Indices Buffer View";
     indices_buffer_view.bufferIndex = 0;
     indices_buffer_view.byteOffset = 0;
-    indices_buffer_view.byteLength = indices.size();
+    indices_buffer_view.byteLength = geometry.indices.size();
     indices_buffer_view.target = fastgltf::BufferTarget::ElementArrayBuffer; // lmao
 
+    // Each view covers its whole buffer, whichever types the attributes are in
+    const auto position_size = quantized != nullptr ? sizeof(quantized->positions[0]) : sizeof(glm::vec3);
+    const auto normal_size = quantized != nullptr ? sizeof(quantized->normals[0]) : sizeof(glm::vec3);
+    const auto texcoord_size = is_texcoord_quantized ? sizeof(quantized->texcoords[0]) : sizeof(glm::vec2);
+
     auto& positions_buffer_view = model.bufferViews.emplace_back();
     positions_buffer_view.name = "Positions Buffer View";
     positions_buffer_view.bufferIndex = 1;
     positions_buffer_view.byteOffset = 0;
-    positions_buffer_view.byteLength = positions.size();
-    positions_buffer_view.byteStride = sizeof(glm::vec3);
+    positions_buffer_view.byteLength = geometry.positions.size() * position_size;
+    positions_buffer_view.byteStride = position_size;
     positions_buffer_view.target = fastgltf::BufferTarget::ArrayBuffer;
 
     auto& normals_buffer_view = model.bufferViews.emplace_back();
     normals_buffer_view.name = "Normals Buffer View";
     normals_buffer_view.bufferIndex = 2;
     normals_buffer_view.byteOffset = 0;
-    normals_buffer_view.byteLength = normals.size();
-    normals_buffer_view.byteStride = sizeof(glm::vec3);
+    normals_buffer_view.byteLength = geometry.normals.size() * normal_size;
+    normals_buffer_view.byteStride = normal_size;
     normals_buffer_view.target = fastgltf::BufferTarget::ArrayBuffer;
 
     auto& texcoords_buffer_view = model.bufferViews.emplace_back();
     texcoords_buffer_view.name = "Texcoords Buffer View";
     texcoords_buffer_view.bufferIndex = 3;
     texcoords_buffer_view.byteOffset = 0;
-    texcoords_buffer_view.byteLength = texcoords.size();
-    texcoords_buffer_view.byteStride = sizeof(glm::vec2);
+    texcoords_buffer_view.byteLength = geometry.texcoords.size() * texcoord_size;
+    texcoords_buffer_view.byteStride = texcoord_size;
     texcoords_buffer_view.target = fastgltf::BufferTarget::ArrayBuffer;
 
-    // Buffers for all the attributes, hopefully in a format that's easy to mutate
+    // Buffers for all the attributes. They borrow the map's arrays, or the quantized ones, which are already in the
+    // right layout
     model.buffers.resize(4);
     auto& indices_buffer = model.buffers[0];
-    indices_buffer.byteLength = indices.size();
+    indices_buffer.byteLength = geometry.indices.size();
     indices_buffer.name = "Indices";
-    indices_buffer.data = fastgltf::sources::Array{.bytes = fastgltf::StaticVector<uint8_t>::fromVector(indices)};
+    indices_buffer.data = view_buffer_data<uint8_t>(geometry.indices);
 
     auto& positions_buffer = model.buffers[1];
-    positions_buffer.byteLength = positions.size();
+    positions_buffer.byteLength = positions_buffer_view.byteLength;
     positions_buffer.name = "Positions";
-    positions_buffer.data = fastgltf::sources::Array{.bytes = fastgltf::StaticVector<uint8_t>::fromVector(positions)};
+    positions_buffer.data = quantized != nullptr
+                                ? view_buffer_data<std::array<int16_t, 4>>(quantized->positions)
+                                : view_buffer_data<glm::vec3>(geometry.positions);
 
     auto& normals_buffer = model.buffers[2];
-    normals_buffer.byteLength = normals.size();
+    normals_buffer.byteLength = normals_buffer_view.byteLength;
     normals_buffer.name = "Normals";
-    normals_buffer.data = fastgltf::sources::Array{.bytes = fastgltf::StaticVector<uint8_t>::fromVector(normals)};
+    normals_buffer.data = quantized != nullptr
+                              ? view_buffer_data<std::array<int8_t, 4>>(quantized->normals)
+                              : view_buffer_data<glm::vec3>(geometry.normals);
 
     auto& texcoords_buffer = model.buffers[3];
-    texcoords_buffer.byteLength = texcoords.size();
+    texcoords_buffer.byteLength = texcoords_buffer_view.byteLength;
     texcoords_buffer.name = "Texcoords";
-    texcoords_buffer.data = fastgltf::sources::Array{.bytes = fastgltf::StaticVector<uint8_t>::fromVector(texcoords)};
+    texcoords_buffer.data = is_texcoord_quantized
+                                ? view_buffer_data<std::array<int16_t, 2>>(quantized->texcoords)
+                                : view_buffer_data<glm::vec2>(geometry.texcoords);
+
+    if (!exported_wad.thing_instances.empty()) {
+        const auto& instances = exported_wad.thing_instances;
+
+        auto& instances_buffer_view = model.bufferViews.emplace_back();
+        instances_buffer_view.name = "Thing Instances Buffer View";
+        instances_buffer_view.bufferIndex = 4;
+        instances_buffer_view.byteOffset = 0;
+        instances_buffer_view.byteLength = instances.size() * sizeof(ThingInstance);
+        instances_buffer_view.byteStride = sizeof(ThingInstance);
+
+        auto& instances_buffer = model.buffers.emplace_back();
+        instances_buffer.byteLength = instances_buffer_view.byteLength;
+        instances_buffer.name = "Thing Instances";
+        instances_buffer.data = view_buffer_data<ThingInstance>(instances);
+    }
 
-    return { .asset = std::move(model), .node_extras = std::move(node_extras) };
+    exported_wad.node_extras = std::move(node_extras);
+    exported_wad.scene_extras = std::move(scene_extras);
+    return exported_wad;
 }
@@ -1,21 +1,72 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
 #include <string_view>
+#include <vector>
 
 #include <fastgltf/types.hpp>
 
 #include "extraction_options.hpp"
 #include "mesh.hpp"
+#include "mesh_quantization.hpp"
+
+/**
+ * \brief One Thing, as an instance of its sprite's Mesh
+ *
+ * EXT_mesh_gpu_instancing reads each member as an instance attribute: TRANSLATION, ROTATION, and _THING for the type
+ * and flags. The translation is in the same space as the sectors' vertices
+ */
+struct ThingInstance {
+    std::array<float, 3> translation;
+
+    /**
+     * Quaternion, as x, y, z, w
+     */
+    std::array<float, 4> rotation;
+
+    uint16_t type;
+    uint16_t flags;
+};
+
+static_assert(sizeof(ThingInstance) == 32);
 
 struct ExportedWad {
     fastgltf::Asset asset;
     std::vector<std::optional<std::string>> node_extras;
+    std::vector<std::optional<std::string>> scene_extras;
+
+    /**
+     * The vertex attributes that the asset's buffers view, if the map was quantized
+     */
+    QuantizedMeshBuffers quantized_geometry;
+
+    /**
+     * The Things that the asset's instance attributes view, if they were instanced
+     */
+    std::vector<ThingInstance> thing_instances;
 };
 
 /**
  * Exports a map's data to glTF
  *
- * Each Sector becomes a glTF Mesh (and thus a glTF Node). Each face in the Sector is a glTF Primitive. We create a
- * glTF Material for each Texture
+ * Each Sector becomes a glTF Mesh (and thus a glTF Node). Each primitive of the Sector's welded mesh is a glTF
+ * Primitive, and all of a Sector's Primitives share one set of vertex attributes. We create a glTF Material for each
+ * Texture
+ *
+ * If the map's sectors are batched, each SectorBatch is a Mesh and a Node instead, and the Sectors' Nodes have no Mesh
+ *
+ * Things that use the same sprite share its Mesh. With options.instance_things, they're also drawn from a single Node
+ * per sprite with EXT_mesh_gpu_instancing, instead of a Node each
+ *
+ * The glTF buffers are views of the map's MeshBuffers, so the map must outlive the asset. Nothing is copied until the
+ * buffers are written out
+ *
+ * With options.quantize_meshes, the vertex attributes are quantized with KHR_mesh_quantization instead. The position
+ * scale is undone by the scale of the map's top-level node, and the texcoord scale by a KHR_texture_transform on each
+ * material. The buffers view the ExportedWad's quantized_geometry then
+ *
+ * If the map has a collision BVH, the scene's extras say where it is. fastgltf doesn't write extras for the asset
+ * itself, so the scene, which holds the whole map, is the closest place for them
  */
 ExportedWad export_to_gltf(std::string_view name, const Map& map, const MapExtractionOptions& options);
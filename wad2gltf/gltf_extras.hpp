@@ -6,10 +6,13 @@
 
 NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(Thing, type, flags);
 NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(Sector, light_level, special_type, tag_number);
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(SectorVertexRange, sector, first_vertex, vertex_count);
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(SectorBatch, sector_ranges);
 
 enum class Type {
     Thing,
     Sector,
+    SectorBatch,
 };
 
 template <typename DataType>
@@ -22,3 +25,23 @@ struct BaseExtra {
 
 using ThingExtra = BaseExtra<Thing>;
 using SectorExtra = BaseExtra<Sector>;
+using SectorBatchExtra = BaseExtra<SectorBatch>;
+
+/**
+ * Where to find the map's collision BVH, relative to the glTF file. See collision_bvh.hpp for its layout
+ */
+struct CollisionBvhExtra {
+    std::string uri;
+    uint32_t version;
+    uint32_t node_count;
+    uint32_t triangle_count;
+    uint64_t byte_length;
+};
+
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(CollisionBvhExtra, uri, version, node_count, triangle_count, byte_length);
+
+struct SceneExtra {
+    CollisionBvhExtra collision_bvh;
+
+    NLOHMANN_DEFINE_TYPE_INTRUSIVE(SceneExtra, collision_bvh);
+};
@@ -0,0 +1,286 @@
+#include "lump_cache.hpp"
+
+#include <algorithm>
+#include <format>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "wad.hpp"
+
+namespace wad {
+    static thread_local LumpPinScope* current_pin_scope = nullptr;
+
+    static uint64_t get_lump_key(const LumpInfo& lump) {
+        return static_cast<uint64_t>(static_cast<uint32_t>(lump.filepos)) << 32 | static_cast<uint32_t>(lump.size);
+    }
+
+    LumpPinScope::LumpPinScope() : previous_scope{current_pin_scope} {
+        current_pin_scope = this;
+    }
+
+    LumpPinScope::~LumpPinScope() {
+        for (const auto& [cache, lump_key] : pins) {
+            cache->unpin(lump_key);
+        }
+
+        current_pin_scope = previous_scope;
+    }
+
+    LumpPinScope* LumpPinScope::get_current() {
+        return current_pin_scope;
+    }
+
+    void LumpPinScope::add_pin(LumpCache* cache, const uint64_t lump_key) {
+        pins.emplace_back(cache, lump_key);
+    }
+
+    std::unique_ptr<LumpCache> LumpCache::open(const std::filesystem::path& wad_path, const size_t budget_bytes) {
+        // The constructor is private, so we can't use make_unique
+        auto cache = std::unique_ptr<LumpCache>{new LumpCache{}};
+        cache->budget_bytes = budget_bytes;
+
+#ifdef _WIN32
+        auto* file = CreateFileW(
+            wad_path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr
+        );
+        if (file == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error{"Could not open WAD file"};
+        }
+        cache->file = file;
+
+        auto file_size = LARGE_INTEGER{};
+        if (!GetFileSizeEx(file, &file_size)) {
+            throw std::runtime_error{"Could not get the size of the WAD file"};
+        }
+        cache->file_size = static_cast<uint64_t>(file_size.QuadPart);
+#else
+        const auto wad_path_string = wad_path.string();
+        cache->file = ::open(wad_path_string.c_str(), O_RDONLY);
+        if (cache->file == -1) {
+            throw std::runtime_error{"Could not open WAD file"};
+        }
+
+        struct stat file_stat = {};
+        if (fstat(cache->file, &file_stat) != 0) {
+            throw std::runtime_error{"Could not get the size of the WAD file"};
+        }
+        cache->file_size = static_cast<uint64_t>(file_stat.st_size);
+#endif
+
+        cache->header = std::make_unique<Header>();
+        if (!cache->read_at(0, std::span{reinterpret_cast<uint8_t*>(cache->header.get()), sizeof(Header)})) {
+            throw std::runtime_error{"WAD file is too small to contain a header"};
+        }
+
+        const auto& header = *cache->header;
+        if (header.infotableofs < 0 || header.numlumps < 0) {
+            throw std::runtime_error{"WAD lump directory is out of bounds"};
+        }
+
+        cache->lump_directory.resize(header.numlumps);
+        const auto directory_bytes = std::span{
+            reinterpret_cast<uint8_t*>(cache->lump_directory.data()), cache->lump_directory.size() * sizeof(LumpInfo)
+        };
+        if (!cache->read_at(header.infotableofs, directory_bytes)) {
+            throw std::runtime_error{"WAD lump directory is out of bounds"};
+        }
+
+        return cache;
+    }
+
+    LumpCache::~LumpCache() {
+#ifdef _WIN32
+        if (file != nullptr) {
+            CloseHandle(file);
+        }
+#else
+        if (file != -1) {
+            close(file);
+        }
+#endif
+    }
+
+    const Header& LumpCache::get_header() const {
+        return *header;
+    }
+
+    std::span<const LumpInfo> LumpCache::get_lump_directory() const {
+        return lump_directory;
+    }
+
+    std::span<const uint8_t> LumpCache::get_lump_data(const LumpInfo& lump) {
+        auto* pin_scope = LumpPinScope::get_current();
+        if (pin_scope == nullptr) {
+            throw std::runtime_error{std::format("Lump {} was read without a LumpPinScope", lump.name)};
+        }
+        if (!is_in_file(lump)) {
+            throw std::runtime_error{std::format("Lump {} is out of bounds", lump.name)};
+        }
+        if (lump.size == 0) {
+            return {};
+        }
+
+        const auto lump_key = get_lump_key(lump);
+
+        {
+            auto lock = std::lock_guard{cache_mutex};
+            if (entries.contains(lump_key)) {
+                auto& entry = insert_or_touch(lump_key, {});
+                entry.pin_count++;
+                pin_scope->add_pin(this, lump_key);
+                return entry.data;
+            }
+        }
+
+        // Read outside the lock, so that threads that hit the cache don't wait on our I/O
+        auto data = std::vector<uint8_t>(static_cast<size_t>(lump.size));
+        if (!read_at(static_cast<uint64_t>(lump.filepos), data)) {
+            throw std::runtime_error{std::format("Could not read lump {}", lump.name)};
+        }
+
+        auto lock = std::lock_guard{cache_mutex};
+        auto& entry = insert_or_touch(lump_key, std::move(data));
+        entry.pin_count++;
+        pin_scope->add_pin(this, lump_key);
+        evict_to_budget(lump_key);
+
+        return entry.data;
+    }
+
+    void LumpCache::prefetch(const std::span<const LumpInfo* const> lumps) {
+        auto missing_lumps = std::vector<const LumpInfo*>{};
+        missing_lumps.reserve(lumps.size());
+        {
+            auto lock = std::lock_guard{cache_mutex};
+            for (const auto* lump : lumps) {
+                // Lumps outside the file are left for get_lump_data to report, if anything reads them
+                if (lump->size > 0 && is_in_file(*lump) && !entries.contains(get_lump_key(*lump))) {
+                    missing_lumps.emplace_back(lump);
+                }
+            }
+        }
+
+        std::ranges::sort(missing_lumps, {}, [](const LumpInfo* lump) { return lump->filepos; });
+
+        auto* pin_scope = LumpPinScope::get_current();
+
+        const auto get_lump_end = [](const LumpInfo& lump) {
+            return static_cast<uint64_t>(lump.filepos) + static_cast<uint64_t>(lump.size);
+        };
+
+        auto run_start = size_t{0};
+        while (run_start < missing_lumps.size()) {
+            // Grow the run while the next lump starts close to the end of the run
+            const auto run_offset = static_cast<uint64_t>(missing_lumps[run_start]->filepos);
+            auto run_end_offset = get_lump_end(*missing_lumps[run_start]);
+            auto run_end = run_start + 1;
+            while (run_end < missing_lumps.size()) {
+                const auto* lump = missing_lumps[run_end];
+                if (static_cast<uint64_t>(lump->filepos) > run_end_offset + MaxPrefetchGap) {
+                    break;
+                }
+                run_end_offset = std::max(run_end_offset, get_lump_end(*lump));
+                run_end++;
+            }
+
+            auto run_data = std::vector<uint8_t>(static_cast<size_t>(run_end_offset - run_offset));
+            if (!read_at(run_offset, run_data)) {
+                throw std::runtime_error{std::format("Could not read lump {}", missing_lumps[run_start]->name)};
+            }
+
+            auto lock = std::lock_guard{cache_mutex};
+            for (auto i = run_start; i < run_end; i++) {
+                const auto& lump = *missing_lumps[i];
+                const auto* lump_start = run_data.data() + (static_cast<uint64_t>(lump.filepos) - run_offset);
+                const auto lump_key = get_lump_key(lump);
+
+                auto& entry = insert_or_touch(lump_key, std::vector(lump_start, lump_start + lump.size));
+                if (pin_scope != nullptr) {
+                    entry.pin_count++;
+                    pin_scope->add_pin(this, lump_key);
+                }
+            }
+            evict_to_budget(get_lump_key(*missing_lumps[run_end - 1]));
+
+            run_start = run_end;
+        }
+    }
+
+    void LumpCache::unpin(const uint64_t lump_key) {
+        auto lock = std::lock_guard{cache_mutex};
+        if (const auto itr = entries.find(lump_key); itr != entries.end()) {
+            itr->second.pin_count--;
+        }
+
+        evict_to_budget(std::nullopt);
+    }
+
+    bool LumpCache::read_at(uint64_t offset, std::span<uint8_t> destination) const {
+        while (!destination.empty()) {
+#ifdef _WIN32
+            auto overlapped = OVERLAPPED{};
+            overlapped.Offset = static_cast<DWORD>(offset);
+            overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+            auto bytes_read = DWORD{0};
+            const auto chunk_size = static_cast<DWORD>(std::min(destination.size(), size_t{1} << 30));
+            if (!ReadFile(file, destination.data(), chunk_size, &bytes_read, &overlapped) || bytes_read == 0) {
+                return false;
+            }
+#else
+            const auto bytes_read = pread(file, destination.data(), destination.size(), static_cast<off_t>(offset));
+            if (bytes_read <= 0) {
+                return false;
+            }
+#endif
+            offset += static_cast<uint64_t>(bytes_read);
+            destination = destination.subspan(static_cast<size_t>(bytes_read));
+        }
+
+        return true;
+    }
+
+    bool LumpCache::is_in_file(const LumpInfo& lump) const {
+        return lump.filepos >= 0 && lump.size >= 0 &&
+               static_cast<uint64_t>(lump.filepos) + static_cast<uint64_t>(lump.size) <= file_size;
+    }
+
+    LumpCache::Entry& LumpCache::insert_or_touch(const uint64_t lump_key, std::vector<uint8_t>&& data) {
+        const auto [itr, inserted] = entries.try_emplace(lump_key);
+        auto& entry = itr->second;
+        if (inserted) {
+            entry.data = std::move(data);
+            cached_bytes += entry.data.size();
+            lru_keys.emplace_front(lump_key);
+            entry.lru_position = lru_keys.begin();
+        } else {
+            lru_keys.splice(lru_keys.begin(), lru_keys, entry.lru_position);
+        }
+
+        return entry;
+    }
+
+    void LumpCache::evict_to_budget(const std::optional<uint64_t> keep_key) {
+        auto itr = lru_keys.end();
+        while (cached_bytes > budget_bytes && itr != lru_keys.begin()) {
+            --itr;
+            const auto lump_key = *itr;
+            auto entry_itr = entries.find(lump_key);
+            if (lump_key == keep_key || entry_itr->second.pin_count > 0) {
+                continue;
+            }
+
+            cached_bytes -= entry_itr->second.data.size();
+            entries.erase(entry_itr);
+            itr = lru_keys.erase(itr);
+        }
+    }
+}
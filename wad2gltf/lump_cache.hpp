@@ -0,0 +1,166 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace wad {
+    struct Header;
+    struct LumpInfo;
+    class LumpCache;
+
+    /**
+     * \brief Keeps the lumps read from streamed WADs in memory while it's alive
+     *
+     * Streamed WADs evict lumps when their cache goes over budget. Every lump that's read on this thread while a pin
+     * scope is alive is pinned, and won't be evicted until the scope ends. Streamed lumps can't be read without one.
+     * Readers create one of these at the top of any function that holds on to lump data, so spans from
+     * WAD::get_lump_data stay valid for the whole function. Scopes nest, and they're free when no WAD is streamed
+     */
+    class LumpPinScope {
+    public:
+        LumpPinScope();
+
+        LumpPinScope(const LumpPinScope& other) = delete;
+        LumpPinScope& operator=(const LumpPinScope& other) = delete;
+
+        LumpPinScope(LumpPinScope&& old) noexcept = delete;
+        LumpPinScope& operator=(LumpPinScope&& old) noexcept = delete;
+
+        ~LumpPinScope();
+
+        /**
+         * The innermost pin scope on this thread, or nullptr if there isn't one
+         */
+        static LumpPinScope* get_current();
+
+        void add_pin(LumpCache* cache, uint64_t lump_key);
+
+    private:
+        LumpPinScope* previous_scope = nullptr;
+
+        std::vector<std::pair<LumpCache*, uint64_t>> pins;
+    };
+
+    /**
+     * \brief Reads lumps from a WAD file on demand, and keeps recently-used lumps in a byte-budgeted LRU cache
+     *
+     * Only the header and lump directory are read up front, so a worker can open a huge WAD without holding a copy
+     * of it. Reads use positional I/O, so this is thread-safe
+     */
+    class LumpCache {
+    public:
+        /**
+         * \brief Opens a WAD file and reads its header and lump directory
+         *
+         * \param wad_path WAD file to open
+         * \param budget_bytes How many bytes of lump data to keep cached. Pinned lumps can push the cache over budget
+         * \throws std::runtime_error if the file can't be opened, or if its header or directory are invalid
+         */
+        static std::unique_ptr<LumpCache> open(const std::filesystem::path& wad_path, size_t budget_bytes);
+
+        LumpCache(const LumpCache& other) = delete;
+        LumpCache& operator=(const LumpCache& other) = delete;
+
+        LumpCache(LumpCache&& old) noexcept = delete;
+        LumpCache& operator=(LumpCache&& old) noexcept = delete;
+
+        ~LumpCache();
+
+        const Header& get_header() const;
+
+        std::span<const LumpInfo> get_lump_directory() const;
+
+        /**
+         * \brief Gets a lump's data, reading it from the file if it's not cached
+         *
+         * The lump is pinned to the innermost LumpPinScope on this thread, and stays valid until that scope ends.
+         * Another thread could evict an unpinned lump at any time, so reading a lump without a pin scope is an error
+         *
+         * \throws std::runtime_error if there's no LumpPinScope on this thread, or if the lump isn't inside the file
+         */
+        std::span<const uint8_t> get_lump_data(const LumpInfo& lump);
+
+        /**
+         * \brief Reads all the requested lumps that aren't cached yet
+         *
+         * The reads are sorted by file offset, and lumps that are close together in the file are read with a single
+         * read, so that the I/O stays sequential. Use this when you know all the lumps that some job needs, such as
+         * the lumps of a map
+         */
+        void prefetch(std::span<const LumpInfo* const> lumps);
+
+        void unpin(uint64_t lump_key);
+
+    private:
+        struct Entry {
+            std::vector<uint8_t> data;
+
+            std::list<uint64_t>::iterator lru_position;
+
+            uint32_t pin_count = 0;
+        };
+
+        /**
+         * Lumps closer together than this in the file are read with one read during prefetch
+         */
+        constexpr static inline size_t MaxPrefetchGap = 64 * 1024;
+
+#ifdef _WIN32
+        void* file = nullptr;
+#else
+        int file = -1;
+#endif
+
+        std::unique_ptr<Header> header;
+
+        uint64_t file_size = 0;
+
+        std::vector<LumpInfo> lump_directory;
+
+        size_t budget_bytes = 0;
+
+        std::mutex cache_mutex;
+
+        /**
+         * Cached lumps, keyed on their offset and size
+         */
+        std::unordered_map<uint64_t, Entry> entries;
+
+        /**
+         * Keys of the cached lumps, most recently used first
+         */
+        std::list<uint64_t> lru_keys;
+
+        size_t cached_bytes = 0;
+
+        LumpCache() = default;
+
+        bool read_at(uint64_t offset, std::span<uint8_t> destination) const;
+
+        /**
+         * Whether a lump is inside the file. PWADs sometimes have junk directory entries, so lumps are only checked
+         * when they're read
+         */
+        bool is_in_file(const LumpInfo& lump) const;
+
+        /**
+         * Adds a lump to the cache, or gets it if it's already there, and marks it as most recently used. Must be
+         * called with cache_mutex locked
+         */
+        Entry& insert_or_touch(uint64_t lump_key, std::vector<uint8_t>&& data);
+
+        /**
+         * Evicts the least recently used lumps that aren't pinned until we're under budget. Never evicts the lump
+         * with key keep_key, which is usually the lump we're about to return. Must be called with cache_mutex locked
+         */
+        void evict_to_budget(std::optional<uint64_t> keep_key);
+    };
+}
@@ -0,0 +1,48 @@
+#include "lump_index.hpp"
+
+#include <algorithm>
+
+#include "wad.hpp"
+
+namespace wad {
+    void LumpIndex::build(const std::span<const LumpInfo> lump_directory) {
+        last_lump_by_name.clear();
+        last_lump_by_name.reserve(lump_directory.size());
+
+        previous_lump_with_name.clear();
+        previous_lump_with_name.resize(lump_directory.size(), NoLump);
+
+        for (auto i = 0u; i < lump_directory.size(); i++) {
+            const auto [itr, inserted] = last_lump_by_name.try_emplace(lump_directory[i].name.key(), i);
+            if (!inserted) {
+                previous_lump_with_name[i] = itr->second;
+                itr->second = i;
+            }
+        }
+    }
+
+    std::optional<uint32_t> LumpIndex::find_last(const Name& name) const {
+        if (const auto itr = last_lump_by_name.find(name.key()); itr != last_lump_by_name.end()) {
+            return itr->second;
+        }
+
+        return std::nullopt;
+    }
+
+    std::vector<uint32_t> LumpIndex::find_all(const Name& name) const {
+        auto lumps = std::vector<uint32_t>{};
+
+        const auto last_lump = find_last(name);
+        if (!last_lump) {
+            return lumps;
+        }
+
+        for (auto lump = *last_lump; lump != NoLump; lump = previous_lump_with_name[lump]) {
+            lumps.emplace_back(lump);
+        }
+
+        std::reverse(lumps.begin(), lumps.end());
+
+        return lumps;
+    }
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include "wad_name.hpp"
+
+namespace wad {
+    struct LumpInfo;
+
+    /**
+     * \brief Hash index over a lump directory
+     *
+     * Built once when the WAD is loaded. Names are case-folded, so lookups are case-insensitive like in DOOM.
+     * Duplicate names resolve to the last lump in the directory, which is how PWADs override lumps from earlier in
+     * the directory. Earlier duplicates are kept in a chain, so that tools which care about them can still find them
+     */
+    class LumpIndex {
+    public:
+        /**
+         * \brief (Re)builds the index from a lump directory
+         */
+        void build(std::span<const LumpInfo> lump_directory);
+
+        /**
+         * \brief Finds the last lump with the requested name
+         *
+         * \return The index of the lump in the directory, or nullopt if there's no such lump
+         */
+        std::optional<uint32_t> find_last(const Name& name) const;
+
+        /**
+         * \brief Finds all the lumps with the requested name
+         *
+         * \return The indices of the lumps in the directory, in directory order
+         */
+        std::vector<uint32_t> find_all(const Name& name) const;
+
+    private:
+        constexpr static inline uint32_t NoLump = UINT32_MAX;
+
+        /**
+         * Index of the last lump with each name, keyed on the name's canonical key
+         */
+        std::unordered_map<uint64_t, uint32_t> last_lump_by_name;
+
+        /**
+         * For each lump, the index of the previous lump with the same name, or NoLump if it's the first one
+         */
+        std::vector<uint32_t> previous_lump_with_name;
+    };
+}
@@ -0,0 +1,92 @@
+#include "map_arena.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+MapArena::MapArena(const size_t initial_block_size) {
+    add_block(nullptr, initial_block_size);
+}
+
+void MapArena::reset() {
+    auto lock = std::lock_guard{blocks_mutex};
+
+    if (blocks.size() > 1) {
+        auto total_size = size_t{0};
+        for (const auto& block : blocks) {
+            total_size += block->size;
+        }
+
+        blocks.clear();
+        auto& block = blocks.emplace_back(std::make_unique<Block>());
+        block->data = std::make_unique_for_overwrite<std::byte[]>(total_size);
+        block->size = total_size;
+    }
+
+    blocks.back()->used.store(0, std::memory_order_relaxed);
+    current_block.store(blocks.back().get(), std::memory_order_release);
+}
+
+size_t MapArena::get_capacity() const {
+    auto lock = std::lock_guard{blocks_mutex};
+
+    auto capacity = size_t{0};
+    for (const auto& block : blocks) {
+        capacity += block->size;
+    }
+
+    return capacity;
+}
+
+void* MapArena::do_allocate(const size_t bytes, const size_t alignment) {
+    while (true) {
+        auto* block = current_block.load(std::memory_order_acquire);
+        if (auto* pointer = try_allocate(*block, bytes, alignment)) {
+            return pointer;
+        }
+
+        add_block(block, bytes + alignment);
+    }
+}
+
+void MapArena::do_deallocate(void*, size_t, size_t) {
+    // Memory is only freed by reset()
+}
+
+bool MapArena::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+    return this == &other;
+}
+
+void MapArena::add_block(const Block* full_block, const size_t min_size) {
+    auto lock = std::lock_guard{blocks_mutex};
+
+    // Another thread might have added a block while we were waiting for the lock
+    if (current_block.load(std::memory_order_acquire) != full_block) {
+        return;
+    }
+
+    // Each block is at least twice as big as the last one, so a big map only needs a few of them
+    const auto last_size = blocks.empty() ? size_t{0} : blocks.back()->size;
+    const auto block_size = std::max(last_size * 2, min_size);
+
+    auto& block = blocks.emplace_back(std::make_unique<Block>());
+    block->data = std::make_unique_for_overwrite<std::byte[]>(block_size);
+    block->size = block_size;
+
+    current_block.store(block.get(), std::memory_order_release);
+}
+
+void* MapArena::try_allocate(Block& block, const size_t bytes, const size_t alignment) {
+    const auto base = reinterpret_cast<uintptr_t>(block.data.get());
+
+    auto used = block.used.load(std::memory_order_relaxed);
+    while (true) {
+        const auto start = ((base + used + alignment - 1) & ~(uintptr_t{alignment} - 1)) - base;
+        if (start + bytes > block.size) {
+            return nullptr;
+        }
+
+        if (block.used.compare_exchange_weak(used, start + bytes, std::memory_order_relaxed)) {
+            return block.data.get() + start;
+        }
+    }
+}
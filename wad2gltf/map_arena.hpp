@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <vector>
+
+/**
+ * \brief A monotonic arena for the temporary data of one map conversion
+ *
+ * Allocating bumps an offset in the current block, and freeing does nothing. When a block is full, we get a bigger one
+ * from the heap. Everything is freed at once by reset()
+ *
+ * Unlike std::pmr::monotonic_buffer_resource, several threads can allocate from the same arena at once, so all the
+ * tasks that build a map can share their map's arena. Only the rare allocation that needs a new block takes a lock
+ */
+class MapArena final : public std::pmr::memory_resource {
+public:
+    /**
+     * \param initial_block_size Size of the first block, in bytes
+     */
+    explicit MapArena(size_t initial_block_size = 1 << 20);
+
+    MapArena(const MapArena& other) = delete;
+    MapArena& operator=(const MapArena& other) = delete;
+
+    MapArena(MapArena&& old) noexcept = delete;
+    MapArena& operator=(MapArena&& old) noexcept = delete;
+
+    ~MapArena() override = default;
+
+    /**
+     * \brief Frees everything that was allocated from the arena, so it can be used for the next map
+     *
+     * If the last map needed more than one block, they're replaced by a single block as big as all of them, so a
+     * similar map fits without going to the heap. Nothing can be allocating from the arena while it's reset, and
+     * nothing allocated from it can be used afterwards
+     */
+    void reset();
+
+    /**
+     * Total size of the blocks that the arena holds, in bytes
+     */
+    size_t get_capacity() const;
+
+private:
+    struct Block {
+        std::unique_ptr<std::byte[]> data;
+
+        size_t size = 0;
+
+        std::atomic<size_t> used = 0;
+    };
+
+    /**
+     * Guards blocks, and adding a new current block
+     */
+    mutable std::mutex blocks_mutex;
+
+    std::vector<std::unique_ptr<Block>> blocks;
+
+    std::atomic<Block*> current_block = nullptr;
+
+    void* do_allocate(size_t bytes, size_t alignment) override;
+
+    void do_deallocate(void* pointer, size_t bytes, size_t alignment) override;
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+    /**
+     * Adds a block with room for at least min_size bytes, unless another thread already replaced full_block
+     */
+    void add_block(const Block* full_block, size_t min_size);
+
+    static void* try_allocate(Block& block, size_t bytes, size_t alignment);
+};
@@ -0,0 +1,55 @@
+#include "map_data.hpp"
+
+namespace wad {
+    MapData load_map_data(const ResourceSet& resources, const MapEntry& map) {
+        resources.prefetch_map(map);
+
+        auto map_data = MapData{};
+        map_data.name = map.name;
+        map_data.is_udmf = map.is_udmf();
+
+        // Node builders write GL nodes for UDMF maps too, so get them before we branch
+        if (map.has_lump(MapLump::GlVert) && map.has_lump(MapLump::GlSegs) && map.has_lump(MapLump::GlSsect)) {
+            map_data.gl_vertexes = resources.get_map_lump_data<uint8_t>(map, MapLump::GlVert);
+            map_data.gl_segs = resources.get_map_lump_data<uint8_t>(map, MapLump::GlSegs);
+            map_data.gl_subsectors = resources.get_map_lump_data<uint8_t>(map, MapLump::GlSsect);
+        }
+
+        if (map_data.is_udmf) {
+            const auto textmap_text = resources.get_map_lump_data<char>(map, MapLump::Textmap);
+            auto textmap = std::make_unique<const TextMap>(
+                parse_textmap(std::string_view{textmap_text.data(), textmap_text.size()})
+            );
+
+            map_data.vertexes = textmap->vertexes;
+            map_data.linedefs = textmap->linedefs;
+            map_data.sidedefs = textmap->sidedefs;
+            map_data.sectors = textmap->sectors;
+            map_data.things = textmap->things;
+            map_data.textmap = std::move(textmap);
+
+            return map_data;
+        }
+
+        map_data.vertexes = resources.get_map_lump_data<Vertex>(map, MapLump::Vertexes);
+        map_data.linedefs = resources.get_map_lump_data<LineDef>(map, MapLump::Linedefs);
+        map_data.sidedefs = resources.get_map_lump_data<SideDef>(map, MapLump::Sidedefs);
+        map_data.sectors = resources.get_map_lump_data<Sector>(map, MapLump::Sectors);
+
+        // Some editors save maps without things while they're being built
+        if (map.has_lump(MapLump::Things)) {
+            map_data.things = resources.get_map_lump_data<Thing>(map, MapLump::Things);
+        }
+
+        if (map.has_lump(MapLump::Segs) && map.has_lump(MapLump::Ssectors)) {
+            map_data.segs = resources.get_map_lump_data<Seg>(map, MapLump::Segs);
+            map_data.subsectors = resources.get_map_lump_data<SubSector>(map, MapLump::Ssectors);
+            // Maps with a single subsector don't need any nodes
+            if (map.has_lump(MapLump::Nodes)) {
+                map_data.nodes = resources.get_map_lump_data<Node>(map, MapLump::Nodes);
+            }
+        }
+
+        return map_data;
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <memory>
+#include <span>
+
+#include "resource_set.hpp"
+#include "udmf_parser.hpp"
+
+namespace wad {
+    /**
+     * \brief The vertexes, linedefs, sidedefs, sectors, things, and nodes of one map
+     *
+     * Binary maps point straight at their lumps. UDMF maps are parsed from their TEXTMAP into the same structs, so
+     * nothing after loading cares which format a map is in
+     */
+    struct MapData {
+        Name name;
+
+        bool is_udmf = false;
+
+        std::span<const Vertex> vertexes;
+        std::span<const LineDef> linedefs;
+        std::span<const SideDef> sidedefs;
+        std::span<const Sector> sectors;
+        std::span<const Thing> things;
+
+        /**
+         * The map's BSP tree, if it has one. UDMF maps keep theirs in ZNODES, which we don't read
+         */
+        std::span<const Seg> segs;
+        std::span<const SubSector> subsectors;
+        std::span<const Node> nodes;
+
+        /**
+         * The map's GL nodes lumps, if it has them. Their layout depends on the GL nodes version, which is stored in
+         * the lumps themselves, so we keep them as bytes
+         */
+        std::span<const uint8_t> gl_vertexes;
+        std::span<const uint8_t> gl_segs;
+        std::span<const uint8_t> gl_subsectors;
+
+        /**
+         * Owns the arrays that the spans point at, for UDMF maps
+         */
+        std::unique_ptr<const TextMap> textmap;
+    };
+
+    /**
+     * \brief Loads a map's geometry and things
+     *
+     * The map's lumps are prefetched if its WAD is streamed. A binary map's spans point into its lumps, so keep a
+     * LumpPinScope alive for as long as you use the map data
+     *
+     * \throws std::runtime_error if the map is missing a lump it needs, or if its TEXTMAP can't be parsed
+     */
+    MapData load_map_data(const ResourceSet& resources, const MapEntry& map);
+}
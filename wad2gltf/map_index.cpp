@@ -0,0 +1,131 @@
+#include "map_index.hpp"
+
+#include <algorithm>
+
+#include "wad.hpp"
+
+namespace wad {
+    static const auto map_lump_keys = []() {
+        auto keys = std::array<uint64_t, static_cast<size_t>(MapLump::Count)>{};
+        for (auto i = 0u; i < keys.size(); i++) {
+            keys[i] = Name::from_string(map_lump_names[i]).key();
+        }
+        return keys;
+    }();
+
+    static const auto end_map_key = Name::from_string(std::string_view{"ENDMAP"}).key();
+
+    std::optional<MapLump> get_map_lump_kind(const Name& lump_name) {
+        const auto key = lump_name.key();
+        if (const auto itr = std::ranges::find(map_lump_keys, key); itr != map_lump_keys.end()) {
+            return static_cast<MapLump>(itr - map_lump_keys.begin());
+        }
+
+        return std::nullopt;
+    }
+
+    static bool is_gl_lump(const MapLump lump) {
+        return lump >= MapLump::GlVert && lump <= MapLump::GlPvs;
+    }
+
+    /**
+     * Adds the map lumps starting at first_lump to the map
+     *
+     * \return The index of the last lump that belongs to the map
+     */
+    static uint32_t add_map_lumps(
+        const std::span<const LumpInfo> lump_directory, const uint32_t first_lump, MapEntry& map
+    ) {
+        auto lump_index = first_lump;
+        for (; lump_index < lump_directory.size(); lump_index++) {
+            const auto& lump_name = lump_directory[lump_index].name;
+            if (map.is_udmf() && lump_name.key() == end_map_key) {
+                return lump_index;
+            }
+
+            const auto kind = get_map_lump_kind(lump_name);
+            if (!kind) {
+                // UDMF maps may have lumps we don't know about before ENDMAP
+                if (map.is_udmf()) {
+                    continue;
+                }
+                break;
+            }
+
+            // A second THINGS lump means that another map started without a marker, which we don't support
+            if (map.has_lump(*kind)) {
+                break;
+            }
+
+            map.lump_indices[static_cast<size_t>(*kind)] = lump_index;
+        }
+
+        return lump_index - 1;
+    }
+
+    MapEntry::MapEntry() {
+        lump_indices.fill(NoLump);
+    }
+
+    bool MapEntry::has_lump(const MapLump lump) const {
+        return lump_indices[static_cast<size_t>(lump)] != NoLump;
+    }
+
+    std::optional<uint32_t> MapEntry::get_lump_index(const MapLump lump) const {
+        if (!has_lump(lump)) {
+            return std::nullopt;
+        }
+
+        return lump_indices[static_cast<size_t>(lump)];
+    }
+
+    bool MapEntry::is_udmf() const {
+        return has_lump(MapLump::Textmap);
+    }
+
+    void MapIndex::build(const std::span<const LumpInfo> lump_directory) {
+        maps.clear();
+        last_map_by_name.clear();
+
+        for (auto i = 0u; i + 1 < lump_directory.size(); i++) {
+            const auto& marker = lump_directory[i];
+            const auto first_lump = get_map_lump_kind(lump_directory[i + 1].name);
+            if (!first_lump || get_map_lump_kind(marker.name)) {
+                continue;
+            }
+
+            if (is_gl_lump(*first_lump) && marker.name.starts_with("GL_")) {
+                // glBSP's GL_<map> marker. The GL nodes belong to the map with the rest of the name
+                const auto map_name = Name::from_string(std::string_view{marker.name.val + 3, 5});
+                const auto itr = last_map_by_name.find(map_name.key());
+                if (itr != last_map_by_name.end()) {
+                    i = add_map_lumps(lump_directory, i + 1, maps[itr->second]);
+                }
+                continue;
+            }
+
+            if (is_gl_lump(*first_lump)) {
+                continue;
+            }
+
+            auto& map = maps.emplace_back();
+            map.name = marker.name;
+            map.marker_index = i;
+            i = add_map_lumps(lump_directory, i + 1, map);
+
+            last_map_by_name[map.name.key()] = static_cast<uint32_t>(maps.size() - 1);
+        }
+    }
+
+    const MapEntry* MapIndex::find_map(const Name& map_name) const {
+        if (const auto itr = last_map_by_name.find(map_name.key()); itr != last_map_by_name.end()) {
+            return &maps[itr->second];
+        }
+
+        return nullptr;
+    }
+
+    std::span<const MapEntry> MapIndex::get_maps() const {
+        return maps;
+    }
+}
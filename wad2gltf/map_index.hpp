@@ -0,0 +1,114 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "wad_name.hpp"
+
+namespace wad {
+    struct LumpInfo;
+
+    /**
+     * The lumps that can follow a map marker. Different node builders and source ports add different lumps, and most
+     * of them are optional
+     */
+    enum class MapLump : uint8_t {
+        Things,
+        Linedefs,
+        Sidedefs,
+        Vertexes,
+        Segs,
+        Ssectors,
+        Nodes,
+        Sectors,
+        Reject,
+        Blockmap,
+        Behavior,
+        Textmap,
+        Znodes,
+        GlVert,
+        GlSegs,
+        GlSsect,
+        GlNodes,
+        GlPvs,
+
+        Count,
+    };
+
+    constexpr inline auto map_lump_names = std::array<std::string_view, static_cast<size_t>(MapLump::Count)>{
+        "THINGS", "LINEDEFS", "SIDEDEFS", "VERTEXES", "SEGS", "SSECTORS", "NODES", "SECTORS", "REJECT", "BLOCKMAP",
+        "BEHAVIOR", "TEXTMAP", "ZNODES", "GL_VERT", "GL_SEGS", "GL_SSECT", "GL_NODES", "GL_PVS"
+    };
+
+    /**
+     * Gets the kind of map lump with the given name, or nullopt if the name isn't a map lump
+     */
+    std::optional<MapLump> get_map_lump_kind(const Name& lump_name);
+
+    /**
+     * A map that we found in a lump directory, and where all its lumps are
+     */
+    struct MapEntry {
+        constexpr static inline uint32_t NoLump = UINT32_MAX;
+
+        Name name;
+
+        /**
+         * Index of the map marker lump in the lump directory
+         */
+        uint32_t marker_index = 0;
+
+        /**
+         * Index of each of the map's lumps in the lump directory, or NoLump if the map doesn't have that lump. The
+         * directory entry at that index has the lump's byte range
+         */
+        std::array<uint32_t, static_cast<size_t>(MapLump::Count)> lump_indices;
+
+        MapEntry();
+
+        bool has_lump(MapLump lump) const;
+
+        std::optional<uint32_t> get_lump_index(MapLump lump) const;
+
+        /**
+         * UDMF maps have a TEXTMAP lump instead of binary LINEDEFS, SIDEDEFS, VERTEXES, and SECTORS lumps
+         */
+        bool is_udmf() const;
+    };
+
+    /**
+     * Table of all the maps in a lump directory, built once when the WAD is loaded
+     *
+     * A map is a marker lump followed by map lumps. We take every map lump after the marker, in whatever order they're
+     * in, until we find a lump that isn't a map lump (or ENDMAP, for UDMF maps). GL nodes are attached to their map
+     * whether they follow the map's other lumps directly or are under a separate GL_<map> marker, like glBSP writes
+     * them
+     */
+    class MapIndex {
+    public:
+        void build(std::span<const LumpInfo> lump_directory);
+
+        /**
+         * Finds the last map with the requested name, or nullptr if there's no such map
+         */
+        const MapEntry* find_map(const Name& map_name) const;
+
+        /**
+         * All the maps, in directory order. If a name appears more than once, all the maps with that name are here
+         */
+        std::span<const MapEntry> get_maps() const;
+
+    private:
+        std::vector<MapEntry> maps;
+
+        /**
+         * Index in maps of the last map with each name, keyed on the name's canonical key
+         */
+        std::unordered_map<uint64_t, uint32_t> last_map_by_name;
+    };
+}
@@ -3,26 +3,77 @@
 #include <algorithm>
 #include <format>
 #include <iostream>
-#include <numeric>
 #include <set>
+#include <span>
+#include <unordered_set>
 
 #include <mapbox/earcut.hpp>
 
+#include "map_topology.hpp"
+#include "mesh_batching.hpp"
+#include "mesh_optimization.hpp"
+#include "mesh_welding.hpp"
 #include "sector.hpp"
-#include "wad.hpp"
+#include "resource_set.hpp"
+#include "subsector_polygons.hpp"
+#include "texture_registry.hpp"
+#include "wall_merging.hpp"
+
+/**
+ * Looks up textures in the map's registry for one geometry task, and remembers which textures the task used in which
+ * order. Replaying the tasks' texture uses in the order a single-threaded run would do the tasks gives us the final
+ * texture indices
+ */
+struct TextureUses {
+    TextureRegistry& registry;
+
+    std::pmr::vector<uint32_t>& used_textures;
+
+    uint32_t get_texture_index(const wad::Name& texture_name) {
+        return used_textures.emplace_back(registry.intern_texture(texture_name));
+    }
 
-struct SectorBoundaryFaces {
-    std::vector<Face> back_sidedef_faces;
-    std::vector<Face> front_sidedef_faces;
+    uint32_t get_flat_index(const wad::Name& flat_name) {
+        return used_textures.emplace_back(registry.intern_flat(flat_name));
+    }
 };
 
-void validate_lump_name(const wad::LumpInfo& lump, const std::string_view name) {
-    if (lump.name != name) {
-        throw std::runtime_error{
-            std::format("Invalid lump name! Expected: {} Actual: {}", name, std::string_view{lump.name.val, 8})
-        };
-    }
-}
+/**
+ * The faces that one linedef adds to the sectors on either side of it. They're only needed until they're copied into
+ * their sectors, so they live in the map's arena
+ */
+struct LinedefWalls {
+    explicit LinedefWalls(std::pmr::memory_resource* memory) :
+        front_faces{memory}, back_faces{memory}, used_textures{memory} {}
+
+    uint32_t front_sector = 0;
+    std::pmr::vector<Face> front_faces;
+
+    uint32_t back_sector = 0;
+    std::pmr::vector<Face> back_faces;
+
+    std::pmr::vector<uint32_t> used_textures;
+};
+
+/**
+ * Result of triangulating one sector's floor and ceiling
+ */
+struct SectorFlats {
+    explicit SectorFlats(std::pmr::memory_resource* memory) : ceiling{memory}, floor{memory}, used_textures{memory} {}
+
+    Flat ceiling;
+    Flat floor;
+
+    bool has_ceiling_texture = false;
+    bool has_floor_texture = false;
+
+    std::pmr::vector<uint32_t> used_textures;
+
+    /**
+     * Number of holes that we couldn't find an exterior loop for
+     */
+    size_t num_orphan_holes = 0;
+};
 
 Face create_face(
     const wad::Vertex& v0, const wad::Vertex v1, const int32_t bottom_height, const int32_t top_height
@@ -60,11 +111,70 @@ Face create_face(
     return face;
 }
 
+/**
+ * Checks that all the linedefs and sidedefs refer to things that exist, so that bad indices are reported instead of
+ * reading past the end of a lump
+ *
+ * Two-sided linedefs without a back sidedef only get a warning, since they're treated as one-sided
+ *
+ * \throws std::runtime_error if an index is out of bounds, or goes past vanilla limits when we don't allow that
+ */
+void validate_map_indices(
+    const std::span<const wad::LineDef> linedefs, const std::span<const wad::SideDef> sidedefs,
+    const std::span<const wad::Vertex> vertexes, const std::span<const wad::Sector> sectors, const bool extended_limits
+) {
+    const auto validate_sidedef_index = [&](const uint32_t linedef_index, const uint16_t sidedef_index) {
+        if (!extended_limits && sidedef_index > wad::LineDef::MaxVanillaSidedef) {
+            throw std::runtime_error{
+                std::format(
+                    "Linedef {} uses sidedef {}, which is past the vanilla limit of {} sidedefs. Use --extended-limits "
+                    "to convert limit-removing maps", linedef_index, sidedef_index, wad::LineDef::MaxVanillaSidedef + 1
+                )
+            };
+        }
+        if (sidedef_index >= sidedefs.size()) {
+            throw std::runtime_error{
+                std::format(
+                    "Linedef {} uses sidedef {}, but the map only has {} sidedefs", linedef_index, sidedef_index,
+                    sidedefs.size()
+                )
+            };
+        }
+    };
+
+    for (auto i = 0u; i < linedefs.size(); i++) {
+        const auto& linedef = linedefs[i];
+        if (linedef.start_vertex >= vertexes.size() || linedef.end_vertex >= vertexes.size()) {
+            throw std::runtime_error{std::format("Linedef {} uses a vertex that doesn't exist", i)};
+        }
+
+        validate_sidedef_index(i, linedef.front_sidedef);
+        if (linedef.back_sidedef != wad::LineDef::NoSidedef) {
+            validate_sidedef_index(i, linedef.back_sidedef);
+        } else if (linedef.flags & wad::LineDef::TwoSided) {
+            // Some released PWADs have these. Ports such as PrBoom clear the flag, and MapTopology ignores it too
+            std::cout << std::format(
+                "WARNING: Linedef {} is two-sided, but it has no back sidedef. Treating it as one-sided\n", i
+            );
+        }
+    }
+
+    for (auto i = 0u; i < sidedefs.size(); i++) {
+        if (sidedefs[i].sector_number >= sectors.size()) {
+            throw std::runtime_error{
+                std::format(
+                    "Sidedef {} uses sector {}, but the map only has {} sectors", i, sidedefs[i].sector_number,
+                    sectors.size()
+                )
+            };
+        }
+    }
+}
+
 void emit_face(
     const wad::Vertex& v0, const wad::Vertex& v1, const int16_t bottom, const int16_t top,
     const wad::Name& texture_name, const glm::i16vec2& texture_offset, const float pegged_height,
-    std::vector<Face>& destination, const wad::WAD& wad,
-    Map& map
+    std::pmr::vector<Face>& destination, TextureUses& textures
 ) {
     if(texture_name.is_none()) {
         // The Unofficial Doom Specs state that "-" means not rendered, so don't generate the face
@@ -72,7 +182,7 @@ void emit_face(
     }
 
     auto face = create_face(v0, v1, bottom, top);
-    face.texture_index = map.get_texture_index(texture_name, wad);
+    face.texture_index = textures.get_texture_index(texture_name);
 
     const auto line_length = glm::distance(
         glm::vec2{v0.x, v0.y}, glm::vec2{v1.x, v1.y}
@@ -83,7 +193,7 @@ void emit_face(
     face.vertices[2].texcoord = glm::vec2{0, pegged_height - face.vertices[2].position.z};
     face.vertices[3].texcoord = glm::vec2{line_length, pegged_height - face.vertices[3].position.z};
 
-    const auto& texture = map.textures[face.texture_index];
+    const auto& texture = textures.registry.get_texture(face.texture_index);
     // Apply offset and scale from pixels -> UV
     for (auto& vertex : face.vertices) {
         vertex.texcoord += texture_offset;
@@ -93,13 +203,11 @@ void emit_face(
     destination.emplace_back(face);
 }
 
-SectorBoundaryFaces generate_faces_for_sector_boundary(
+void generate_faces_for_sector_boundary(
     const wad::LineDef& linedef, const wad::Vertex& start_vertex, const wad::Vertex& end_vertex,
-    const std::span<const wad::SideDef> sidedefs, const std::span<const wad::Sector> sectors, const wad::WAD& wad,
-    Map& map, const bool skip_upper
+    const std::span<const wad::SideDef> sidedefs, const std::span<const wad::Sector> sectors, TextureUses& textures,
+    const bool skip_upper, LinedefWalls& walls
 ) {
-    auto boundary = SectorBoundaryFaces{};
-
     const auto& front_sidedef = sidedefs[linedef.front_sidedef];
     const auto& back_sidedef = sidedefs[linedef.back_sidedef];
     const auto& front_sector = sectors[front_sidedef.sector_number];
@@ -121,13 +229,13 @@ SectorBoundaryFaces generate_faces_for_sector_boundary(
             emit_face(
                 start_vertex, end_vertex, front_sector.floor_height, back_sector.floor_height,
                 front_sidedef.lower_texture_name, glm::i16vec2{front_sidedef.x_offset, front_sidedef.y_offset},
-                pegged_height, boundary.front_sidedef_faces, wad, map
+                pegged_height, walls.front_faces, textures
             );
         } else {
             emit_face(
                 end_vertex, start_vertex, back_sector.floor_height, front_sector.floor_height,
                 back_sidedef.lower_texture_name, glm::i16vec2{back_sidedef.x_offset, back_sidedef.y_offset},
-                pegged_height, boundary.back_sidedef_faces, wad, map
+                pegged_height, walls.back_faces, textures
             );
         }
     }
@@ -142,7 +250,7 @@ SectorBoundaryFaces generate_faces_for_sector_boundary(
             emit_face(
                 start_vertex, end_vertex, floor_height, ceiling_height, front_sidedef.middle_texture_name,
                 glm::i16vec2{front_sidedef.x_offset, front_sidedef.y_offset}, pegged_height,
-                boundary.front_sidedef_faces, wad, map
+                walls.front_faces, textures
             );
         }
 
@@ -150,7 +258,7 @@ SectorBoundaryFaces generate_faces_for_sector_boundary(
             emit_face(
                 end_vertex, start_vertex, floor_height, ceiling_height, back_sidedef.middle_texture_name,
                 glm::i16vec2{back_sidedef.x_offset, back_sidedef.y_offset},
-                pegged_height, boundary.back_sidedef_faces, wad, map
+                pegged_height, walls.back_faces, textures
             );
         }
     }
@@ -164,23 +272,22 @@ SectorBoundaryFaces generate_faces_for_sector_boundary(
             emit_face(
                 start_vertex, end_vertex, back_sector.ceiling_height, front_sector.ceiling_height,
                 front_sidedef.upper_texture_name, glm::i16vec2{front_sidedef.x_offset, front_sidedef.y_offset},
-                pegged_height, boundary.front_sidedef_faces, wad, map
+                pegged_height, walls.front_faces, textures
             );
         } else if (back_sidedef.upper_texture_name.is_valid()) {
             emit_face(
                 end_vertex, start_vertex, front_sector.ceiling_height, back_sector.ceiling_height,
                 back_sidedef.upper_texture_name, glm::i16vec2{back_sidedef.x_offset, back_sidedef.y_offset},
-                pegged_height, boundary.back_sidedef_faces, wad, map
+                pegged_height, walls.back_faces, textures
             );
         }
     }
-
-    return boundary;
 }
 
 void generate_one_sided_wall(
     const wad::LineDef& linedef, const wad::Vertex& start_vertex, const wad::Vertex end_vertex,
-    const wad::SideDef& sidedef, const std::span<const wad::Sector> sectors, const wad::WAD& wad, Map& map
+    const wad::SideDef& sidedef, const std::span<const wad::Sector> sectors, std::pmr::vector<Face>& faces,
+    TextureUses& textures
 ) {
     const auto flags = linedef.flags;
 
@@ -191,132 +298,306 @@ void generate_one_sided_wall(
         return;
     }
 
-    auto& faces = map.sectors[sidedef.sector_number].faces;
-
     const auto pegged_height = flags & wad::LineDef::LowerTextureUnpegged ? sector.floor_height : sector.ceiling_height;
     emit_face(
         start_vertex, end_vertex, sector.floor_height, sector.ceiling_height, sidedef.middle_texture_name,
-        glm::i16vec2{sidedef.x_offset, sidedef.y_offset}, pegged_height, faces, wad, map
+        glm::i16vec2{sidedef.x_offset, sidedef.y_offset}, pegged_height, faces, textures
     );
 }
 
-std::vector<SectorVertex> extract_line_loop(
-    const std::span<const wad::Vertex> vertexes, const std::vector<std::pair<uint16_t, uint16_t>>& sector_linedefs,
-    std::vector<uint32_t>& remaining_lines
+void generate_linedef_walls(
+    const uint32_t linedef_index, const wad::MapData& map_data, const MapTopology& topology, TextureRegistry& registry,
+    LinedefWalls& walls
 ) {
-    auto vertices_in_loop = std::vector<SectorVertex>{};
-
-    auto cur_line_idx = remaining_lines[0];
-    auto iterating = true;
-    do {
-        std::erase(remaining_lines, cur_line_idx);
-        const auto& cur_line = sector_linedefs[cur_line_idx];
-
-        // Add our vertex to the loop
-        const auto& vertex = vertexes[cur_line.first];
-        vertices_in_loop.emplace_back(std::array{vertex.x, vertex.y});
-
-        // Find the line that continues the loop
-        iterating = false;
-        for (unsigned int idx : remaining_lines) {
-            const auto& test_line = sector_linedefs[idx];
-            if (test_line.first == cur_line.second) {
-                // This is a continuation of the loop, keep iterating
-                iterating = true;
-                cur_line_idx = idx;
-                break;
+    const auto& linedef = map_data.linedefs[linedef_index];
+    const auto& start_vertex = map_data.vertexes[linedef.start_vertex];
+    const auto& end_vertex = map_data.vertexes[linedef.end_vertex];
+    const auto sidedefs = map_data.sidedefs;
+    const auto sectors = map_data.sectors;
+
+    auto textures = TextureUses{.registry = registry, .used_textures = walls.used_textures};
+
+    const auto& front_half_edge = topology.get_half_edge(topology.get_front_half_edge(linedef_index));
+    const auto back_half_edge_index = topology.get_back_half_edge(linedef_index);
+    walls.front_sector = front_half_edge.sector;
+
+    if (back_half_edge_index != HalfEdge::None) {
+        // Two-sided wall
+        const auto& back_half_edge = topology.get_half_edge(back_half_edge_index);
+        walls.back_sector = back_half_edge.sector;
+
+        // Are we at the boundary between two sky sectors? If so, don't emit any upper faces
+        const auto& front_sector = sectors[front_half_edge.sector];
+        const auto& back_sector = sectors[back_half_edge.sector];
+        const auto skip_upper = front_sector.ceiling_texture.starts_with("F_SKY") &&
+                                back_sector.ceiling_texture.starts_with("F_SKY");
+
+        generate_faces_for_sector_boundary(
+            linedef, start_vertex, end_vertex, sidedefs, sectors, textures, skip_upper, walls
+        );
+    } else {
+        // One-sided wall
+        const auto& front_sidedef = sidedefs[linedef.front_sidedef];
+        generate_one_sided_wall(linedef, start_vertex, end_vertex, front_sidedef, sectors, walls.front_faces, textures);
+
+        if (linedef.back_sidedef != wad::LineDef::NoSidedef) {
+            const auto& back_sidedef = sidedefs[linedef.back_sidedef];
+            walls.back_sector = back_sidedef.sector_number;
+            // NOLINT(readability-suspicious-call-argument)
+            generate_one_sided_wall(
+                linedef, end_vertex, start_vertex, back_sidedef, sectors, walls.back_faces, textures
+            );
+        }
+    }
+}
+
+/**
+ * Triangulates a sector's line loops with earcut. Each exterior loop is a polygon, with the holes it owns cut out of it
+ *
+ * \param vertices Gets the vertices of all the loops, polygon by polygon
+ * \param indices Gets the triangles, in counter-clockwise order
+ */
+void triangulate_line_loops(
+    const std::vector<std::vector<SectorVertex>>& line_loops, const LoopClassification& classification,
+    const std::pmr::vector<std::pmr::vector<uint32_t>>& holes_per_loop, std::pmr::vector<glm::vec2>& vertices,
+    std::pmr::vector<uint32_t>& indices
+) {
+    auto polygon_line_loops = std::pmr::vector<std::pmr::vector<SectorVertex>>{vertices.get_allocator()};
+    for (const auto exterior_index : classification.exterior_loops) {
+        polygon_line_loops.clear();
+        polygon_line_loops.emplace_back(line_loops[exterior_index].begin(), line_loops[exterior_index].end());
+        for (const auto hole_index : holes_per_loop[exterior_index]) {
+            polygon_line_loops.emplace_back(line_loops[hole_index].begin(), line_loops[hole_index].end());
+        }
+
+        // First loop is assumed to be the polygon, and subsequent loops are holes
+        const auto polygon_indices = mapbox::earcut<uint32_t>(polygon_line_loops);
+        // As Earcut was run on the individual polygon, the indices always start at 0 and must be corrected
+        const auto first_vertex = static_cast<uint32_t>(vertices.size());
+        for (const auto index : polygon_indices) {
+            indices.emplace_back(index + first_vertex);
+        }
+
+        for (const auto& loop : polygon_line_loops) {
+            for (const auto& vertex : loop) {
+                vertices.emplace_back(vertex[0], vertex[1]);
             }
         }
-    } while (iterating);
+    }
+}
+
+/**
+ * Fan-triangulates a sector's subsector polygons. They're convex, so every fan is a valid triangulation
+ *
+ * \param vertices Gets the vertices of all the polygons
+ * \param indices Gets the triangles, in counter-clockwise order
+ */
+void triangulate_subsectors(
+    const SubsectorPolygons& subsector_polygons, const uint32_t sector_index, std::pmr::vector<glm::vec2>& vertices,
+    std::pmr::vector<uint32_t>& indices
+) {
+    const auto num_polygons = subsector_polygons.get_num_polygons(sector_index);
+    for (auto polygon_index = 0u; polygon_index < num_polygons; polygon_index++) {
+        const auto polygon = subsector_polygons.get_polygon(sector_index, polygon_index);
+
+        const auto first_vertex = static_cast<uint32_t>(vertices.size());
+        vertices.insert(vertices.end(), polygon.begin(), polygon.end());
 
-    return vertices_in_loop;
+        for (auto i = 1u; i + 1 < polygon.size(); i++) {
+            indices.emplace_back(first_vertex);
+            indices.emplace_back(first_vertex + i);
+            indices.emplace_back(first_vertex + i + 1);
+        }
+    }
 }
 
-void emit_ceiling_and_floor(
-    const wad::WAD& wad, const std::span<const wad::Sector> sectors, Map& map, const uint32_t i,
-    const std::vector<std::vector<SectorVertex>>& polygon_line_loops,
-    const std::vector<unsigned short>& ceiling_indices
+/**
+ * Triangulates a sector's floor and ceiling
+ *
+ * The floor and ceiling come from the sector's subsector polygons if we have them. Otherwise, or if the node builder
+ * left the sector without any subsectors, we split the sector into its line loops and triangulate them with earcut
+ */
+void generate_sector_flats(
+    const uint32_t sector_index, const wad::MapData& map_data, const MapTopology& topology,
+    const SubsectorPolygons* subsector_polygons, TextureRegistry& registry, SectorFlats& flats
 ) {
-    // We can add the indices as-is to a ceiling flat, but we have to reverse them for a floor flat
-    auto& map_sector = map.sectors[i];
-    auto& ceiling = map_sector.ceiling;
-    auto& floor = map_sector.floor;
+    auto* memory = flats.used_textures.get_allocator().resource();
 
-    const auto& sector = sectors[i];
-    ceiling.texture_index = map.get_flat_index(sector.ceiling_texture, wad);
-    floor.texture_index = map.get_flat_index(sector.floor_texture, wad);
+    const auto num_loops = topology.get_num_loops(sector_index);
+    if (num_loops == 0) {
+        return;
+    }
 
-    // Flatten the vertices arrays
-    auto vertices = std::vector<glm::vec2>{};
-    vertices.reserve(polygon_line_loops.size() * polygon_line_loops[0].size());
-    for (const auto& loop_vertices : polygon_line_loops) {
-        for (const auto& vertex : loop_vertices) {
-            vertices.emplace_back(vertex[0], vertex[1]);
+    auto vertices = std::pmr::vector<glm::vec2>{memory};
+    auto sector_ceiling_indices = std::pmr::vector<uint32_t>{memory};
+    if (subsector_polygons != nullptr && subsector_polygons->get_num_polygons(sector_index) > 0) {
+        triangulate_subsectors(*subsector_polygons, sector_index, vertices, sector_ceiling_indices);
+    } else {
+        auto sector_line_loops = std::vector<std::vector<SectorVertex>>{};
+        sector_line_loops.reserve(num_loops);
+        for (auto loop_index = 0u; loop_index < num_loops; loop_index++) {
+            auto loop = topology.get_loop_vertices(sector_index, loop_index);
+
+            if (!is_polygon_clockwise(loop)) {
+                std::reverse(loop.begin(), loop.end());
+            }
+
+            sector_line_loops.emplace_back(std::move(loop));
         }
+
+        const auto classification = classify_loops(sector_line_loops, memory);
+
+        // Holes are listed in loop order, like the loops themselves
+        auto holes_per_loop = std::pmr::vector<std::pmr::vector<uint32_t>>(sector_line_loops.size(), memory);
+        auto num_owned_holes = size_t{0};
+        for (auto loop_index = 0u; loop_index < sector_line_loops.size(); loop_index++) {
+            const auto owner = classification.hole_owners[loop_index];
+            if (owner != LoopClassification::NoOwner) {
+                holes_per_loop[owner].emplace_back(loop_index);
+                num_owned_holes++;
+            }
+        }
+        flats.num_orphan_holes = sector_line_loops.size() - classification.exterior_loops.size() - num_owned_holes;
+
+        triangulate_line_loops(sector_line_loops, classification, holes_per_loop, vertices, sector_ceiling_indices);
+    }
+
+    // We can add the indices as-is to a ceiling flat, but we have to reverse them for a floor flat
+
+    const auto& sector = map_data.sectors[sector_index];
+
+    // If we're in a sky sector, don't emit the ceiling
+    const auto is_sky_sector = !sector.ceiling_texture.starts_with("F_SKY");
+
+    auto textures = TextureUses{.registry = registry, .used_textures = flats.used_textures};
+    if (is_sky_sector) {
+        flats.ceiling.texture_index = textures.get_flat_index(sector.ceiling_texture);
+        flats.has_ceiling_texture = true;
     }
+    flats.floor.texture_index = textures.get_flat_index(sector.floor_texture);
+    flats.has_floor_texture = true;
 
-    ceiling.vertices.reserve(vertices.size());
-    floor.vertices.reserve(vertices.size());
+    flats.ceiling.vertices.reserve(vertices.size());
+    flats.floor.vertices.reserve(vertices.size());
 
     for (const auto& vertex : vertices) {
-        ceiling.vertices.emplace_back(vertex[0], vertex[1], sector.ceiling_height);
-        floor.vertices.emplace_back(vertex[0], vertex[1], sector.floor_height);
+        flats.ceiling.vertices.emplace_back(vertex[0], vertex[1], sector.ceiling_height);
+        flats.floor.vertices.emplace_back(vertex[0], vertex[1], sector.floor_height);
+    }
+
+    if (is_sky_sector) {
+        flats.ceiling.indices.resize(sector_ceiling_indices.size());
     }
+    flats.floor.indices.resize(sector_ceiling_indices.size());
+
+    for (auto triangle_index = 0u; triangle_index < sector_ceiling_indices.size(); triangle_index += 3) {
+        if (is_sky_sector) {
+            flats.ceiling.indices[triangle_index] = sector_ceiling_indices[triangle_index + 2];
+            flats.ceiling.indices[triangle_index + 1] = sector_ceiling_indices[triangle_index + 1];
+            flats.ceiling.indices[triangle_index + 2] = sector_ceiling_indices[triangle_index];
+        }
 
-    ceiling.indices.resize(ceiling_indices.size());
-    floor.indices.resize(ceiling_indices.size());
+        flats.floor.indices[triangle_index] = sector_ceiling_indices[triangle_index];
+        flats.floor.indices[triangle_index + 1] = sector_ceiling_indices[triangle_index + 1];
+        flats.floor.indices[triangle_index + 2] = sector_ceiling_indices[triangle_index + 2];
+    }
+}
 
-    for (auto triangle_index = 0u; triangle_index < ceiling_indices.size(); triangle_index += 3) {
-        ceiling.indices[triangle_index] = ceiling_indices[triangle_index + 2];
-        ceiling.indices[triangle_index + 1] = ceiling_indices[triangle_index + 1];
-        ceiling.indices[triangle_index + 2] = ceiling_indices[triangle_index];
+/**
+ * Gets the map's subsector polygons from its GL nodes if it has them, or else from its regular nodes. Broken nodes
+ * aren't fatal, since we can still triangulate the sectors' line loops
+ */
+std::optional<SubsectorPolygons> load_subsector_polygons(const wad::MapData& map_data) {
+    try {
+        if (auto polygons = SubsectorPolygons::from_gl_nodes(map_data)) {
+            return polygons;
+        }
+    } catch (const std::runtime_error& e) {
+        std::cout << std::format("WARNING: Can't use the GL nodes of map {}: {}\n", map_data.name, e.what());
+    }
+
+    try {
+        if (auto polygons = SubsectorPolygons::from_nodes(map_data)) {
+            return polygons;
+        }
+    } catch (const std::runtime_error& e) {
+        std::cout << std::format("WARNING: Can't use the nodes of map {}: {}\n", map_data.name, e.what());
+    }
+
+    std::cout << std::format(
+        "Map {} has no nodes that we can use, so its flats are triangulated from its linedefs\n", map_data.name
+    );
+
+    return std::nullopt;
+}
+
+/**
+ * Gets the triangles of every wall and flat, tagged with where they came from. Walls haven't been merged yet, so each
+ * wall triangle belongs to exactly one linedef
+ */
+std::vector<CollisionTriangle> get_collision_triangles(
+    std::span<const LinedefWalls> linedef_walls, std::span<const SectorFlats> sector_flats
+) {
+    auto triangles = std::vector<CollisionTriangle>{};
+
+    const auto add_faces = [&](const std::pmr::vector<Face>& faces, const uint32_t sector, const uint32_t linedef) {
+        for (const auto& face : faces) {
+            // 0 1 2 3 2 1, like the exported faces
+            const auto& vertices = face.vertices;
+            triangles.emplace_back(
+                CollisionTriangle{
+                    .vertices = {vertices[0].position, vertices[1].position, vertices[2].position},
+                    .sector = sector, .linedef = linedef, .surface = SurfaceType::Wall,
+                }
+            );
+            triangles.emplace_back(
+                CollisionTriangle{
+                    .vertices = {vertices[3].position, vertices[2].position, vertices[1].position},
+                    .sector = sector, .linedef = linedef, .surface = SurfaceType::Wall,
+                }
+            );
+        }
+    };
+    for (auto linedef_index = 0u; linedef_index < linedef_walls.size(); linedef_index++) {
+        const auto& walls = linedef_walls[linedef_index];
+        add_faces(walls.front_faces, walls.front_sector, linedef_index);
+        add_faces(walls.back_faces, walls.back_sector, linedef_index);
+    }
 
-        floor.indices[triangle_index] = ceiling_indices[triangle_index];
-        floor.indices[triangle_index + 1] = ceiling_indices[triangle_index + 1];
-        floor.indices[triangle_index + 2] = ceiling_indices[triangle_index + 2];
+    const auto add_flat = [&](const Flat& flat, const uint32_t sector, const SurfaceType surface) {
+        for (auto i = 0u; i + 2 < flat.indices.size(); i += 3) {
+            triangles.emplace_back(
+                CollisionTriangle{
+                    .vertices = {
+                        flat.vertices[flat.indices[i]], flat.vertices[flat.indices[i + 1]],
+                        flat.vertices[flat.indices[i + 2]]
+                    },
+                    .sector = sector, .linedef = CollisionTriangle::NoLinedef, .surface = surface,
+                }
+            );
+        }
+    };
+    for (auto sector_index = 0u; sector_index < sector_flats.size(); sector_index++) {
+        add_flat(sector_flats[sector_index].ceiling, sector_index, SurfaceType::Ceiling);
+        add_flat(sector_flats[sector_index].floor, sector_index, SurfaceType::Floor);
     }
+
+    return triangles;
 }
 
-Map create_mesh_from_map(const wad::WAD& wad, const MapExtractionOptions& options) {
-    auto itr = wad.find_lump(options.map_name);
-
-    std::cout << std::format("Loaded map lump {}\n", itr->name);
-
-    // DOOM wiki says these have to be in this order
-    const auto map_lump_itr = itr;
-    ++itr;
-    const auto things_itr = itr;
-    ++itr;
-    const auto linedefs_itr = itr;
-    ++itr;
-    const auto sidedefs_itr = itr;
-    ++itr;
-    const auto vertexes_itr = itr;
-    ++itr;
-    const auto segs_itr = itr;
-    ++itr;
-    const auto ssectors_itr = itr;
-    ++itr;
-    const auto nodes_itr = itr;
-    ++itr;
-    const auto sectors_itr = itr;
-
-    // There's some other optional things that don't seem important for this program
-
-    // Validate that the lumps are what they should be
-    validate_lump_name(*things_itr, "THINGS");
-    validate_lump_name(*linedefs_itr, "LINEDEFS");
-    validate_lump_name(*sidedefs_itr, "SIDEDEFS");
-    validate_lump_name(*vertexes_itr, "VERTEXES");
-    validate_lump_name(*segs_itr, "SEGS");
-    validate_lump_name(*ssectors_itr, "SSECTORS");
-    validate_lump_name(*nodes_itr, "NODES");
-    validate_lump_name(*sectors_itr, "SECTORS");
-
-    const auto linedefs = wad.get_lump_data<wad::LineDef>(*linedefs_itr);
-    const auto sidedefs = wad.get_lump_data<wad::SideDef>(*sidedefs_itr);
-    const auto vertexes = wad.get_lump_data<wad::Vertex>(*vertexes_itr);
-    const auto sectors = wad.get_lump_data<wad::Sector>(*sectors_itr);
+Map create_mesh_from_map(
+    const wad::ResourceSet& resources, const wad::MapData& map_data, const MapExtractionOptions& options,
+    ThreadPool& thread_pool, MapArena& arena
+) {
+    std::cout << std::format("Loaded map {}\n", map_data.name);
+
+    const auto linedefs = map_data.linedefs;
+    const auto sidedefs = map_data.sidedefs;
+    const auto vertexes = map_data.vertexes;
+    const auto sectors = map_data.sectors;
+
+    // UDMF maps are never vanilla maps, so they don't have vanilla limits
+    validate_map_indices(linedefs, sidedefs, vertexes, sectors, options.extended_limits || map_data.is_udmf);
 
     /*
      * So... how to make a mesh from all this?
@@ -342,200 +623,199 @@ Map create_mesh_from_map(const wad::WAD& wad, const MapExtractionOptions& option
 
     auto map = Map{};
     map.sectors.resize(sectors.size());
-    map.textures.reserve(sectors.size() * 2);
 
     // Copy the sector info into our data structure
     for (auto i = 0u; i < sectors.size(); i++) {
         const auto& sector = sectors[i];
         auto& map_sector = map.sectors[i];
+        map_sector.floor_height = sector.floor_height;
+        map_sector.ceiling_height = sector.ceiling_height;
         map_sector.light_level = sector.light_level;
         map_sector.special_type = sector.special_type;
         map_sector.tag_number = sector.tag_number;
     }
 
-    auto linedefs_per_sector = std::vector<std::vector<std::pair<uint16_t, uint16_t>>>(sectors.size());
+    const auto topology = MapTopology::build(map_data);
+    const auto subsector_polygons = options.earcut_flats ? std::nullopt : load_subsector_polygons(map_data);
+    auto registry = TextureRegistry{resources};
 
-    for (const auto& linedef : linedefs) {
-        const auto& start_vertex = vertexes[linedef.start_vertex];
-        const auto& end_vertex = vertexes[linedef.end_vertex];
-
-        const auto& front_sidedef = sidedefs[linedef.front_sidedef];
+    // Each linedef's walls and each sector's flats are a separate task. Tasks only write their own results, which we
+    // stitch together in linedef and sector order afterwards, so the output doesn't depend on how the tasks ran
+    auto linedef_walls = std::pmr::vector<LinedefWalls>{&arena};
+    linedef_walls.reserve(linedefs.size());
+    for (auto i = 0u; i < linedefs.size(); i++) {
+        linedef_walls.emplace_back(&arena);
+    }
+    auto sector_flats = std::pmr::vector<SectorFlats>{&arena};
+    sector_flats.reserve(sectors.size());
+    for (auto i = 0u; i < sectors.size(); i++) {
+        sector_flats.emplace_back(&arena);
+    }
 
-        linedefs_per_sector.at(front_sidedef.sector_number).emplace_back(linedef.start_vertex, linedef.end_vertex);
-        if (linedef.flags & wad::LineDef::TwoSided) {
-            const auto& back_sidedef = sidedefs[linedef.back_sidedef];
-            linedefs_per_sector.at(back_sidedef.sector_number).emplace_back(linedef.end_vertex, linedef.start_vertex);
+    thread_pool.parallel_for(linedefs.size() + sectors.size(), [&](const size_t task_index) {
+        if (task_index < linedefs.size()) {
+            const auto linedef_index = static_cast<uint32_t>(task_index);
+            generate_linedef_walls(linedef_index, map_data, topology, registry, linedef_walls[linedef_index]);
+        } else {
+            const auto sector_index = static_cast<uint32_t>(task_index - linedefs.size());
+            generate_sector_flats(
+                sector_index, map_data, topology, subsector_polygons ? &*subsector_polygons : nullptr, registry,
+                sector_flats[sector_index]
+            );
         }
-
-        // Are we at the boundary between two sky sectors? If so, don't emit any faces
-        auto skip_upper = false;
-        if(linedef.back_sidedef != -1) {
-            const auto& back_sidedef = sidedefs[linedef.back_sidedef];
-
-            const auto& front_sector = sectors[front_sidedef.sector_number];
-            const auto& back_sector = sectors[back_sidedef.sector_number];
-
-            if(front_sector.ceiling_texture.starts_with("F_SKY") && back_sector.ceiling_texture.starts_with("F_SKY")) {
-                skip_upper = true;
+    });
+
+    // Number the textures in the order that a single-threaded run would first use them: the walls in linedef order,
+    // then each sector's ceiling and floor
+    auto final_texture_indices = std::pmr::vector<uint32_t>{&arena};
+    auto texture_order = std::vector<uint32_t>{};
+    const auto add_texture_uses = [&](const std::pmr::vector<uint32_t>& used_textures) {
+        for (const auto registry_index : used_textures) {
+            if (registry_index >= final_texture_indices.size()) {
+                final_texture_indices.resize(registry_index + 1, UINT32_MAX);
             }
-        }
-
-        if (linedef.flags & wad::LineDef::TwoSided) {
-            // Two-sided wall
-
-            const auto& back_sidedef = sidedefs[linedef.back_sidedef];
-
-            const auto& [back_faces, front_faces] = generate_faces_for_sector_boundary(
-                linedef, start_vertex, end_vertex, sidedefs, sectors, wad, map, skip_upper
-            );
-
-            auto& front_sector_faces = map.sectors[front_sidedef.sector_number].faces;
-            front_sector_faces.insert(front_sector_faces.end(), front_faces.begin(), front_faces.end());
-
-            auto& back_sector_faces = map.sectors[back_sidedef.sector_number].faces;
-            back_sector_faces.insert(back_sector_faces.end(), back_faces.begin(), back_faces.end());
-        } else {
-            // One-sided wall
-            generate_one_sided_wall(linedef, start_vertex, end_vertex, front_sidedef, sectors, wad, map);
-
-            if (linedef.back_sidedef != -1) {
-                const auto& back_sidedef = sidedefs[linedef.back_sidedef];
-                // NOLINT(readability-suspicious-call-argument)
-                generate_one_sided_wall(linedef, end_vertex, start_vertex, back_sidedef, sectors, wad, map);
+            if (final_texture_indices[registry_index] == UINT32_MAX) {
+                final_texture_indices[registry_index] = static_cast<uint32_t>(texture_order.size());
+                texture_order.emplace_back(registry_index);
             }
         }
+    };
+    for (const auto& walls : linedef_walls) {
+        add_texture_uses(walls.used_textures);
+    }
+    for (const auto& flats : sector_flats) {
+        add_texture_uses(flats.used_textures);
     }
 
-    // Split the sector into its line loops and triangulate them
-    for (auto sector_index = 0u; sector_index < linedefs_per_sector.size(); sector_index++) {
-        const auto& sector_linedefs = linedefs_per_sector[sector_index];
-
-        auto remaining_lines = std::vector<uint32_t>(sector_linedefs.size());
-        std::iota(remaining_lines.begin(), remaining_lines.end(), 0);
+    map.textures = registry.take_textures(texture_order);
 
-        if (remaining_lines.empty()) {
-            continue;
+    // Each sector's walls, before they're merged and welded
+    auto sector_faces = std::pmr::vector<std::pmr::vector<Face>>(sectors.size(), &arena);
+    const auto append_faces = [&](std::pmr::vector<Face>& faces, const uint32_t sector_index) {
+        for (auto& face : faces) {
+            face.texture_index = final_texture_indices[face.texture_index];
+            sector_faces[sector_index].emplace_back(face);
         }
+    };
+    for (auto& walls : linedef_walls) {
+        append_faces(walls.front_faces, walls.front_sector);
+        append_faces(walls.back_faces, walls.back_sector);
+    }
 
-        auto sector_line_loops = std::vector<std::vector<SectorVertex>>{};
-        do {
-            auto loop = extract_line_loop(vertexes, sector_linedefs, remaining_lines);
-
-            if (!is_polygon_clockwise(loop)) {
-                std::reverse(loop.begin(), loop.end());
-            }
-
-            sector_line_loops.emplace_back(loop);
-        } while (!remaining_lines.empty());
-
-        auto exterior_line_loops = std::vector<std::vector<SectorVertex>>{};
-        auto interior_line_loops = std::vector<std::vector<SectorVertex>>{};
-        for (size_t j = 0u; j < sector_line_loops.size(); j++) {
-            auto& loop = sector_line_loops[j];
-
-            bool is_hole = false;
-            for (size_t k = 0u; k < sector_line_loops.size(); k++) {
-                if (k == j) {
-                    continue;
-                }
-
-                if (is_polygon_in_polygon(loop, sector_line_loops[k])) {
-                    is_hole = true;
-                    break;
-                }
-            }
-
-            if (is_hole) {
-                interior_line_loops.emplace_back(loop);
-            } else {
-                exterior_line_loops.emplace_back(loop);
-            }
+    for (auto sector_index = 0u; sector_index < sectors.size(); sector_index++) {
+        auto& flats = sector_flats[sector_index];
+        if (flats.has_ceiling_texture) {
+            flats.ceiling.texture_index = final_texture_indices[flats.ceiling.texture_index];
         }
-
-        uint32_t sector_vertex_count = 0u;
-        auto sector_ceiling_indices = std::vector<uint32_t>{};
-        sector_line_loops.clear();
-
-        auto& map_sector = map.sectors[sector_index];
-
-        for (const auto& polygon : exterior_line_loops) {
-            map_sector.exterior_loops.emplace_back(polygon);
-            auto polygon_line_loops = std::vector<std::vector<SectorVertex>>{polygon};
-
-            for (size_t j = 0u; j < interior_line_loops.size(); /**/) {
-                const auto& loop = interior_line_loops[j];
-                if (is_polygon_in_polygon(loop, polygon)) {
-                    polygon_line_loops.emplace_back(loop);
-                    interior_line_loops.erase(interior_line_loops.begin() + j);
-                    // NOTE: j is not incremented as we've erased it from the list that's being iterated
-                    continue;
-                }
-
-                j++;
-            }
-
-            // First loop is assumed to be the polygon, and subsequent loops are holes
-            auto polygon_ceiling_indices = mapbox::earcut<uint16_t>(polygon_line_loops);
-            // As Earcut was run on the individual polygon, the indices always start at 0 and must be corrected
-            for (auto& index : polygon_ceiling_indices) {
-                index += sector_vertex_count;
-            }
-            sector_ceiling_indices.insert(sector_ceiling_indices.end(), polygon_ceiling_indices.begin(), polygon_ceiling_indices.end());
-
-            sector_line_loops.insert(sector_line_loops.end(), polygon_line_loops.begin(), polygon_line_loops.end());
-            sector_vertex_count += static_cast<uint32_t>(polygon_line_loops.size());
+        if (flats.has_floor_texture) {
+            flats.floor.texture_index = final_texture_indices[flats.floor.texture_index];
         }
 
-        if (!interior_line_loops.empty()) {
-            std::cout << std::format("WARNING: Sector {} has {} remaining inner line loops!\n", sector_index, interior_line_loops.size());
+        if (flats.num_orphan_holes > 0) {
+            std::cout << std::format(
+                "WARNING: Sector {} has {} remaining inner line loops!\n", sector_index, flats.num_orphan_holes
+            );
         }
+    }
 
-        // We can add the indices as-is to a ceiling flat, but we have to reverse them for a floor flat
-
-        const auto& sector = sectors[sector_index];
-
-        // If we're in a sky sector, don't emit the ceiling
-        const auto is_sky_sector = !sector.ceiling_texture.starts_with("F_SKY");
+    if (options.export_bvh) {
+        map.collision_bvh = CollisionBvh::build(get_collision_triangles(linedef_walls, sector_flats));
+    }
 
-        if (is_sky_sector) {
-            map_sector.ceiling.texture_index = map.get_flat_index(sector.ceiling_texture, wad);
+    // Long walls are often split over many linedefs. Sectors don't share faces, so each one can be merged and welded on
+    // its own. Unless sectors are batched together, each one is optimized on its own too
+    const auto is_batching_sectors = options.mesh_batching == MeshBatching::Chunk ||
+                                     options.mesh_batching == MeshBatching::Map;
+    auto sector_meshes = std::pmr::vector<SectorMesh>{&arena};
+    sector_meshes.reserve(map.sectors.size());
+    for (auto i = 0u; i < map.sectors.size(); i++) {
+        sector_meshes.emplace_back(&arena);
+    }
+    auto mesh_cache_stats = std::pmr::vector<VertexCacheStats>(map.sectors.size(), &arena);
+    thread_pool.parallel_for(map.sectors.size(), [&](const size_t sector_index) {
+        auto& faces = sector_faces[sector_index];
+        const auto& flats = sector_flats[sector_index];
+        merge_collinear_walls(faces, map.textures, &arena);
+        auto& mesh = sector_meshes[sector_index];
+        mesh = weld_sector(faces, flats.ceiling, flats.floor, &arena);
+        if (options.mesh_batching == MeshBatching::Sector) {
+            merge_primitives_by_texture(mesh, &arena);
         }
-        map_sector.floor.texture_index = map.get_flat_index(sector.floor_texture, wad);
-
-        // Flatten the vertices arrays
-        auto vertices = std::vector<glm::vec2>{};
-        vertices.reserve(sector_vertex_count);
-        for (const auto& loop_vertices : sector_line_loops) {
-            for (const auto& vertex : loop_vertices) {
-                vertices.emplace_back(vertex[0], vertex[1]);
-            }
+        if (!is_batching_sectors && !options.skip_mesh_optimization) {
+            mesh_cache_stats[sector_index] = optimize_mesh(mesh, &arena);
         }
+    });
+
+    // Batches are made of whole sectors, so they're merged from the welded sectors and optimized once they're merged
+    auto batch_sectors = std::pmr::vector<std::pmr::vector<uint32_t>>{&arena};
+    auto batch_meshes = std::pmr::vector<SectorMesh>{&arena};
+    if (is_batching_sectors) {
+        batch_sectors = group_sectors_into_batches(sector_meshes, options.mesh_batching, &arena);
+        batch_meshes.reserve(batch_sectors.size());
+        for (auto i = 0u; i < batch_sectors.size(); i++) {
+            batch_meshes.emplace_back(&arena);
+        }
+        mesh_cache_stats.assign(batch_sectors.size(), VertexCacheStats{});
+        thread_pool.parallel_for(batch_sectors.size(), [&](const size_t batch_index) {
+            auto& mesh = batch_meshes[batch_index];
+            mesh = merge_sector_meshes(sector_meshes, batch_sectors[batch_index], &arena);
+            if (!options.skip_mesh_optimization) {
+                mesh_cache_stats[batch_index] = optimize_mesh(mesh, &arena);
+            }
+        });
+    }
 
-        map_sector.ceiling.vertices.reserve(vertices.size());
-        map_sector.floor.vertices.reserve(vertices.size());
-
-        for (const auto& vertex : vertices) {
-            map_sector.ceiling.vertices.emplace_back(vertex[0], vertex[1], sector.ceiling_height);
-            map_sector.floor.vertices.emplace_back(vertex[0], vertex[1], sector.floor_height);
+    if (!options.skip_mesh_optimization) {
+        auto cache_stats = VertexCacheStats{};
+        for (const auto& stats : mesh_cache_stats) {
+            cache_stats += stats;
         }
+        std::cout << std::format(
+            "Optimized map {} for the vertex cache: ACMR went from {:.3f} to {:.3f} over {} triangles\n",
+            map_data.name, cache_stats.get_acmr_before(), cache_stats.get_acmr_after(), cache_stats.num_triangles
+        );
+    }
 
-        if (is_sky_sector) {
-            map_sector.ceiling.indices.resize(sector_ceiling_indices.size());
+    // Lay the welded sectors or batches out one after another, the way they're exported. This is the only copy of the
+    // geometry that outlives the arena
+    const auto& final_meshes = is_batching_sectors ? batch_meshes : sector_meshes;
+    auto num_vertices = size_t{0};
+    auto num_index_bytes = size_t{0};
+    auto num_primitives = size_t{0};
+    for (const auto& mesh : final_meshes) {
+        num_vertices += mesh.positions.size();
+        num_index_bytes += MeshBuffers::get_index_bytes(mesh);
+        num_primitives += mesh.primitives.size();
+    }
+    map.geometry.reserve_more(num_vertices, num_index_bytes, num_primitives);
+    if (is_batching_sectors) {
+        map.sector_batches.reserve(batch_meshes.size());
+        for (const auto& mesh : batch_meshes) {
+            map.sector_batches.emplace_back(
+                SectorBatch{
+                    .mesh = map.geometry.append(mesh),
+                    .sector_ranges = {mesh.sector_ranges.begin(), mesh.sector_ranges.end()},
+                }
+            );
+        }
+    } else {
+        for (auto sector_index = 0u; sector_index < map.sectors.size(); sector_index++) {
+            map.sectors[sector_index].mesh = map.geometry.append(sector_meshes[sector_index]);
         }
-        map_sector.floor.indices.resize(sector_ceiling_indices.size());
+    }
 
-        for (auto triangle_index = 0u; triangle_index < sector_ceiling_indices.size(); triangle_index += 3) {
-            if (is_sky_sector) {
-                map_sector.ceiling.indices[triangle_index] = sector_ceiling_indices[triangle_index + 2];
-                map_sector.ceiling.indices[triangle_index + 1] = sector_ceiling_indices[triangle_index + 1];
-                map_sector.ceiling.indices[triangle_index + 2] = sector_ceiling_indices[triangle_index];
-            }
+    return map;
+}
 
-            map_sector.floor.indices[triangle_index] = sector_ceiling_indices[triangle_index];
-            map_sector.floor.indices[triangle_index + 1] = sector_ceiling_indices[triangle_index + 1];
-            map_sector.floor.indices[triangle_index + 2] = sector_ceiling_indices[triangle_index + 2];
+std::vector<std::string> find_map_names(const wad::ResourceSet& resources) {
+    auto map_names = std::vector<std::string>{};
+    auto seen_maps = std::unordered_set<wad::Name>{};
+
+    for (const auto& map : resources.map_index.get_maps()) {
+        if (seen_maps.emplace(map.name).second) {
+            map_names.emplace_back(map.name.to_string());
         }
     }
 
-    return map;
+    return map_names;
 }
@@ -1,8 +1,14 @@
 #pragma once
 
+#include <string>
+#include <vector>
+
 #include "extraction_options.hpp"
+#include "map_arena.hpp"
+#include "map_data.hpp"
 #include "mesh.hpp"
-#include "wad.hpp"
+#include "resource_set.hpp"
+#include "thread_pool.hpp"
 
 /**
  * \file map_reader.hpp
@@ -14,12 +20,27 @@
 /**
  * Creates a mesh from a map in the WAD data
  *
- * \param wad WAD data that contains the map
+ * \param resources WADs that contain the resources the map uses
+ * \param map_data The map's geometry, from either a binary or a UDMF map
  * \param options Options for what data to extract
+ * \param thread_pool Pool to build the walls and flats on. The output is the same no matter how many threads it has
+ * \param arena Arena for the data that's only needed while the map is built. Nothing in the returned map uses it, so
+ * it can be reset as soon as this returns
  * \return A mesh that contains the map
  *
+ * Walls that continue each other with the same texture are merged into one face, see merge_collinear_walls
+ *
  * \throws std::runtime_error if there's an error at runtime
+ */
+Map create_mesh_from_map(
+    const wad::ResourceSet& resources, const wad::MapData& map_data, const MapExtractionOptions& options,
+    ThreadPool& thread_pool, MapArena& arena
+);
+
+/**
+ * Finds the names of all the maps in the WADs
  *
- * TODO: More options, such as trying to combine faces that use the same texture
+ * This reads the map index that was built when the WADs were loaded, so it doesn't touch any lump data. If several
+ * WADs have a map with the same name, it's only listed once, in the position of its first appearance
  */
-Map create_mesh_from_map(const wad::WAD& wad, const MapExtractionOptions& options);
+std::vector<std::string> find_map_names(const wad::ResourceSet& resources);
@@ -0,0 +1,168 @@
+#include "map_topology.hpp"
+
+MapTopology MapTopology::build(const wad::MapData& map_data) {
+    auto topology = MapTopology{};
+    topology.vertexes = map_data.vertexes;
+
+    const auto& linedefs = map_data.linedefs;
+    const auto& sidedefs = map_data.sidedefs;
+
+    topology.half_edges.reserve(linedefs.size() * 2);
+    topology.linedef_half_edges.resize(linedefs.size(), {HalfEdge::None, HalfEdge::None});
+
+    for (auto i = 0u; i < linedefs.size(); i++) {
+        const auto& linedef = linedefs[i];
+
+        const auto front = static_cast<uint32_t>(topology.half_edges.size());
+        topology.half_edges.emplace_back(
+            HalfEdge{
+                .origin_vertex = linedef.start_vertex,
+                .target_vertex = linedef.end_vertex,
+                .linedef = i,
+                .sidedef = linedef.front_sidedef,
+                .sector = sidedefs[linedef.front_sidedef].sector_number,
+            }
+        );
+        topology.linedef_half_edges[i][0] = front;
+
+        if (linedef.flags & wad::LineDef::TwoSided && linedef.back_sidedef != wad::LineDef::NoSidedef) {
+            const auto back = static_cast<uint32_t>(topology.half_edges.size());
+            topology.half_edges.emplace_back(
+                HalfEdge{
+                    .origin_vertex = linedef.end_vertex,
+                    .target_vertex = linedef.start_vertex,
+                    .twin = front,
+                    .linedef = i,
+                    .sidedef = linedef.back_sidedef,
+                    .sector = sidedefs[linedef.back_sidedef].sector_number,
+                }
+            );
+            topology.half_edges[front].twin = back;
+            topology.linedef_half_edges[i][1] = back;
+        }
+    }
+
+    // Group the half-edges by sector with a counting sort, so each sector's half-edges stay in linedef order
+    const auto num_sectors = static_cast<uint32_t>(map_data.sectors.size());
+    auto sector_offsets = std::vector<uint32_t>(num_sectors + 1, 0);
+    for (const auto& half_edge : topology.half_edges) {
+        sector_offsets[half_edge.sector + 1]++;
+    }
+    for (auto i = 0u; i < num_sectors; i++) {
+        sector_offsets[i + 1] += sector_offsets[i];
+    }
+
+    auto half_edges_by_sector = std::vector<uint32_t>(topology.half_edges.size());
+    {
+        auto insert_positions = sector_offsets;
+        for (auto i = 0u; i < topology.half_edges.size(); i++) {
+            half_edges_by_sector[insert_positions[topology.half_edges[i].sector]++] = i;
+        }
+    }
+
+    // Trace the loops. Each vertex has a list of the unused half-edges that start at it, in index order. Tracing a loop
+    // takes the first unused half-edge from the list of the vertex where the loop currently ends
+    auto first_outgoing = std::vector<uint32_t>(map_data.vertexes.size(), HalfEdge::None);
+    auto next_outgoing = std::vector<uint32_t>(topology.half_edges.size(), HalfEdge::None);
+    auto is_used = std::vector<bool>(topology.half_edges.size(), false);
+
+    topology.loop_half_edges.reserve(topology.half_edges.size());
+    topology.sector_first_loops.reserve(num_sectors + 1);
+
+    for (auto sector = 0u; sector < num_sectors; sector++) {
+        topology.sector_first_loops.emplace_back(static_cast<uint32_t>(topology.loop_offsets.size()));
+
+        const auto sector_half_edges = std::span{half_edges_by_sector}.subspan(
+            sector_offsets[sector], sector_offsets[sector + 1] - sector_offsets[sector]
+        );
+
+        // Push in reverse so that each vertex's list ends up in index order
+        for (auto itr = sector_half_edges.rbegin(); itr != sector_half_edges.rend(); ++itr) {
+            const auto origin = topology.half_edges[*itr].origin_vertex;
+            next_outgoing[*itr] = first_outgoing[origin];
+            first_outgoing[origin] = *itr;
+        }
+
+        for (const auto start : sector_half_edges) {
+            if (is_used[start]) {
+                continue;
+            }
+
+            const auto loop_index = static_cast<uint32_t>(topology.loop_offsets.size()) -
+                                    topology.sector_first_loops.back();
+            const auto loop_start = static_cast<uint32_t>(topology.loop_half_edges.size());
+            topology.loop_offsets.emplace_back(loop_start);
+
+            auto current = start;
+            while (current != HalfEdge::None) {
+                is_used[current] = true;
+                topology.loop_half_edges.emplace_back(current);
+                topology.half_edges[current].loop = loop_index;
+
+                auto& candidate = first_outgoing[topology.half_edges[current].target_vertex];
+                while (candidate != HalfEdge::None && is_used[candidate]) {
+                    candidate = next_outgoing[candidate];
+                }
+
+                if (candidate != HalfEdge::None) {
+                    topology.half_edges[current].next = candidate;
+                }
+                current = candidate;
+            }
+
+            // Close the loop if it got back to where it started
+            auto& last = topology.half_edges[topology.loop_half_edges.back()];
+            if (last.target_vertex == topology.half_edges[start].origin_vertex) {
+                last.next = start;
+            }
+        }
+
+        for (const auto half_edge : sector_half_edges) {
+            first_outgoing[topology.half_edges[half_edge].origin_vertex] = HalfEdge::None;
+        }
+    }
+
+    topology.sector_first_loops.emplace_back(static_cast<uint32_t>(topology.loop_offsets.size()));
+    topology.loop_offsets.emplace_back(static_cast<uint32_t>(topology.loop_half_edges.size()));
+
+    return topology;
+}
+
+std::span<const HalfEdge> MapTopology::get_half_edges() const {
+    return half_edges;
+}
+
+const HalfEdge& MapTopology::get_half_edge(const uint32_t half_edge) const {
+    return half_edges[half_edge];
+}
+
+uint32_t MapTopology::get_front_half_edge(const uint32_t linedef) const {
+    return linedef_half_edges[linedef][0];
+}
+
+uint32_t MapTopology::get_back_half_edge(const uint32_t linedef) const {
+    return linedef_half_edges[linedef][1];
+}
+
+uint32_t MapTopology::get_num_loops(const uint32_t sector) const {
+    return sector_first_loops[sector + 1] - sector_first_loops[sector];
+}
+
+std::span<const uint32_t> MapTopology::get_loop(const uint32_t sector, const uint32_t loop) const {
+    const auto loop_index = sector_first_loops[sector] + loop;
+    const auto start = loop_offsets[loop_index];
+    return std::span{loop_half_edges}.subspan(start, loop_offsets[loop_index + 1] - start);
+}
+
+std::vector<SectorVertex> MapTopology::get_loop_vertices(const uint32_t sector, const uint32_t loop) const {
+    const auto loop_half_edge_indices = get_loop(sector, loop);
+
+    auto loop_vertices = std::vector<SectorVertex>{};
+    loop_vertices.reserve(loop_half_edge_indices.size());
+    for (const auto half_edge : loop_half_edge_indices) {
+        const auto& vertex = vertexes[half_edges[half_edge].origin_vertex];
+        loop_vertices.emplace_back(SectorVertex{vertex.x, vertex.y});
+    }
+
+    return loop_vertices;
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "map_data.hpp"
+#include "sector.hpp"
+
+/**
+ * \file map_topology.hpp
+ *
+ * Half-edge representation of a map's linedefs, built once per map
+ */
+
+/**
+ * One side of a linedef, directed so that its sector is on its right, like in DOOM
+ */
+struct HalfEdge {
+    constexpr static inline uint32_t None = UINT32_MAX;
+
+    uint32_t origin_vertex = 0;
+    uint32_t target_vertex = 0;
+
+    /**
+     * The other side of the same linedef, or None for one-sided linedefs
+     */
+    uint32_t twin = None;
+
+    /**
+     * The half-edge after this one in its sector's boundary loop, or None if the loop isn't closed
+     */
+    uint32_t next = None;
+
+    uint32_t linedef = 0;
+    uint32_t sidedef = 0;
+    uint32_t sector = 0;
+
+    /**
+     * Index of the loop that this half-edge is in, in its sector's loops
+     */
+    uint32_t loop = 0;
+};
+
+/**
+ * \brief Half-edge (DCEL) topology of a map
+ *
+ * Every front side is a half-edge, and so is the back side of every two-sided linedef. A one-sided linedef with a
+ * back sidedef is a mapping error that DOOM ignores, so its back side doesn't bound a sector and isn't a half-edge.
+ * Neither is a two-sided linedef without a back sidedef, which is treated as one-sided
+ *
+ * Half-edges are grouped by sector, and each sector's half-edges are split into boundary loops. Building the
+ * topology and every query on it are linear in the number of half-edges involved
+ */
+class MapTopology {
+public:
+    /**
+     * \brief Builds the topology of a map whose indices have already been validated
+     *
+     * Loops are traced the way DOOM editors expect: start at the first unused half-edge of a sector, and keep taking
+     * the first unused half-edge that starts where the previous one ended. A loop ends when there's no such half-edge,
+     * which is usually when it gets back to its start
+     */
+    static MapTopology build(const wad::MapData& map_data);
+
+    std::span<const HalfEdge> get_half_edges() const;
+
+    const HalfEdge& get_half_edge(uint32_t half_edge) const;
+
+    /**
+     * The front half-edge of a linedef
+     */
+    uint32_t get_front_half_edge(uint32_t linedef) const;
+
+    /**
+     * The back half-edge of a linedef, or HalfEdge::None for one-sided linedefs
+     */
+    uint32_t get_back_half_edge(uint32_t linedef) const;
+
+    uint32_t get_num_loops(uint32_t sector) const;
+
+    /**
+     * The half-edges in one of a sector's boundary loops, in order
+     */
+    std::span<const uint32_t> get_loop(uint32_t sector, uint32_t loop) const;
+
+    /**
+     * Gets the vertex positions of one of a sector's loops, in order
+     */
+    std::vector<SectorVertex> get_loop_vertices(uint32_t sector, uint32_t loop) const;
+
+private:
+    std::span<const wad::Vertex> vertexes;
+
+    std::vector<HalfEdge> half_edges;
+
+    /**
+     * Front and back half-edge of each linedef
+     */
+    std::vector<std::array<uint32_t, 2>> linedef_half_edges;
+
+    /**
+     * Half-edge indices of all the loops, sector by sector and loop by loop
+     */
+    std::vector<uint32_t> loop_half_edges;
+
+    /**
+     * Where each loop starts in loop_half_edges. Has one more element than there are loops
+     */
+    std::vector<uint32_t> loop_offsets;
+
+    /**
+     * Index of each sector's first loop in loop_offsets. Has one more element than there are sectors
+     */
+    std::vector<uint32_t> sector_first_loops;
+};
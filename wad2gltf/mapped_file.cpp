@@ -0,0 +1,109 @@
+#include "mapped_file.hpp"
+
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+std::optional<MappedFile> MappedFile::map(const std::filesystem::path& filename) {
+    auto mapped_file = MappedFile{};
+
+#ifdef _WIN32
+    auto* file = CreateFileW(
+        filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr
+    );
+    if (file == INVALID_HANDLE_VALUE) {
+        return std::nullopt;
+    }
+
+    auto file_size = LARGE_INTEGER{};
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+        CloseHandle(file);
+        return std::nullopt;
+    }
+
+    auto* mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (mapping == nullptr) {
+        return std::nullopt;
+    }
+
+    // The view keeps the mapping object alive, so we can close our handle to it right away
+    auto* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (view == nullptr) {
+        return std::nullopt;
+    }
+
+    mapped_file.address = static_cast<const uint8_t*>(view);
+    mapped_file.size = static_cast<size_t>(file_size.QuadPart);
+#else
+    const auto filename_string = filename.string();
+    const auto file = open(filename_string.c_str(), O_RDONLY);
+    if (file == -1) {
+        return std::nullopt;
+    }
+
+    struct stat file_stat = {};
+    if (fstat(file, &file_stat) != 0 || !S_ISREG(file_stat.st_mode) || file_stat.st_size == 0) {
+        close(file);
+        return std::nullopt;
+    }
+
+    auto* view = mmap(nullptr, static_cast<size_t>(file_stat.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+    // The mapping holds its own reference to the file
+    close(file);
+    if (view == MAP_FAILED) {
+        return std::nullopt;
+    }
+
+    mapped_file.address = static_cast<const uint8_t*>(view);
+    mapped_file.size = static_cast<size_t>(file_stat.st_size);
+#endif
+
+    return mapped_file;
+}
+
+MappedFile::MappedFile(MappedFile&& old) noexcept :
+    address{std::exchange(old.address, nullptr)}, size{std::exchange(old.size, 0)} {}
+
+MappedFile& MappedFile::operator=(MappedFile&& old) noexcept {
+    if (this != &old) {
+        unmap();
+        address = std::exchange(old.address, nullptr);
+        size = std::exchange(old.size, 0);
+    }
+
+    return *this;
+}
+
+MappedFile::~MappedFile() {
+    unmap();
+}
+
+std::span<const uint8_t> MappedFile::data() const {
+    return std::span{address, size};
+}
+
+void MappedFile::unmap() {
+    if (address == nullptr) {
+        return;
+    }
+
+#ifdef _WIN32
+    UnmapViewOfFile(address);
+#else
+    munmap(const_cast<uint8_t*>(address), size);
+#endif
+
+    address = nullptr;
+    size = 0;
+}
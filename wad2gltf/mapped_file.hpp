@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+
+/**
+ * \brief Read-only memory mapping of a whole file
+ *
+ * Pages are faulted in by the OS as they're touched, so mapping a 300 MB megawad only costs us the lumps we actually
+ * read. The mapping is released when this object is destroyed. Moving the object keeps the mapped address stable, so
+ * spans into the data remain valid across moves
+ */
+class MappedFile {
+public:
+    /**
+     * \brief Maps the requested file into memory
+     *
+     * \param filename File to map
+     * \return The mapped file, or nullopt if the file could not be opened or mapped
+     */
+    static std::optional<MappedFile> map(const std::filesystem::path& filename);
+
+    MappedFile() = default;
+
+    MappedFile(const MappedFile& other) = delete;
+    MappedFile& operator=(const MappedFile& other) = delete;
+
+    MappedFile(MappedFile&& old) noexcept;
+    MappedFile& operator=(MappedFile&& old) noexcept;
+
+    ~MappedFile();
+
+    std::span<const uint8_t> data() const;
+
+private:
+    const uint8_t* address = nullptr;
+
+    size_t size = 0;
+
+    void unmap();
+};
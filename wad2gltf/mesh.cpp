@@ -0,0 +1,140 @@
+#include "mesh.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <span>
+
+/**
+ * Appends indices to a byte array as IndexType, padded so that they're aligned to their size
+ *
+ * \return Offset of the first index, in bytes
+ */
+template <typename IndexType>
+uint32_t append_indices(std::vector<uint8_t>& index_bytes, const std::span<const uint32_t> indices) {
+    // Accessor offsets must be a multiple of the component size
+    const auto offset = (index_bytes.size() + sizeof(IndexType) - 1) & ~(sizeof(IndexType) - 1);
+    index_bytes.resize(offset + indices.size() * sizeof(IndexType));
+
+    auto* dest = index_bytes.data() + offset;
+    for (const auto index : indices) {
+        const auto narrow_index = static_cast<IndexType>(index);
+        std::memcpy(dest, &narrow_index, sizeof(IndexType));
+        dest += sizeof(IndexType);
+    }
+
+    return static_cast<uint32_t>(offset);
+}
+
+/**
+ * \brief Size of the smallest index type that holds all of a primitive's indices
+ *
+ * glTF doesn't allow an index with the largest value of its component type, since some APIs use that value to restart
+ * strips. So 8-bit indices can address 255 vertices, and 16-bit indices 65535
+ */
+uint32_t get_index_size(const std::span<const uint32_t> indices) {
+    const auto max_index = indices.empty() ? 0u : *std::max_element(indices.begin(), indices.end());
+    if (max_index < std::numeric_limits<uint8_t>::max()) {
+        return sizeof(uint8_t);
+    } else if (max_index < std::numeric_limits<uint16_t>::max()) {
+        return sizeof(uint16_t);
+    } else {
+        return sizeof(uint32_t);
+    }
+}
+
+/**
+ * Appends a primitive's indices in the smallest type that holds them all
+ */
+PrimitiveRange append_primitive(
+    std::vector<uint8_t>& index_bytes, const uint32_t texture_index, const std::span<const uint32_t> indices
+) {
+    auto range = PrimitiveRange{
+        .texture_index = texture_index,
+        .index_count = static_cast<uint32_t>(indices.size()),
+        .index_size = get_index_size(indices),
+    };
+    switch (range.index_size) {
+    case sizeof(uint8_t):
+        range.index_offset = append_indices<uint8_t>(index_bytes, indices);
+        break;
+    case sizeof(uint16_t):
+        range.index_offset = append_indices<uint16_t>(index_bytes, indices);
+        break;
+    default:
+        range.index_offset = append_indices<uint32_t>(index_bytes, indices);
+        break;
+    }
+
+    return range;
+}
+
+MeshRange get_range(const MeshBuffers& buffers, const size_t first_vertex, const size_t first_primitive) {
+    auto range = MeshRange{
+        .first_vertex = static_cast<uint32_t>(first_vertex),
+        .vertex_count = static_cast<uint32_t>(buffers.positions.size() - first_vertex),
+        .first_primitive = static_cast<uint32_t>(first_primitive),
+        .primitive_count = static_cast<uint32_t>(buffers.primitives.size() - first_primitive),
+        .min = glm::vec3{std::numeric_limits<float>::max()},
+        .max = glm::vec3{std::numeric_limits<float>::lowest()},
+    };
+    for (auto i = first_vertex; i < buffers.positions.size(); i++) {
+        const auto& position = buffers.positions[i];
+        range.min = glm::min(range.min, position);
+        range.max = glm::max(range.max, position);
+    }
+
+    return range;
+}
+
+MeshRange MeshBuffers::append(const SectorMesh& mesh) {
+    const auto first_vertex = positions.size();
+    const auto first_primitive = primitives.size();
+
+    positions.insert(positions.end(), mesh.positions.begin(), mesh.positions.end());
+    normals.insert(normals.end(), mesh.normals.begin(), mesh.normals.end());
+    texcoords.insert(texcoords.end(), mesh.texcoords.begin(), mesh.texcoords.end());
+
+    // Each primitive picks its own index size, so a small primitive in a big sector still gets small indices
+    for (const auto& primitive : mesh.primitives) {
+        primitives.emplace_back(append_primitive(indices, primitive.texture_index, primitive.indices));
+    }
+
+    return get_range(*this, first_vertex, first_primitive);
+}
+
+MeshRange MeshBuffers::append(const Face& face) {
+    const auto first_vertex = positions.size();
+    const auto first_primitive = primitives.size();
+
+    for (const auto& vertex : face.vertices) {
+        positions.emplace_back(vertex.position);
+        normals.emplace_back(face.normal);
+        texcoords.emplace_back(vertex.texcoord);
+    }
+
+    // 0 1 2 3 2 1, counter-clockwise
+    constexpr auto face_indices = std::array<uint32_t, 6>{0, 1, 2, 3, 2, 1};
+    primitives.emplace_back(append_primitive(indices, face.texture_index, face_indices));
+
+    return get_range(*this, first_vertex, first_primitive);
+}
+
+size_t MeshBuffers::get_index_bytes(const SectorMesh& mesh) {
+    auto num_bytes = size_t{0};
+    for (const auto& primitive : mesh.primitives) {
+        // Aligning a primitive's indices to their size pads them by at most one byte less than an index
+        const auto index_size = get_index_size(primitive.indices);
+        num_bytes += primitive.indices.size() * index_size + index_size - 1;
+    }
+
+    return num_bytes;
+}
+
+void MeshBuffers::reserve_more(const size_t num_vertices, const size_t num_index_bytes, const size_t num_primitives) {
+    positions.reserve(positions.size() + num_vertices);
+    normals.reserve(normals.size() + num_vertices);
+    texcoords.reserve(texcoords.size() + num_vertices);
+    indices.reserve(indices.size() + num_index_bytes);
+    primitives.reserve(primitives.size() + num_primitives);
+}
@@ -2,10 +2,13 @@
 
 #include <cstdint>
 #include <array>
+#include <memory_resource>
 #include <optional>
+#include <vector>
 
 #include <glm/glm.hpp>
 
+#include "collision_bvh.hpp"
 #include "sector.hpp"
 #include "texture_reader.hpp"
 
@@ -29,23 +32,167 @@ struct Face {
     // Counter-clockwise winding order
 };
 
+/**
+ * A sector's floor or ceiling, while the map is being built
+ */
 struct Flat {
-    std::vector<glm::vec3> vertices;
-    std::vector<uint16_t> indices;
-    uint32_t texture_index;    
+    explicit Flat(std::pmr::memory_resource* memory = std::pmr::get_default_resource())
+        : vertices{memory}, indices{memory} {}
+
+    std::pmr::vector<glm::vec3> vertices;
+    /**
+     * Large sectors in limit-removing maps can have more than 65535 vertices, so we use 32-bit indices here. Each
+     * primitive is exported with the smallest indices that hold it
+     */
+    std::pmr::vector<uint32_t> indices;
+    uint32_t texture_index = 0;
+};
+
+/**
+ * Triangles in a sector's mesh that all use the same texture
+ */
+struct MeshPrimitive {
+    uint32_t texture_index;
+
+    /**
+     * Triangle list into the mesh's vertex arrays, with counter-clockwise winding
+     */
+    std::pmr::vector<uint32_t> indices;
+};
+
+/**
+ * Where one sector's vertices are in a mesh that holds several sectors. Every triangle of the mesh uses the vertices of
+ * a single sector
+ */
+struct SectorVertexRange {
+    uint32_t sector;
+    uint32_t first_vertex;
+    uint32_t vertex_count;
+};
+
+/**
+ * \brief A sector's faces, ceiling, and floor as one indexed mesh, while it's being built
+ *
+ * There's one array per vertex attribute, and each vertex (a unique combination of position, normal, and texcoord) is
+ * only in them once. Primitives are in the same order as the faces they came from, then the ceiling, then the floor.
+ * Once it's done, it's appended to the map's MeshBuffers
+ */
+struct SectorMesh {
+    explicit SectorMesh(std::pmr::memory_resource* memory = std::pmr::get_default_resource())
+        : positions{memory}, normals{memory}, texcoords{memory}, primitives{memory}, sector_ranges{memory} {}
+
+    std::pmr::vector<glm::vec3> positions;
+    std::pmr::vector<glm::vec3> normals;
+    std::pmr::vector<glm::vec2> texcoords;
+
+    std::pmr::vector<MeshPrimitive> primitives;
+
+    /**
+     * Each sector's vertices, if the mesh is a batch of several sectors. Empty if it's a single sector
+     */
+    std::pmr::vector<SectorVertexRange> sector_ranges;
+};
+
+/**
+ * Triangles in a MeshBuffers that all use the same texture
+ */
+struct PrimitiveRange {
+    uint32_t texture_index = 0;
+
+    /**
+     * Offset of the first index in MeshBuffers::indices, in bytes
+     */
+    uint32_t index_offset = 0;
+
+    uint32_t index_count = 0;
+
+    /**
+     * Size of each index in bytes: 1, 2, or 4, whichever is the smallest that holds the primitive's largest index
+     */
+    uint32_t index_size = 0;
 };
 
+/**
+ * \brief One mesh in a MeshBuffers
+ *
+ * The indices of the mesh's primitives count from first_vertex, so each mesh's vertices can be exported as their own
+ * accessors that all point into the same buffers
+ */
+struct MeshRange {
+    uint32_t first_vertex = 0;
+    uint32_t vertex_count = 0;
+
+    uint32_t first_primitive = 0;
+    uint32_t primitive_count = 0;
+
+    /**
+     * Bounds of the mesh's positions
+     */
+    glm::vec3 min = {};
+    glm::vec3 max = {};
+};
+
+/**
+ * \brief All of a map's geometry, laid out the way the glTF exporter writes it
+ *
+ * Each vertex attribute and the indices are in one contiguous array for the whole map, so each one becomes a glTF
+ * buffer with a single copy. Indices are already in the size that their accessor will use, which each primitive picks
+ * for itself
+ */
+struct MeshBuffers {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec2> texcoords;
+
+    std::vector<uint8_t> indices;
+
+    std::vector<PrimitiveRange> primitives;
+
+    /**
+     * Appends a mesh's vertices and primitives
+     *
+     * \return Where the mesh ended up
+     */
+    MeshRange append(const SectorMesh& mesh);
+
+    /**
+     * Appends a single face, as four vertices and two triangles
+     *
+     * \return Where the face ended up
+     */
+    MeshRange append(const Face& face);
+
+    /**
+     * How many bytes of indices appending a mesh can add at most, counting the padding that aligns each primitive's
+     * indices
+     */
+    static size_t get_index_bytes(const SectorMesh& mesh);
+
+    /**
+     * Makes room for some more vertices, indices, and primitives, so appending them doesn't need to reallocate
+     */
+    void reserve_more(size_t num_vertices, size_t num_index_bytes, size_t num_primitives);
+};
+
+/**
+ * \brief A sector of the map
+ *
+ * The sector's walls and flats are only built while the map is, and go straight into the map's MeshBuffers once
+ * they're welded. The sector just keeps where they ended up
+ */
 struct Sector {
-    std::vector<Face> faces;
+    /**
+     * The faces and flats welded into one mesh, in the map's MeshBuffers. This is what gets exported. Empty if the
+     * sector is part of one of the map's SectorBatches instead
+     */
+    MeshRange mesh;
 
-    Flat ceiling;
-    Flat floor;
+    int16_t floor_height;
+    int16_t ceiling_height;
 
     int16_t light_level;
     int16_t special_type;
     int16_t tag_number;
-
-    std::vector<std::vector<SectorVertex>> exterior_loops;
 };
 
 struct Thing {
@@ -56,62 +203,47 @@ struct Thing {
      */
     float angle;
 
-    Face sprite;
+    /**
+     * The sprite's quad, in the map's MeshBuffers. Things with the same sprite share it
+     */
+    MeshRange sprite;
 
     int16_t type;
     uint16_t flags;
 };
 
+/**
+ * \brief Several sectors' geometry in one mesh, with one primitive per texture. See MeshBatching
+ */
+struct SectorBatch {
+    MeshRange mesh;
+
+    /**
+     * Which of the mesh's vertices belong to which sector, counting from the mesh's first vertex
+     */
+    std::vector<SectorVertexRange> sector_ranges;
+};
+
 struct Map {
     std::vector<Sector> sectors;
 
+    /**
+     * The batches that hold the sectors' geometry, if MapExtractionOptions::mesh_batching merges sectors together.
+     * Sectors' own meshes are empty then
+     */
+    std::vector<SectorBatch> sector_batches;
+
     std::vector<DecodedTexture> textures;
 
     std::vector<Thing> things;
 
     /**
-     * \brief Finds the index of the requested texture in the textures array, or loads it if is doesn't exist
-     * \param texture_name Name of the texture to find
-     * \return Index of the texture
+     * Geometry for all the sectors and things
      */
-    uint32_t get_texture_index(const wad::Name& texture_name, const wad::WAD& wad);
+    MeshBuffers geometry;
 
-    uint32_t get_flat_index(const wad::Name& flat_name, const wad::WAD& wad);
+    /**
+     * BVH over the walls and flats, if MapExtractionOptions::export_bvh is set
+     */
+    CollisionBvh collision_bvh;
 };
-
-inline uint32_t Map::get_texture_index(const wad::Name& texture_name, const wad::WAD& wad) {
-    if(!texture_name.is_valid()) {
-        throw std::runtime_error{ "Texture name is not valid" };
-    }
-
-    for (auto i = 0u; i < textures.size(); i++) {
-        const auto& texture = textures[i];
-        if (texture.name == texture_name) {
-            return i;
-        }
-    }
-
-    auto index = textures.size();
-    textures.emplace_back(load_texture_from_wad(texture_name, wad));
-    return static_cast<uint32_t>(index);
-}
-
-inline uint32_t Map::get_flat_index(const wad::Name& flat_name, const wad::WAD& wad) {
-    if (!flat_name.is_valid()) {
-        throw std::runtime_error{ "Texture name is not valid" };
-    }
-    if (flat_name.is_none()) {
-        throw std::runtime_error{ "Sector floor/ceiling name cannot be '-'." };
-    }
-
-    for (auto i = 0u; i < textures.size(); i++) {
-        const auto& texture = textures[i];
-        if (texture.name == flat_name) {
-            return i;
-        }
-    }
-
-    auto index = textures.size();
-    textures.emplace_back(load_flat_from_wad(flat_name, wad));
-    return static_cast<uint32_t>(index);
-}
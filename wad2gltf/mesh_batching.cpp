@@ -0,0 +1,160 @@
+#include "mesh_batching.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <tuple>
+
+constexpr auto NoPrimitive = UINT32_MAX;
+
+/**
+ * Finds the primitive for a texture, adding it if the texture doesn't have one yet
+ *
+ * \param texture_primitives The primitive for each texture index, or NoPrimitive
+ */
+MeshPrimitive& get_texture_primitive(
+    std::pmr::vector<MeshPrimitive>& primitives, std::pmr::vector<uint32_t>& texture_primitives,
+    const uint32_t texture_index, std::pmr::memory_resource* memory
+) {
+    if (texture_index >= texture_primitives.size()) {
+        texture_primitives.resize(texture_index + 1, NoPrimitive);
+    }
+
+    auto& primitive_index = texture_primitives[texture_index];
+    if (primitive_index == NoPrimitive) {
+        primitive_index = static_cast<uint32_t>(primitives.size());
+        primitives.emplace_back(
+            MeshPrimitive{.texture_index = texture_index, .indices = std::pmr::vector<uint32_t>{memory}}
+        );
+    }
+
+    return primitives[primitive_index];
+}
+
+void merge_primitives_by_texture(SectorMesh& mesh, std::pmr::memory_resource* memory) {
+    auto primitives = std::pmr::vector<MeshPrimitive>{memory};
+    auto texture_primitives = std::pmr::vector<uint32_t>{memory};
+    for (const auto& primitive : mesh.primitives) {
+        auto& merged_primitive = get_texture_primitive(
+            primitives, texture_primitives, primitive.texture_index, memory
+        );
+        auto& indices = merged_primitive.indices;
+        indices.insert(indices.end(), primitive.indices.begin(), primitive.indices.end());
+    }
+
+    mesh.primitives = std::move(primitives);
+}
+
+std::pmr::vector<std::pmr::vector<uint32_t>> group_sectors_into_batches(
+    const std::span<const SectorMesh> sector_meshes, const MeshBatching batching, std::pmr::memory_resource* memory
+) {
+    auto batches = std::pmr::vector<std::pmr::vector<uint32_t>>{memory};
+
+    const auto has_triangles = [](const SectorMesh& mesh) {
+        return std::any_of(mesh.primitives.begin(), mesh.primitives.end(), [](const MeshPrimitive& primitive) {
+            return !primitive.indices.empty();
+        });
+    };
+
+    if (batching == MeshBatching::Map) {
+        auto& batch = batches.emplace_back();
+        for (auto sector = 0u; sector < sector_meshes.size(); sector++) {
+            if (has_triangles(sector_meshes[sector])) {
+                batch.emplace_back(sector);
+            }
+        }
+        if (batch.empty()) {
+            batches.clear();
+        }
+        return batches;
+    }
+
+    struct ChunkSector {
+        int32_t row;
+        int32_t column;
+        uint32_t sector;
+    };
+
+    auto chunk_sectors = std::pmr::vector<ChunkSector>{memory};
+    chunk_sectors.reserve(sector_meshes.size());
+    for (auto sector = 0u; sector < sector_meshes.size(); sector++) {
+        const auto& mesh = sector_meshes[sector];
+        if (!has_triangles(mesh)) {
+            continue;
+        }
+
+        auto min = glm::vec3{std::numeric_limits<float>::max()};
+        auto max = glm::vec3{std::numeric_limits<float>::lowest()};
+        for (const auto& position : mesh.positions) {
+            min = glm::min(min, position);
+            max = glm::max(max, position);
+        }
+
+        const auto center = (min + max) * 0.5f;
+        chunk_sectors.emplace_back(
+            ChunkSector{
+                .row = static_cast<int32_t>(std::floor(center.y / BatchChunkSize)),
+                .column = static_cast<int32_t>(std::floor(center.x / BatchChunkSize)),
+                .sector = sector,
+            }
+        );
+    }
+
+    std::sort(chunk_sectors.begin(), chunk_sectors.end(), [](const ChunkSector& a, const ChunkSector& b) {
+        return std::tie(a.row, a.column, a.sector) < std::tie(b.row, b.column, b.sector);
+    });
+
+    for (auto i = 0u; i < chunk_sectors.size(); i++) {
+        const auto& chunk_sector = chunk_sectors[i];
+        if (i == 0 || chunk_sector.row != chunk_sectors[i - 1].row ||
+            chunk_sector.column != chunk_sectors[i - 1].column) {
+            batches.emplace_back();
+        }
+        batches.back().emplace_back(chunk_sector.sector);
+    }
+
+    return batches;
+}
+
+SectorMesh merge_sector_meshes(
+    const std::span<const SectorMesh> sector_meshes, const std::span<const uint32_t> sectors,
+    std::pmr::memory_resource* memory
+) {
+    auto mesh = SectorMesh{memory};
+
+    auto num_vertices = size_t{0};
+    for (const auto sector : sectors) {
+        num_vertices += sector_meshes[sector].positions.size();
+    }
+    mesh.positions.reserve(num_vertices);
+    mesh.normals.reserve(num_vertices);
+    mesh.texcoords.reserve(num_vertices);
+    mesh.sector_ranges.reserve(sectors.size());
+
+    auto texture_primitives = std::pmr::vector<uint32_t>{memory};
+    for (const auto sector : sectors) {
+        const auto& sector_mesh = sector_meshes[sector];
+        const auto first_vertex = static_cast<uint32_t>(mesh.positions.size());
+        mesh.positions.insert(mesh.positions.end(), sector_mesh.positions.begin(), sector_mesh.positions.end());
+        mesh.normals.insert(mesh.normals.end(), sector_mesh.normals.begin(), sector_mesh.normals.end());
+        mesh.texcoords.insert(mesh.texcoords.end(), sector_mesh.texcoords.begin(), sector_mesh.texcoords.end());
+        mesh.sector_ranges.emplace_back(
+            SectorVertexRange{
+                .sector = sector,
+                .first_vertex = first_vertex,
+                .vertex_count = static_cast<uint32_t>(sector_mesh.positions.size()),
+            }
+        );
+
+        for (const auto& primitive : sector_mesh.primitives) {
+            auto& merged_primitive = get_texture_primitive(
+                mesh.primitives, texture_primitives, primitive.texture_index, memory
+            );
+            for (const auto index : primitive.indices) {
+                merged_primitive.indices.emplace_back(first_vertex + index);
+            }
+        }
+    }
+
+    return mesh;
+}
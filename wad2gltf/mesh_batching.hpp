@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <memory_resource>
+#include <span>
+
+#include "extraction_options.hpp"
+#include "mesh.hpp"
+
+/**
+ * \file mesh_batching.hpp
+ *
+ * Merges sectors' primitives into one primitive per texture, see MeshBatching
+ */
+
+/**
+ * Size of the chunks that MeshBatching::Chunk groups sectors by, in map units. Eight blockmap blocks
+ */
+constexpr auto BatchChunkSize = 1024;
+
+/**
+ * \brief Merges the primitives of a mesh that use the same texture into one
+ *
+ * The merged primitives are in the order that the mesh first uses their textures, and each one keeps its triangles in
+ * the order they were in
+ */
+void merge_primitives_by_texture(
+    SectorMesh& mesh, std::pmr::memory_resource* memory = std::pmr::get_default_resource()
+);
+
+/**
+ * \brief Groups sectors into the batches that MeshBatching::Chunk or MeshBatching::Map make
+ *
+ * A sector is in the chunk that the center of its bounds is in. Chunks are in row order, from -Y to +Y and from -X to
+ * +X, and each chunk's sectors are in sector order. Sectors without any triangles aren't in any batch
+ *
+ * \param sector_meshes Each sector's welded mesh
+ * \param batching Either MeshBatching::Chunk or MeshBatching::Map
+ * \param memory Where the batches go
+ * \return The sectors in each batch
+ */
+std::pmr::vector<std::pmr::vector<uint32_t>> group_sectors_into_batches(
+    std::span<const SectorMesh> sector_meshes, MeshBatching batching,
+    std::pmr::memory_resource* memory = std::pmr::get_default_resource()
+);
+
+/**
+ * \brief Merges some sectors' meshes into one, with one primitive per texture
+ *
+ * Each sector's vertices stay together, in the order of the sectors, and the mesh's sector_ranges say where they are
+ *
+ * \param sector_meshes Each sector's welded mesh
+ * \param sectors The sectors to merge
+ * \param memory Where the merged mesh goes
+ */
+SectorMesh merge_sector_meshes(
+    std::span<const SectorMesh> sector_meshes, std::span<const uint32_t> sectors,
+    std::pmr::memory_resource* memory = std::pmr::get_default_resource()
+);
@@ -0,0 +1,456 @@
+#include "mesh_optimization.hpp"
+
+#include <algorithm>
+#include <span>
+
+constexpr auto NoVertex = UINT32_MAX;
+
+/**
+ * A run of triangles that's drawn as a unit when we reorder for overdraw
+ */
+struct TriangleCluster {
+    /**
+     * Sum of the triangles' centroids, weighted by area
+     */
+    glm::vec3 centroid = glm::vec3{0};
+
+    /**
+     * Sum of the triangles' unnormalized normals
+     */
+    glm::vec3 normal = glm::vec3{0};
+
+    float area = 0;
+
+    /**
+     * How far the cluster faces away from the primitive's center. Clusters with larger keys are drawn first
+     */
+    float key = 0;
+};
+
+/**
+ * Scratch data for optimizing one primitive. It's reused for each primitive of a mesh, so the arena only has to hold
+ * one copy of it
+ */
+struct PrimitiveScratch {
+    // is_triangle_emitted takes its resource in parentheses, since braces would pick vector<bool>'s initializer_list
+    // constructor
+    explicit PrimitiveScratch(std::pmr::memory_resource* memory) :
+        local_indices{memory}, local_vertices{memory}, adjacency_offsets{memory}, adjacency{memory},
+        live_triangles{memory}, cache_times{memory}, is_triangle_emitted(memory), dead_ends{memory},
+        candidates{memory}, triangle_order{memory}, cluster_starts{memory}, clusters{memory},
+        cluster_order{memory} {}
+
+    /**
+     * The primitive's triangles, with its vertices numbered from 0 in the order it first uses them
+     */
+    std::pmr::vector<uint32_t> local_indices;
+
+    /**
+     * The mesh vertex for each local vertex
+     */
+    std::pmr::vector<uint32_t> local_vertices;
+
+    /**
+     * The triangles that use each local vertex, as offsets into adjacency
+     */
+    std::pmr::vector<uint32_t> adjacency_offsets;
+    std::pmr::vector<uint32_t> adjacency;
+
+    std::pmr::vector<uint32_t> live_triangles;
+    std::pmr::vector<uint32_t> cache_times;
+    std::pmr::vector<bool> is_triangle_emitted;
+    std::pmr::vector<uint32_t> dead_ends;
+    std::pmr::vector<uint32_t> candidates;
+
+    std::pmr::vector<uint32_t> triangle_order;
+
+    std::pmr::vector<uint32_t> cluster_starts;
+    std::pmr::vector<TriangleCluster> clusters;
+    std::pmr::vector<uint32_t> cluster_order;
+};
+
+double VertexCacheStats::get_acmr_before() const {
+    return num_triangles == 0 ? 0.0 : static_cast<double>(num_transformed_before) / static_cast<double>(num_triangles);
+}
+
+double VertexCacheStats::get_acmr_after() const {
+    return num_triangles == 0 ? 0.0 : static_cast<double>(num_transformed_after) / static_cast<double>(num_triangles);
+}
+
+VertexCacheStats& VertexCacheStats::operator+=(const VertexCacheStats& other) {
+    num_triangles += other.num_triangles;
+    num_transformed_before += other.num_transformed_before;
+    num_transformed_after += other.num_transformed_after;
+    return *this;
+}
+
+/**
+ * Counts the vertices that a FIFO cache of VertexCacheSize entries transforms to draw some local triangles, in the
+ * given order. A vertex is in the cache if fewer than VertexCacheSize vertices have been transformed since it was
+ */
+uint64_t count_transformed_vertices(
+    const std::span<const uint32_t> local_indices, const std::span<const uint32_t> triangle_order,
+    std::pmr::vector<uint32_t>& cache_times
+) {
+    // Times start after VertexCacheSize, so that time 0 means a vertex was never transformed
+    std::fill(cache_times.begin(), cache_times.end(), 0);
+    auto time = VertexCacheSize + 1;
+    for (const auto triangle : triangle_order) {
+        for (auto corner = 0u; corner < 3; corner++) {
+            const auto vertex = local_indices[triangle * 3 + corner];
+            if (time - cache_times[vertex] > VertexCacheSize) {
+                cache_times[vertex] = time++;
+            }
+        }
+    }
+
+    return time - (VertexCacheSize + 1);
+}
+
+/**
+ * \brief Picks the next vertex to fan around, as in Tipsify's GetNextVertex and SkipDeadEnd
+ *
+ * The best candidate is the one that's been in the cache the longest, as long as all of its remaining triangles can
+ * be drawn before it leaves the cache. Otherwise, we go back to a vertex we've used recently, then to any vertex with
+ * triangles left
+ */
+uint32_t get_next_fan_vertex(PrimitiveScratch& scratch, const uint32_t time, uint32_t& cursor) {
+    auto best_vertex = NoVertex;
+    auto best_priority = -1;
+    for (const auto vertex : scratch.candidates) {
+        const auto live_triangles = scratch.live_triangles[vertex];
+        if (live_triangles == 0) {
+            continue;
+        }
+
+        auto priority = 0;
+        if (time - scratch.cache_times[vertex] + 2 * live_triangles <= VertexCacheSize) {
+            priority = static_cast<int>(time - scratch.cache_times[vertex]);
+        }
+        if (priority > best_priority) {
+            best_priority = priority;
+            best_vertex = vertex;
+        }
+    }
+    if (best_vertex != NoVertex) {
+        return best_vertex;
+    }
+
+    while (!scratch.dead_ends.empty()) {
+        const auto vertex = scratch.dead_ends.back();
+        scratch.dead_ends.pop_back();
+        if (scratch.live_triangles[vertex] > 0) {
+            return vertex;
+        }
+    }
+
+    for (; cursor < scratch.live_triangles.size(); cursor++) {
+        if (scratch.live_triangles[cursor] > 0) {
+            return cursor;
+        }
+    }
+
+    return NoVertex;
+}
+
+/**
+ * Orders the local triangles with Tipsify, leaving the order in scratch.triangle_order
+ */
+void order_triangles_for_vertex_cache(PrimitiveScratch& scratch) {
+    const auto num_vertices = static_cast<uint32_t>(scratch.local_vertices.size());
+    const auto num_triangles = static_cast<uint32_t>(scratch.local_indices.size() / 3);
+
+    scratch.adjacency_offsets.assign(num_vertices + 1, 0);
+    for (const auto vertex : scratch.local_indices) {
+        scratch.adjacency_offsets[vertex + 1]++;
+    }
+    for (auto vertex = 0u; vertex < num_vertices; vertex++) {
+        scratch.adjacency_offsets[vertex + 1] += scratch.adjacency_offsets[vertex];
+    }
+
+    scratch.live_triangles.assign(num_vertices, 0);
+    scratch.adjacency.resize(scratch.local_indices.size());
+    for (auto triangle = 0u; triangle < num_triangles; triangle++) {
+        for (auto corner = 0u; corner < 3; corner++) {
+            const auto vertex = scratch.local_indices[triangle * 3 + corner];
+            scratch.adjacency[scratch.adjacency_offsets[vertex] + scratch.live_triangles[vertex]] = triangle;
+            scratch.live_triangles[vertex]++;
+        }
+    }
+
+    scratch.cache_times.assign(num_vertices, 0);
+    scratch.is_triangle_emitted.assign(num_triangles, false);
+    scratch.dead_ends.clear();
+    scratch.triangle_order.clear();
+
+    auto time = VertexCacheSize + 1;
+    auto cursor = 0u;
+    auto fan_vertex = 0u;
+    while (fan_vertex != NoVertex) {
+        scratch.candidates.clear();
+        for (auto i = scratch.adjacency_offsets[fan_vertex]; i < scratch.adjacency_offsets[fan_vertex + 1]; i++) {
+            const auto triangle = scratch.adjacency[i];
+            if (scratch.is_triangle_emitted[triangle]) {
+                continue;
+            }
+
+            for (auto corner = 0u; corner < 3; corner++) {
+                const auto vertex = scratch.local_indices[triangle * 3 + corner];
+                scratch.dead_ends.emplace_back(vertex);
+                scratch.candidates.emplace_back(vertex);
+                scratch.live_triangles[vertex]--;
+                if (time - scratch.cache_times[vertex] > VertexCacheSize) {
+                    scratch.cache_times[vertex] = time++;
+                }
+            }
+
+            scratch.is_triangle_emitted[triangle] = true;
+            scratch.triangle_order.emplace_back(triangle);
+        }
+
+        fan_vertex = get_next_fan_vertex(scratch, time, cursor);
+    }
+}
+
+/**
+ * \brief Reorders clusters of the triangles in scratch.triangle_order to reduce overdraw
+ *
+ * A cluster starts at each triangle whose vertices have all left the cache, so moving clusters around barely changes
+ * how well the cache is used. Clusters on the outside of the primitive, facing away from its center, are the most
+ * likely to hide the others, so they go first
+ */
+void order_clusters_for_overdraw(PrimitiveScratch& scratch, const SectorMesh& mesh) {
+    const auto& order = scratch.triangle_order;
+
+    std::fill(scratch.cache_times.begin(), scratch.cache_times.end(), 0);
+    scratch.cluster_starts.clear();
+    auto time = VertexCacheSize + 1;
+    for (auto i = 0u; i < order.size(); i++) {
+        auto num_misses = 0u;
+        for (auto corner = 0u; corner < 3; corner++) {
+            const auto vertex = scratch.local_indices[order[i] * 3 + corner];
+            if (time - scratch.cache_times[vertex] > VertexCacheSize) {
+                scratch.cache_times[vertex] = time++;
+                num_misses++;
+            }
+        }
+        if (i == 0 || num_misses == 3) {
+            scratch.cluster_starts.emplace_back(i);
+        }
+    }
+    if (scratch.cluster_starts.size() < 2) {
+        return;
+    }
+    scratch.cluster_starts.emplace_back(static_cast<uint32_t>(order.size()));
+
+    const auto get_position = [&](const uint32_t triangle, const uint32_t corner) {
+        return mesh.positions[scratch.local_vertices[scratch.local_indices[triangle * 3 + corner]]];
+    };
+
+    // Area-weighted centroids and normals. The cross product's length is twice the triangle's area, which is fine
+    // since we only compare them
+    auto primitive_centroid = glm::vec3{0};
+    auto primitive_area = 0.f;
+    scratch.clusters.clear();
+    const auto num_clusters = static_cast<uint32_t>(scratch.cluster_starts.size() - 1);
+    for (auto cluster_index = 0u; cluster_index < num_clusters; cluster_index++) {
+        auto& cluster = scratch.clusters.emplace_back();
+        for (auto i = scratch.cluster_starts[cluster_index]; i < scratch.cluster_starts[cluster_index + 1]; i++) {
+            const auto p0 = get_position(order[i], 0);
+            const auto p1 = get_position(order[i], 1);
+            const auto p2 = get_position(order[i], 2);
+            const auto cross = glm::cross(p1 - p0, p2 - p0);
+            const auto area = glm::length(cross);
+            cluster.centroid += (p0 + p1 + p2) * (area / 3.f);
+            cluster.normal += cross;
+            cluster.area += area;
+        }
+
+        primitive_centroid += cluster.centroid;
+        primitive_area += cluster.area;
+    }
+    if (primitive_area <= 0) {
+        return;
+    }
+    primitive_centroid /= primitive_area;
+
+    for (auto& cluster : scratch.clusters) {
+        const auto normal_length = glm::length(cluster.normal);
+        if (cluster.area > 0 && normal_length > 0) {
+            const auto centroid = cluster.centroid / cluster.area;
+            cluster.key = glm::dot(centroid - primitive_centroid, cluster.normal / normal_length);
+        }
+    }
+
+    scratch.cluster_order.resize(num_clusters);
+    for (auto cluster = 0u; cluster < num_clusters; cluster++) {
+        scratch.cluster_order[cluster] = cluster;
+    }
+    std::stable_sort(
+        scratch.cluster_order.begin(), scratch.cluster_order.end(), [&](const uint32_t a, const uint32_t b) {
+            return scratch.clusters[a].key > scratch.clusters[b].key;
+        }
+    );
+
+    // The sorted triangles go in triangle_order's old storage, so reuse adjacency for the copy of the old order
+    scratch.adjacency.assign(order.begin(), order.end());
+    auto next_triangle = 0u;
+    for (const auto cluster : scratch.cluster_order) {
+        for (auto i = scratch.cluster_starts[cluster]; i < scratch.cluster_starts[cluster + 1]; i++) {
+            scratch.triangle_order[next_triangle++] = scratch.adjacency[i];
+        }
+    }
+}
+
+/**
+ * Reorders one primitive's triangles for the vertex cache and for overdraw
+ *
+ * \param local_vertex_indices The local number of each mesh vertex, or NoVertex. All NoVertex before and after
+ */
+VertexCacheStats optimize_primitive(
+    MeshPrimitive& primitive, const SectorMesh& mesh, std::pmr::vector<uint32_t>& local_vertex_indices,
+    PrimitiveScratch& scratch
+) {
+    auto& indices = primitive.indices;
+    const auto num_triangles = static_cast<uint32_t>(indices.size() / 3);
+    auto stats = VertexCacheStats{.num_triangles = num_triangles};
+    if (num_triangles == 0) {
+        return stats;
+    }
+
+    scratch.local_indices.clear();
+    scratch.local_vertices.clear();
+    for (auto i = 0u; i < num_triangles * 3; i++) {
+        auto& local_index = local_vertex_indices[indices[i]];
+        if (local_index == NoVertex) {
+            local_index = static_cast<uint32_t>(scratch.local_vertices.size());
+            scratch.local_vertices.emplace_back(indices[i]);
+        }
+        scratch.local_indices.emplace_back(local_index);
+    }
+    for (const auto vertex : scratch.local_vertices) {
+        local_vertex_indices[vertex] = NoVertex;
+    }
+
+    // The original order, to measure it
+    scratch.triangle_order.resize(num_triangles);
+    for (auto triangle = 0u; triangle < num_triangles; triangle++) {
+        scratch.triangle_order[triangle] = triangle;
+    }
+    scratch.cache_times.resize(scratch.local_vertices.size());
+    stats.num_transformed_before = count_transformed_vertices(
+        scratch.local_indices, scratch.triangle_order, scratch.cache_times
+    );
+
+    order_triangles_for_vertex_cache(scratch);
+    order_clusters_for_overdraw(scratch, mesh);
+
+    stats.num_transformed_after = count_transformed_vertices(
+        scratch.local_indices, scratch.triangle_order, scratch.cache_times
+    );
+
+    // Clustering can, rarely, cost a few cache hits. Keep the original order if it's better
+    if (stats.num_transformed_after > stats.num_transformed_before) {
+        stats.num_transformed_after = stats.num_transformed_before;
+        return stats;
+    }
+
+    auto next_index = 0u;
+    for (const auto triangle : scratch.triangle_order) {
+        for (auto corner = 0u; corner < 3; corner++) {
+            indices[next_index++] = scratch.local_vertices[scratch.local_indices[triangle * 3 + corner]];
+        }
+    }
+
+    return stats;
+}
+
+/**
+ * Renumbers the mesh's vertices in the order that its primitives first use them. Vertices that no primitive uses are
+ * dropped. In a batch of sectors, each sector's vertices are renumbered within its range, so the ranges stay valid
+ */
+void order_vertices_for_fetch(SectorMesh& mesh, std::pmr::memory_resource* memory) {
+    // A single sector is one range that covers the whole mesh. Only the ranges' vertices matter here, so its sector
+    // is left at 0
+    auto ranges = std::pmr::vector<SectorVertexRange>{mesh.sector_ranges.begin(), mesh.sector_ranges.end(), memory};
+    if (ranges.empty()) {
+        ranges.emplace_back(
+            SectorVertexRange{
+                .sector = 0, .first_vertex = 0, .vertex_count = static_cast<uint32_t>(mesh.positions.size())
+            }
+        );
+    }
+
+    auto vertex_ranges = std::pmr::vector<uint32_t>(mesh.positions.size(), 0, memory);
+    for (auto range_index = 0u; range_index < ranges.size(); range_index++) {
+        const auto& range = ranges[range_index];
+        std::fill_n(vertex_ranges.begin() + range.first_vertex, range.vertex_count, range_index);
+    }
+
+    // First each used vertex's position within its range, then, once we know how many vertices each range keeps, its
+    // position in the mesh
+    auto new_vertex_indices = std::pmr::vector<uint32_t>(mesh.positions.size(), NoVertex, memory);
+    auto num_used_vertices = std::pmr::vector<uint32_t>(ranges.size(), 0, memory);
+    for (const auto& primitive : mesh.primitives) {
+        for (const auto index : primitive.indices) {
+            auto& new_index = new_vertex_indices[index];
+            if (new_index == NoVertex) {
+                new_index = num_used_vertices[vertex_ranges[index]]++;
+            }
+        }
+    }
+
+    auto first_vertex = 0u;
+    for (auto range_index = 0u; range_index < ranges.size(); range_index++) {
+        ranges[range_index].first_vertex = first_vertex;
+        ranges[range_index].vertex_count = num_used_vertices[range_index];
+        first_vertex += num_used_vertices[range_index];
+    }
+
+    for (auto vertex = 0u; vertex < new_vertex_indices.size(); vertex++) {
+        if (new_vertex_indices[vertex] != NoVertex) {
+            new_vertex_indices[vertex] += ranges[vertex_ranges[vertex]].first_vertex;
+        }
+    }
+    for (auto& primitive : mesh.primitives) {
+        for (auto& index : primitive.indices) {
+            index = new_vertex_indices[index];
+        }
+    }
+
+    auto positions = std::pmr::vector<glm::vec3>(first_vertex, memory);
+    auto normals = std::pmr::vector<glm::vec3>(first_vertex, memory);
+    auto texcoords = std::pmr::vector<glm::vec2>(first_vertex, memory);
+    for (auto vertex = 0u; vertex < new_vertex_indices.size(); vertex++) {
+        const auto new_index = new_vertex_indices[vertex];
+        if (new_index != NoVertex) {
+            positions[new_index] = mesh.positions[vertex];
+            normals[new_index] = mesh.normals[vertex];
+            texcoords[new_index] = mesh.texcoords[vertex];
+        }
+    }
+
+    mesh.positions = std::move(positions);
+    mesh.normals = std::move(normals);
+    mesh.texcoords = std::move(texcoords);
+    if (!mesh.sector_ranges.empty()) {
+        mesh.sector_ranges.assign(ranges.begin(), ranges.end());
+    }
+}
+
+VertexCacheStats optimize_mesh(SectorMesh& mesh, std::pmr::memory_resource* memory) {
+    auto stats = VertexCacheStats{};
+    if (mesh.primitives.empty()) {
+        return stats;
+    }
+
+    auto scratch = PrimitiveScratch{memory};
+    auto local_vertex_indices = std::pmr::vector<uint32_t>(mesh.positions.size(), NoVertex, memory);
+    for (auto& primitive : mesh.primitives) {
+        stats += optimize_primitive(primitive, mesh, local_vertex_indices, scratch);
+    }
+
+    order_vertices_for_fetch(mesh, memory);
+
+    return stats;
+}
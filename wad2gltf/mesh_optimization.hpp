@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <memory_resource>
+
+#include "mesh.hpp"
+
+/**
+ * \file mesh_optimization.hpp
+ *
+ * Reorders a welded mesh's triangles and vertices so that GPUs draw it faster
+ */
+
+/**
+ * Size of the post-transform vertex cache that we optimize for and simulate. Most GPUs have at least this many entries
+ */
+constexpr auto VertexCacheSize = 16u;
+
+/**
+ * \brief How well a mesh uses the post-transform vertex cache, before and after optimizing it
+ *
+ * The average cache miss ratio (ACMR) is the number of vertices that a FIFO cache of VertexCacheSize entries has to
+ * transform, divided by the number of triangles. It's 3 at worst, and about 0.5 at best for a big regular grid
+ */
+struct VertexCacheStats {
+    uint64_t num_triangles = 0;
+    uint64_t num_transformed_before = 0;
+    uint64_t num_transformed_after = 0;
+
+    double get_acmr_before() const;
+
+    double get_acmr_after() const;
+
+    VertexCacheStats& operator+=(const VertexCacheStats& other);
+};
+
+/**
+ * \brief Reorders a mesh for the vertex cache, overdraw, and vertex fetch, in that order
+ *
+ * 1. Each primitive's triangles are reordered with Tipsify (Sander, Nehab, and Barczak, "Fast Triangle Reordering for
+ *    Vertex Locality and Reduced Overdraw"), which fans around vertices while they're still in the cache
+ * 2. The reordered triangles are cut into clusters wherever the cache has gone cold anyway, and the clusters that face
+ *    away from the primitive's center are drawn first, since they're the most likely to be in front of the others
+ * 3. The vertices are renumbered in the order that the primitives first use them, so the GPU reads them in order. In a
+ *    batch of sectors, each sector's vertices are only renumbered within the sector's range
+ *
+ * The mesh looks exactly the same afterwards. Only the order of its triangles and vertices changes
+ *
+ * \param mesh The mesh to reorder
+ * \param memory Where the adjacency and the other scratch data go
+ * \return The vertex cache stats for the mesh's primitives
+ */
+VertexCacheStats optimize_mesh(
+    SectorMesh& mesh, std::pmr::memory_resource* memory = std::pmr::get_default_resource()
+);
@@ -0,0 +1,171 @@
+#include "mesh_quantization.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+/**
+ * Finest position scale we use. GL node vertices are fixed point, so a small map keeps their fractions
+ */
+constexpr auto MaxPositionScale = 16.f;
+
+/**
+ * Finest texcoord scale we use, which is finer than a texel of any texture DOOM can load
+ */
+constexpr auto MaxTexcoordScale = 16384.f;
+
+/**
+ * The largest power of two up to max_scale that keeps min_value * scale and max_value * scale in the range of an
+ * int16_t once they're rounded
+ */
+float get_quantization_scale(const float min_value, const float max_value, const float max_scale) {
+    auto scale = max_scale;
+    while (std::lround(min_value * scale) < std::numeric_limits<int16_t>::min() ||
+           std::lround(max_value * scale) > std::numeric_limits<int16_t>::max()) {
+        scale /= 2;
+    }
+
+    return scale;
+}
+
+int16_t quantize_short(const float value, const float scale) {
+    return static_cast<int16_t>(std::lround(value * scale));
+}
+
+int8_t quantize_normalized_byte(const float value) {
+    return static_cast<int8_t>(std::lround(std::clamp(value, -1.f, 1.f) * std::numeric_limits<int8_t>::max()));
+}
+
+QuantizedMeshBuffers quantize_mesh_buffers(const Map& map) {
+    const auto& geometry = map.geometry;
+    auto quantized = QuantizedMeshBuffers{};
+
+    // Sprite quads are in their things' space, and everything else is in the map's space. Only the map is moved to
+    // its center, so that maps that reach either end of the int16_t range keep the full scale
+    auto is_sprite_vertex = std::vector<bool>(geometry.positions.size(), false);
+    for (const auto& thing : map.things) {
+        std::fill_n(is_sprite_vertex.begin() + thing.sprite.first_vertex, thing.sprite.vertex_count, true);
+    }
+
+    auto map_min = glm::vec3{std::numeric_limits<float>::max()};
+    auto map_max = glm::vec3{std::numeric_limits<float>::lowest()};
+    for (auto vertex = 0u; vertex < geometry.positions.size(); vertex++) {
+        if (!is_sprite_vertex[vertex]) {
+            map_min = glm::min(map_min, geometry.positions[vertex]);
+            map_max = glm::max(map_max, geometry.positions[vertex]);
+        }
+    }
+    // A whole number of map units, so that positions on integers stay on integers. Halves round up, which centers the
+    // odd 65535-unit span of a map from -32768 to 32767 on 0
+    if (map_min.x <= map_max.x) {
+        const auto center = (map_min + map_max) / 2.f;
+        quantized.position_offset = glm::vec3{
+            std::floor(center.x + 0.5f), std::floor(center.y + 0.5f), std::floor(center.z + 0.5f)
+        };
+    }
+    const auto get_offset_position = [&](const uint32_t vertex) {
+        return is_sprite_vertex[vertex] ? geometry.positions[vertex]
+                                        : geometry.positions[vertex] - quantized.position_offset;
+    };
+
+    auto min_position = 0.f;
+    auto max_position = 0.f;
+    for (auto vertex = 0u; vertex < geometry.positions.size(); vertex++) {
+        const auto position = get_offset_position(vertex);
+        min_position = std::min({min_position, position.x, position.y, position.z});
+        max_position = std::max({max_position, position.x, position.y, position.z});
+    }
+    quantized.position_scale = get_quantization_scale(min_position, max_position, MaxPositionScale);
+
+    quantized.positions.reserve(geometry.positions.size());
+    for (auto vertex = 0u; vertex < geometry.positions.size(); vertex++) {
+        const auto position = get_offset_position(vertex);
+        quantized.positions.emplace_back(
+            std::array<int16_t, 4>{
+                quantize_short(position.x, quantized.position_scale),
+                quantize_short(position.y, quantized.position_scale),
+                quantize_short(position.z, quantized.position_scale),
+                0,
+            }
+        );
+    }
+
+    quantized.normals.reserve(geometry.normals.size());
+    for (const auto& normal : geometry.normals) {
+        quantized.normals.emplace_back(
+            std::array<int8_t, 4>{
+                quantize_normalized_byte(normal.x),
+                quantize_normalized_byte(normal.y),
+                quantize_normalized_byte(normal.z),
+                0,
+            }
+        );
+    }
+
+    // Every vertex of a mesh is shifted by the same whole number of repeats, so each of its triangles samples the
+    // texture in the same place
+    auto texcoord_shifts = std::vector<glm::vec2>(geometry.texcoords.size(), glm::vec2{0});
+    const auto add_texcoord_shift = [&](const uint32_t first_vertex, const uint32_t vertex_count) {
+        if (vertex_count == 0) {
+            return;
+        }
+
+        auto min = glm::vec2{std::numeric_limits<float>::max()};
+        auto max = glm::vec2{std::numeric_limits<float>::lowest()};
+        for (auto vertex = first_vertex; vertex < first_vertex + vertex_count; vertex++) {
+            min = glm::min(min, geometry.texcoords[vertex]);
+            max = glm::max(max, geometry.texcoords[vertex]);
+        }
+
+        const auto shift = glm::vec2{std::round((min.x + max.x) / 2), std::round((min.y + max.y) / 2)};
+        std::fill(
+            texcoord_shifts.begin() + first_vertex, texcoord_shifts.begin() + first_vertex + vertex_count, shift
+        );
+    };
+    for (const auto& sector : map.sectors) {
+        add_texcoord_shift(sector.mesh.first_vertex, sector.mesh.vertex_count);
+    }
+    // Sectors in a batch don't share vertices, so each one can have its own shift
+    for (const auto& batch : map.sector_batches) {
+        for (const auto& range : batch.sector_ranges) {
+            add_texcoord_shift(batch.mesh.first_vertex + range.first_vertex, range.vertex_count);
+        }
+    }
+    for (const auto& thing : map.things) {
+        add_texcoord_shift(thing.sprite.first_vertex, thing.sprite.vertex_count);
+    }
+
+    auto min_texcoord = 0.f;
+    auto max_texcoord = 0.f;
+    for (auto vertex = 0u; vertex < geometry.texcoords.size(); vertex++) {
+        const auto texcoord = geometry.texcoords[vertex] - texcoord_shifts[vertex];
+        min_texcoord = std::min({min_texcoord, texcoord.x, texcoord.y});
+        max_texcoord = std::max({max_texcoord, texcoord.x, texcoord.y});
+    }
+    quantized.texcoord_scale = get_quantization_scale(min_texcoord, max_texcoord, MaxTexcoordScale);
+
+    // Rounding moves a texcoord by up to 0.5 / texcoord_scale repeats, which is half a texel when the scale is the
+    // texture's size
+    auto max_texture_size = 0.f;
+    for (const auto& texture : map.textures) {
+        max_texture_size = std::max(
+            {max_texture_size, static_cast<float>(texture.size.x), static_cast<float>(texture.size.y)}
+        );
+    }
+    if (quantized.texcoord_scale < max_texture_size) {
+        return quantized;
+    }
+
+    quantized.texcoords.reserve(geometry.texcoords.size());
+    for (auto vertex = 0u; vertex < geometry.texcoords.size(); vertex++) {
+        const auto texcoord = geometry.texcoords[vertex] - texcoord_shifts[vertex];
+        quantized.texcoords.emplace_back(
+            std::array<int16_t, 2>{
+                quantize_short(texcoord.x, quantized.texcoord_scale),
+                quantize_short(texcoord.y, quantized.texcoord_scale),
+            }
+        );
+    }
+
+    return quantized;
+}
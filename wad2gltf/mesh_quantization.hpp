@@ -0,0 +1,68 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "mesh.hpp"
+
+/**
+ * \file mesh_quantization.hpp
+ *
+ * Packs a map's vertex attributes into the smaller component types that KHR_mesh_quantization allows
+ */
+
+/**
+ * \brief A map's vertex attributes, quantized
+ *
+ * The vertices are in the same order as in the map's MeshBuffers, so the same MeshRanges and indices work for both.
+ * glTF needs each vertex's attribute to start on a multiple of 4 bytes, so positions and normals are padded
+ */
+struct QuantizedMeshBuffers {
+    /**
+     * \brief SHORT positions. Each one is round((position - position_offset) * position_scale)
+     *
+     * Things' sprite quads are in their things' space rather than the map's, so they aren't offset
+     */
+    std::vector<std::array<int16_t, 4>> positions;
+
+    /**
+     * Center of the map's bounds, in whole map units. The map's top-level node moves the positions back by this much
+     */
+    glm::vec3 position_offset = glm::vec3{0};
+
+    /**
+     * A power of two, so that the positions are exact whenever they're multiples of 1 / position_scale. DOOM's map
+     * units are integers, so that's everything but some sprites and GL node vertices in big maps
+     */
+    float position_scale = 1;
+
+    /**
+     * Normalized BYTE normals
+     */
+    std::vector<std::array<int8_t, 4>> normals;
+
+    /**
+     * \brief SHORT texcoords. Each one is round((texcoord - shift) * texcoord_scale)
+     *
+     * Textures repeat, so each sector's and thing's texcoords are shifted by the whole number of repeats closest to
+     * their center. That doesn't change how the mesh looks, and it keeps the texcoords small enough for a useful scale
+     *
+     * Empty if the texcoords span so many repeats that the scale that fits them in a SHORT would be off by more than
+     * half a texel
+     */
+    std::vector<std::array<int16_t, 2>> texcoords;
+
+    /**
+     * A power of two. Texture transforms on the materials scale the texcoords back by 1 / texcoord_scale
+     */
+    float texcoord_scale = 1;
+};
+
+/**
+ * \brief Quantizes the attributes of all the sectors and things in the map
+ *
+ * \param map The map. Every vertex in its MeshBuffers must be in one of its sectors', sector batches', or things'
+ * MeshRanges
+ */
+QuantizedMeshBuffers quantize_mesh_buffers(const Map& map);
@@ -0,0 +1,298 @@
+#include "mesh_welding.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <memory_resource>
+#include <unordered_map>
+
+/**
+ * How far from an edge a vertex can be and still be on it, in map units
+ */
+constexpr auto EdgeEpsilon = 1.0 / 1024.0;
+
+/**
+ * Size of the grid cells that we bucket positions into when looking for T-junctions, in map units
+ */
+constexpr auto GridCellSize = 64.0;
+
+/**
+ * Gets the bits of some floats, with -0 turned into 0 so that the two compare and hash the same
+ */
+template <size_t NumValues>
+std::array<uint32_t, NumValues> to_key(const std::array<float, NumValues>& values) {
+    auto key = std::array<uint32_t, NumValues>{};
+    for (auto i = 0u; i < NumValues; i++) {
+        const auto value = values[i] + 0.0f;
+        std::memcpy(&key[i], &value, sizeof(uint32_t));
+    }
+
+    return key;
+}
+
+template <size_t NumValues>
+struct KeyHash {
+    std::size_t operator()(const std::array<uint32_t, NumValues>& key) const noexcept {
+        auto hash = uint64_t{0xcbf29ce484222325};
+        for (const auto value : key) {
+            hash = (hash ^ value) * 0x100000001b3;
+        }
+        hash ^= hash >> 33;
+        return static_cast<std::size_t>(hash);
+    }
+};
+
+/**
+ * Adds vertices to a mesh, reusing the vertex that's already there if there is one
+ */
+class VertexWelder {
+public:
+    VertexWelder(SectorMesh& mesh_in, std::pmr::memory_resource* memory) : mesh{mesh_in}, vertex_indices{memory} {}
+
+    uint32_t add(const glm::vec3& position, const glm::vec3& normal, const glm::vec2& texcoord) {
+        const auto key = to_key<8>(
+            {position.x, position.y, position.z, normal.x, normal.y, normal.z, texcoord.x, texcoord.y}
+        );
+        const auto [itr, is_new] = vertex_indices.try_emplace(key, static_cast<uint32_t>(mesh.positions.size()));
+        if (is_new) {
+            mesh.positions.emplace_back(position);
+            mesh.normals.emplace_back(normal);
+            mesh.texcoords.emplace_back(texcoord);
+        }
+
+        return itr->second;
+    }
+
+private:
+    SectorMesh& mesh;
+
+    std::pmr::unordered_map<std::array<uint32_t, 8>, uint32_t, KeyHash<8>> vertex_indices;
+};
+
+/**
+ * The distinct positions in a mesh, bucketed into a grid on the XY plane
+ */
+class PositionGrid {
+public:
+    PositionGrid(const std::pmr::vector<glm::vec3>& all_positions, std::pmr::memory_resource* memory) : cells{memory} {
+        auto seen_positions = std::pmr::unordered_map<std::array<uint32_t, 3>, uint32_t, KeyHash<3>>{memory};
+        for (const auto& position : all_positions) {
+            if (seen_positions.try_emplace(to_key<3>({position.x, position.y, position.z}), 0).second) {
+                cells[get_cell(position.x, position.y)].emplace_back(position);
+            }
+        }
+    }
+
+    /**
+     * Calls visitor with every position that might be on the edge from start to end
+     */
+    template <typename VisitorType>
+    void for_each_near_edge(const glm::vec3& start, const glm::vec3& end, VisitorType&& visitor) const {
+        const auto min_x = cell_coordinate(std::min(start.x, end.x) - EdgeEpsilon);
+        const auto max_x = cell_coordinate(std::max(start.x, end.x) + EdgeEpsilon);
+        const auto min_y = cell_coordinate(std::min(start.y, end.y) - EdgeEpsilon);
+        const auto max_y = cell_coordinate(std::max(start.y, end.y) + EdgeEpsilon);
+        for (auto y = min_y; y <= max_y; y++) {
+            for (auto x = min_x; x <= max_x; x++) {
+                const auto itr = cells.find(pack_cell(x, y));
+                if (itr == cells.end()) {
+                    continue;
+                }
+                for (const auto& position : itr->second) {
+                    visitor(position);
+                }
+            }
+        }
+    }
+
+private:
+    std::pmr::unordered_map<uint64_t, std::pmr::vector<glm::vec3>> cells;
+
+    static int32_t cell_coordinate(const double value) {
+        return static_cast<int32_t>(std::floor(value / GridCellSize));
+    }
+
+    static uint64_t pack_cell(const int32_t x, const int32_t y) {
+        return (uint64_t{static_cast<uint32_t>(x)} << 32) | static_cast<uint32_t>(y);
+    }
+
+    static uint64_t get_cell(const float x, const float y) {
+        return pack_cell(cell_coordinate(x), cell_coordinate(y));
+    }
+};
+
+/**
+ * A vertex of a triangle that we're splitting, and how far along its edge it is
+ */
+struct EdgePoint {
+    double t;
+    glm::vec3 position;
+};
+
+double get_triangle_area(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+    const auto ab = glm::dvec3{b} - glm::dvec3{a};
+    const auto ac = glm::dvec3{c} - glm::dvec3{a};
+    return glm::length(glm::cross(ab, ac)) / 2.0;
+}
+
+/**
+ * Finds the positions inside an edge, sorted from start to end. points is cleared first
+ */
+void find_edge_points(
+    const PositionGrid& grid, const glm::vec3& start, const glm::vec3& end, std::pmr::vector<EdgePoint>& points
+) {
+    points.clear();
+
+    const auto edge = glm::dvec3{end} - glm::dvec3{start};
+    const auto edge_length = glm::length(edge);
+    if (edge_length <= 2 * EdgeEpsilon) {
+        return;
+    }
+
+    grid.for_each_near_edge(start, end, [&](const glm::vec3& position) {
+        const auto offset = glm::dvec3{position} - glm::dvec3{start};
+        const auto distance_along = glm::dot(offset, edge) / edge_length;
+        if (distance_along <= EdgeEpsilon || distance_along >= edge_length - EdgeEpsilon) {
+            return;
+        }
+
+        const auto distance_away = glm::length(offset - edge * (distance_along / edge_length));
+        if (distance_away <= EdgeEpsilon) {
+            points.emplace_back(EdgePoint{.t = distance_along / edge_length, .position = position});
+        }
+    });
+
+    std::sort(points.begin(), points.end(), [](const EdgePoint& a, const EdgePoint& b) { return a.t < b.t; });
+}
+
+/**
+ * Splits every triangle that has a position of the mesh inside one of its edges
+ *
+ * The triangle becomes a convex polygon with its split points on its edges. We triangulate that by cutting off ears
+ * that aren't flat, which never needs any new vertices
+ */
+void split_t_junctions(SectorMesh& mesh, VertexWelder& welder, std::pmr::memory_resource* memory) {
+    const auto grid = PositionGrid{mesh.positions, memory};
+
+    auto split_indices = std::pmr::vector<uint32_t>{memory};
+    auto polygon = std::pmr::vector<uint32_t>{memory};
+    auto edge_points = std::pmr::vector<EdgePoint>{memory};
+    for (auto& primitive : mesh.primitives) {
+        split_indices.clear();
+        split_indices.reserve(primitive.indices.size());
+
+        for (auto triangle = 0u; triangle + 2 < primitive.indices.size(); triangle += 3) {
+            polygon.clear();
+
+            for (auto corner = 0u; corner < 3; corner++) {
+                const auto start = primitive.indices[triangle + corner];
+                const auto end = primitive.indices[triangle + (corner + 1) % 3];
+                polygon.emplace_back(start);
+
+                // Copies, since adding vertices can move the mesh's arrays
+                const auto start_normal = mesh.normals[start];
+                const auto end_normal = mesh.normals[end];
+                const auto start_texcoord = mesh.texcoords[start];
+                const auto end_texcoord = mesh.texcoords[end];
+                find_edge_points(grid, mesh.positions[start], mesh.positions[end], edge_points);
+                for (const auto& point : edge_points) {
+                    const auto t = static_cast<float>(point.t);
+                    polygon.emplace_back(
+                        welder.add(
+                            point.position, start_normal + (end_normal - start_normal) * t,
+                            start_texcoord + (end_texcoord - start_texcoord) * t
+                        )
+                    );
+                }
+            }
+
+            if (polygon.size() == 3) {
+                split_indices.insert(split_indices.end(), polygon.begin(), polygon.end());
+                continue;
+            }
+
+            // Cut off the first ear with some area until only a triangle is left. Every ear keeps the winding order
+            const auto min_area = EdgeEpsilon * EdgeEpsilon;
+            while (polygon.size() > 3) {
+                auto ear = size_t{0};
+                for (; ear < polygon.size(); ear++) {
+                    const auto previous = polygon[(ear + polygon.size() - 1) % polygon.size()];
+                    const auto next = polygon[(ear + 1) % polygon.size()];
+                    if (get_triangle_area(mesh.positions[previous], mesh.positions[polygon[ear]], mesh.positions[next])
+                        > min_area) {
+                        break;
+                    }
+                }
+                if (ear == polygon.size()) {
+                    // Everything left is flat, so there's nothing to draw
+                    polygon.clear();
+                    break;
+                }
+
+                split_indices.emplace_back(polygon[(ear + polygon.size() - 1) % polygon.size()]);
+                split_indices.emplace_back(polygon[ear]);
+                split_indices.emplace_back(polygon[(ear + 1) % polygon.size()]);
+                polygon.erase(polygon.begin() + static_cast<ptrdiff_t>(ear));
+            }
+            split_indices.insert(split_indices.end(), polygon.begin(), polygon.end());
+        }
+
+        primitive.indices.assign(split_indices.begin(), split_indices.end());
+    }
+}
+
+void add_flat(
+    const Flat& flat, const glm::vec3& normal, SectorMesh& mesh, VertexWelder& welder,
+    std::pmr::memory_resource* memory
+) {
+    auto vertex_indices = std::pmr::vector<uint32_t>{memory};
+    vertex_indices.reserve(flat.vertices.size());
+    for (const auto& position : flat.vertices) {
+        // Flats are aligned to a 64x64 grid
+        vertex_indices.emplace_back(welder.add(position, normal, glm::vec2{position.x / 64.f, position.y / 64.f}));
+    }
+
+    auto& primitive = mesh.primitives.emplace_back(
+        MeshPrimitive{.texture_index = flat.texture_index, .indices = std::pmr::vector<uint32_t>{memory}}
+    );
+    primitive.indices.reserve(flat.indices.size());
+    for (const auto index : flat.indices) {
+        primitive.indices.emplace_back(vertex_indices[index]);
+    }
+}
+
+SectorMesh weld_sector(
+    const std::span<const Face> faces, const Flat& ceiling, const Flat& floor, std::pmr::memory_resource* memory
+) {
+    auto mesh = SectorMesh{memory};
+    auto welder = VertexWelder{mesh, memory};
+
+    for (const auto& face : faces) {
+        auto& primitive = mesh.primitives.emplace_back(
+            MeshPrimitive{.texture_index = face.texture_index, .indices = std::pmr::vector<uint32_t>{memory}}
+        );
+
+        auto face_indices = std::array<uint32_t, 4>{};
+        for (auto i = 0u; i < 4; i++) {
+            face_indices[i] = welder.add(face.vertices[i].position, face.normal, face.vertices[i].texcoord);
+        }
+
+        // 0 1 2 3 2 1, counter-clockwise
+        primitive.indices = {
+            face_indices[0], face_indices[1], face_indices[2], face_indices[3], face_indices[2], face_indices[1]
+        };
+    }
+
+    // The floor or ceiling may be empty for F_SKYn (where the sky should be drawn)
+    if (!ceiling.indices.empty()) {
+        add_flat(ceiling, glm::vec3{0, 0, -1}, mesh, welder, memory);
+    }
+    if (!floor.indices.empty()) {
+        add_flat(floor, glm::vec3{0, 0, 1}, mesh, welder, memory);
+    }
+
+    split_t_junctions(mesh, welder, memory);
+
+    return mesh;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <memory_resource>
+#include <span>
+
+#include "mesh.hpp"
+
+/**
+ * \file mesh_welding.hpp
+ *
+ * Turns a sector's separate faces and flats into one indexed mesh
+ */
+
+/**
+ * \brief Welds a sector's faces, ceiling, and floor into one mesh
+ *
+ * Vertices with exactly the same position, normal, and texcoord are stored once. Then T-junctions are split: wherever
+ * a vertex of the sector lies inside the edge of a triangle, the triangle is split at that vertex, so that
+ * neighboring triangles share their edges exactly and there are no cracks between them. Walls that
+ * merge_collinear_walls joined, and floors built from subsectors, are where most T-junctions come from
+ *
+ * Flats get their texcoords here, from a 64x64 grid in world space
+ *
+ * \param faces The sector's walls
+ * \param ceiling The sector's ceiling, which has no indices in sky sectors
+ * \param floor The sector's floor
+ * \param memory Where the mesh, the vertex lookup, the T-junction grid, and the other scratch data go
+ * \return The welded mesh, ready to be appended to the map's MeshBuffers
+ */
+SectorMesh weld_sector(
+    std::span<const Face> faces, const Flat& ceiling, const Flat& floor,
+    std::pmr::memory_resource* memory = std::pmr::get_default_resource()
+);
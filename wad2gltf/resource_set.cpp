@@ -0,0 +1,50 @@
+#include "resource_set.hpp"
+
+#include <functional>
+
+namespace wad {
+    ResourceSet::ResourceSet(WAD&& wad) {
+        add_wad(std::move(wad));
+    }
+
+    void ResourceSet::add_wad(WAD&& wad) {
+        const auto wad_index = static_cast<uint32_t>(wads.size());
+
+        lump_directory.insert(lump_directory.end(), wad.lump_directory.begin(), wad.lump_directory.end());
+        lump_sources.resize(lump_directory.size(), wad_index);
+
+        // Moving the WAD doesn't move its data, so lump_directory stays valid
+        wads.emplace_back(std::move(wad));
+
+        lump_index.build(lump_directory);
+        map_index.build(lump_directory);
+    }
+
+    void ResourceSet::prefetch_map(const MapEntry& map) const {
+        // All of a map's lumps come from the same WAD, except for GL nodes which might be in a separate GWA file
+        auto lumps_per_wad = std::vector<std::vector<const LumpInfo*>>(wads.size());
+        for (const auto lump_index_in_directory : map.lump_indices) {
+            if (lump_index_in_directory != MapEntry::NoLump) {
+                lumps_per_wad[lump_sources[lump_index_in_directory]].emplace_back(
+                    &lump_directory[lump_index_in_directory]
+                );
+            }
+        }
+
+        for (auto i = 0u; i < wads.size(); i++) {
+            if (!lumps_per_wad[i].empty()) {
+                wads[i].prefetch_lumps(lumps_per_wad[i]);
+            }
+        }
+    }
+
+    const WAD& ResourceSet::get_source_wad(const LumpInfo& lump) const {
+        const auto* lump_ptr = &lump;
+        if (std::less{}(lump_ptr, lump_directory.data()) ||
+            !std::less{}(lump_ptr, lump_directory.data() + lump_directory.size())) {
+            throw std::runtime_error{std::format("Lump {} is not from this resource set's lump directory", lump.name)};
+        }
+
+        return wads[lump_sources[lump_ptr - lump_directory.data()]];
+    }
+}
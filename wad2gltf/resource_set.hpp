@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstdint>
+#include <format>
+#include <stdexcept>
+#include <vector>
+
+#include "lump_index.hpp"
+#include "map_index.hpp"
+#include "wad.hpp"
+
+namespace wad {
+    /**
+     * A stack of WADs that are searched as if they were one WAD
+     *
+     * Usually this is an IWAD with some PWADs on top of it. Lumps in WADs that are added later override lumps with
+     * the same name in WADs that were added earlier, like when you run DOOM with `-file`
+     *
+     * We don't concatenate the WADs' data. Instead we keep a merged copy of the lump directories, along with which WAD
+     * each lump came from, and hash the merged directory. A map's lumps all come from the same WAD, so they're still
+     * contiguous in the merged directory
+     */
+    struct ResourceSet {
+        std::vector<WAD> wads;
+
+        /**
+         * All the WADs' lump directories, in the order the WADs were added
+         */
+        std::vector<LumpInfo> lump_directory;
+
+        /**
+         * Index of the WAD that each lump in lump_directory came from
+         */
+        std::vector<uint32_t> lump_sources;
+
+        /**
+         * Hash index of the merged lump directory
+         */
+        LumpIndex lump_index;
+
+        /**
+         * Table of the maps in the merged lump directory. Maps in later WADs replace maps with the same name in
+         * earlier WADs
+         */
+        MapIndex map_index;
+
+        ResourceSet() = default;
+
+        explicit ResourceSet(WAD&& wad);
+
+        ResourceSet(const ResourceSet& other) = delete;
+        ResourceSet& operator=(const ResourceSet& other) = delete;
+
+        ResourceSet(ResourceSet&& old) noexcept = default;
+        ResourceSet& operator=(ResourceSet&& old) noexcept = default;
+
+        /**
+         * Adds a WAD to the top of the stack, so that its lumps override the lumps of all the WADs added before it
+         */
+        void add_wad(WAD&& wad);
+
+        /**
+         * Finds the lump with the requested name in the topmost WAD that has it
+         *
+         * \throws std::runtime_error if no WAD has a lump with the requested name
+         */
+        template <typename NameType>
+        auto find_lump(const NameType& lump_name) const {
+            const auto lump_index_in_directory = lump_index.find_last(to_name(lump_name));
+            if (!lump_index_in_directory) {
+                throw std::runtime_error{std::format("Could not find requested lump {}", lump_name)};
+            }
+
+            return lump_directory.begin() + *lump_index_in_directory;
+        }
+
+        /**
+         * Finds all the lumps with the requested name, from the bottom of the stack to the top
+         */
+        template <typename NameType>
+        auto find_all(const NameType& lump_name) const {
+            auto lumps = std::vector<decltype(lump_directory.begin())>{};
+            for (const auto lump_index_in_directory : lump_index.find_all(to_name(lump_name))) {
+                lumps.emplace_back(lump_directory.begin() + lump_index_in_directory);
+            }
+
+            return lumps;
+        }
+
+        /**
+         * Finds the map with the requested name in the topmost WAD that has it
+         *
+         * \throws std::runtime_error if no WAD has a map with the requested name
+         */
+        template <typename NameType>
+        const MapEntry& find_map(const NameType& map_name) const {
+            const auto* map = map_index.find_map(to_name(map_name));
+            if (map == nullptr) {
+                throw std::runtime_error{std::format("Could not find requested map {}", map_name)};
+            }
+
+            return *map;
+        }
+
+        /**
+         * Gets the data for one of a map's lumps
+         *
+         * \throws std::runtime_error if the map doesn't have the requested lump
+         */
+        template <typename LumpDataType>
+        std::span<const LumpDataType> get_map_lump_data(const MapEntry& map, const MapLump lump) const {
+            const auto lump_index_in_directory = map.get_lump_index(lump);
+            if (!lump_index_in_directory) {
+                throw std::runtime_error{std::format(
+                    "Map {} has no {} lump", map.name, map_lump_names[static_cast<size_t>(lump)]
+                )};
+            }
+
+            return get_lump_data<LumpDataType>(lump_directory[*lump_index_in_directory]);
+        }
+
+        /**
+         * Reads all of a map's lumps ahead of time, in file order. Does nothing for WADs that aren't streamed
+         */
+        void prefetch_map(const MapEntry& map) const;
+
+        /**
+         * Gets the data for a lump
+         *
+         * \param lump A lump from this resource set's lump directory. Lumps from the individual WADs' directories
+         * are not allowed, because we wouldn't know which WAD they came from
+         */
+        template <typename LumpDataType>
+        std::span<const LumpDataType> get_lump_data(const LumpInfo& lump) const {
+            return get_source_wad(lump).get_lump_data<LumpDataType>(lump);
+        }
+
+    private:
+        const WAD& get_source_wad(const LumpInfo& lump) const;
+    };
+}
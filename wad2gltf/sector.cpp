@@ -1,5 +1,8 @@
 #include "sector.hpp"
 
+#include <algorithm>
+#include <cmath>
+
 bool is_polygon_clockwise(const std::vector<SectorVertex>& polygon) {
     int32_t area = 0;
     for (auto i = 0u; i < polygon.size(); i++) {
@@ -45,3 +48,110 @@ bool is_polygon_in_polygon(const std::vector<SectorVertex>& candidate_hole,const
 
     return false;
 }
+
+LoopBounds LoopBounds::of(const std::vector<SectorVertex>& loop) {
+    auto bounds = LoopBounds{
+        .min_x = INT32_MAX, .min_y = INT32_MAX, .max_x = INT32_MIN, .max_y = INT32_MIN
+    };
+    for (const auto& vertex : loop) {
+        bounds.min_x = std::min(bounds.min_x, static_cast<int32_t>(vertex[0]));
+        bounds.min_y = std::min(bounds.min_y, static_cast<int32_t>(vertex[1]));
+        bounds.max_x = std::max(bounds.max_x, static_cast<int32_t>(vertex[0]));
+        bounds.max_y = std::max(bounds.max_y, static_cast<int32_t>(vertex[1]));
+    }
+
+    return bounds;
+}
+
+bool LoopBounds::overlaps(const LoopBounds& other) const {
+    return min_x <= other.max_x && other.min_x <= max_x && min_y <= other.max_y && other.min_y <= max_y;
+}
+
+LoopClassification classify_loops(
+    const std::vector<std::vector<SectorVertex>>& loops, std::pmr::memory_resource* memory
+) {
+    const auto num_loops = static_cast<uint32_t>(loops.size());
+
+    auto classification = LoopClassification{};
+    classification.hole_owners.resize(num_loops, LoopClassification::NoOwner);
+    if (num_loops == 0) {
+        return classification;
+    }
+
+    auto loop_bounds = std::pmr::vector<LoopBounds>{memory};
+    loop_bounds.reserve(num_loops);
+    auto sector_bounds = LoopBounds{.min_x = INT32_MAX, .min_y = INT32_MAX, .max_x = INT32_MIN, .max_y = INT32_MIN};
+    for (const auto& loop : loops) {
+        const auto& bounds = loop_bounds.emplace_back(LoopBounds::of(loop));
+        sector_bounds.min_x = std::min(sector_bounds.min_x, bounds.min_x);
+        sector_bounds.min_y = std::min(sector_bounds.min_y, bounds.min_y);
+        sector_bounds.max_x = std::max(sector_bounds.max_x, bounds.max_x);
+        sector_bounds.max_y = std::max(sector_bounds.max_y, bounds.max_y);
+    }
+
+    // Bucket the loops into a grid with about one cell per loop. Each loop goes in every cell its bounds touch
+    const auto grid_size = std::clamp(static_cast<int32_t>(std::ceil(std::sqrt(num_loops))), 1, 64);
+    const auto cell_width = (sector_bounds.max_x - sector_bounds.min_x) / grid_size + 1;
+    const auto cell_height = (sector_bounds.max_y - sector_bounds.min_y) / grid_size + 1;
+    const auto get_cell_range = [&](const LoopBounds& bounds) {
+        return std::array{
+            (bounds.min_x - sector_bounds.min_x) / cell_width, (bounds.min_y - sector_bounds.min_y) / cell_height,
+            (bounds.max_x - sector_bounds.min_x) / cell_width, (bounds.max_y - sector_bounds.min_y) / cell_height,
+        };
+    };
+
+    auto cells = std::pmr::vector<std::pmr::vector<uint32_t>>(static_cast<size_t>(grid_size * grid_size), memory);
+    for (auto i = 0u; i < num_loops; i++) {
+        const auto [min_cell_x, min_cell_y, max_cell_x, max_cell_y] = get_cell_range(loop_bounds[i]);
+        for (auto y = min_cell_y; y <= max_cell_y; y++) {
+            for (auto x = min_cell_x; x <= max_cell_x; x++) {
+                cells[y * grid_size + x].emplace_back(i);
+            }
+        }
+    }
+
+    // Find the loops that contain each loop. A loop that's listed in several of the cells we look at is only tested
+    // once, thanks to the stamp
+    auto containers = std::pmr::vector<std::pmr::vector<uint32_t>>(num_loops, memory);
+    auto last_tested_for = std::pmr::vector<uint32_t>(num_loops, UINT32_MAX, memory);
+    for (auto i = 0u; i < num_loops; i++) {
+        const auto [min_cell_x, min_cell_y, max_cell_x, max_cell_y] = get_cell_range(loop_bounds[i]);
+        for (auto y = min_cell_y; y <= max_cell_y; y++) {
+            for (auto x = min_cell_x; x <= max_cell_x; x++) {
+                for (const auto candidate : cells[y * grid_size + x]) {
+                    if (candidate == i || last_tested_for[candidate] == i) {
+                        continue;
+                    }
+                    last_tested_for[candidate] = i;
+
+                    if (loop_bounds[i].overlaps(loop_bounds[candidate]) &&
+                        is_polygon_in_polygon(loops[i], loops[candidate])) {
+                        containers[i].emplace_back(candidate);
+                    }
+                }
+            }
+        }
+    }
+
+    // The innermost loop that encloses a loop is the enclosing loop with the most loops around it
+    for (auto i = 0u; i < num_loops; i++) {
+        const auto depth = containers[i].size();
+        if (depth % 2 == 0) {
+            classification.exterior_loops.emplace_back(i);
+            continue;
+        }
+
+        auto innermost_container = containers[i].front();
+        for (const auto container : containers[i]) {
+            if (containers[container].size() > containers[innermost_container].size()) {
+                innermost_container = container;
+            }
+        }
+
+        if (containers[innermost_container].size() % 2 == 0) {
+            classification.hole_owners[i] = innermost_container;
+        }
+    }
+
+    return classification;
+}
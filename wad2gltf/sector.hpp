@@ -2,6 +2,7 @@
 
 #include <array>
 #include <cstdint>
+#include <memory_resource>
 #include <vector>
 
 using SectorVertex = std::array<int16_t, 2>;
@@ -13,3 +14,52 @@ bool is_point_in_polygon(const SectorVertex& p, const std::vector<SectorVertex>&
 bool is_polygon_in_polygon(
     const std::vector<SectorVertex>& candidate_hole, const std::vector<SectorVertex>& outer_polygon
 );
+
+/**
+ * Axis-aligned bounding box of a loop, in map units
+ */
+struct LoopBounds {
+    int32_t min_x = 0;
+    int32_t min_y = 0;
+    int32_t max_x = 0;
+    int32_t max_y = 0;
+
+    static LoopBounds of(const std::vector<SectorVertex>& loop);
+
+    bool overlaps(const LoopBounds& other) const;
+};
+
+/**
+ * How a sector's loops nest inside each other
+ */
+struct LoopClassification {
+    constexpr static inline uint32_t NoOwner = UINT32_MAX;
+
+    /**
+     * Loops that bound an area of the sector, in the order they were given. These are loops that are inside an even
+     * number of other loops, so an island inside a hole is an exterior loop too
+     */
+    std::vector<uint32_t> exterior_loops;
+
+    /**
+     * For each loop, the exterior loop that it's a hole in. NoOwner for exterior loops, and for holes whose
+     * innermost enclosing loop is also a hole, which only happens when loops overlap
+     */
+    std::vector<uint32_t> hole_owners;
+};
+
+/**
+ * \brief Decides which of a sector's loops are exteriors and which are holes, and which exterior owns each hole
+ *
+ * A loop is inside another loop if is_polygon_in_polygon says so. Its containment depth is how many loops it's in.
+ * Loops at an even depth are exteriors, and loops at an odd depth are holes in the innermost loop that encloses them.
+ * A grid over the loops' bounding boxes means we only run the point-in-polygon test for loops whose bounding boxes
+ * overlap
+ *
+ * \param loops The sector's loops
+ * \param memory Where the grid and the other scratch data go. The result doesn't use it
+ */
+LoopClassification classify_loops(
+    const std::vector<std::vector<SectorVertex>>& loops,
+    std::pmr::memory_resource* memory = std::pmr::get_default_resource()
+);
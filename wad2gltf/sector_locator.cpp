@@ -0,0 +1,244 @@
+#include "sector_locator.hpp"
+
+#include <algorithm>
+#include <format>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+#include "subsector_polygons.hpp"
+
+constexpr auto NoSector = UINT32_MAX;
+
+/**
+ * Size of the linedef grid's cells, in map units. The same as the game's blockmap
+ */
+constexpr auto GridCellSize = 128;
+
+/**
+ * Whether a point is on the left (back) side of a node's partition line. This is R_PointOnSide, without the fixed point
+ */
+bool is_on_back_side(const wad::Node& node, const int32_t x, const int32_t y) {
+    if (node.dx == 0) {
+        return x <= node.x ? node.dy > 0 : node.dy < 0;
+    }
+    if (node.dy == 0) {
+        return y <= node.y ? node.dx < 0 : node.dx > 0;
+    }
+
+    const auto left = int64_t{node.dy} * (x - node.x);
+    const auto right = int64_t{y - node.y} * node.dx;
+    return right >= left;
+}
+
+SectorLocator SectorLocator::build(const wad::MapData& map_data) {
+    try {
+        if (auto locator = from_nodes(map_data)) {
+            return std::move(*locator);
+        }
+    } catch (const std::runtime_error& e) {
+        std::cout << std::format(
+            "WARNING: Can't use the nodes of map {} to find sectors: {}\n", map_data.name, e.what()
+        );
+    }
+
+    return from_linedefs(map_data);
+}
+
+std::optional<SectorLocator> SectorLocator::from_nodes(const wad::MapData& map_data) {
+    const auto segs = map_data.segs;
+    const auto subsectors = map_data.subsectors;
+    const auto nodes = map_data.nodes;
+    if (segs.empty() || subsectors.empty() || (nodes.empty() && subsectors.size() > 1)) {
+        return std::nullopt;
+    }
+
+    // A subsector is in the sector of any of its segs, so we use the first one
+    auto locator = SectorLocator{};
+    locator.nodes = nodes;
+    locator.subsector_sectors.reserve(subsectors.size());
+    for (auto subsector_index = 0u; subsector_index < subsectors.size(); subsector_index++) {
+        const auto& subsector = subsectors[subsector_index];
+        if (subsector.seg_count == 0 || subsector.first_seg >= segs.size()) {
+            throw std::runtime_error{std::format("Subsector {} uses segs that don't exist", subsector_index)};
+        }
+
+        const auto& seg = segs[subsector.first_seg];
+        locator.subsector_sectors.emplace_back(
+            get_seg_sector(map_data, subsector.first_seg, seg.linedef, static_cast<uint16_t>(seg.direction))
+        );
+    }
+
+    if (nodes.empty()) {
+        return locator;
+    }
+
+    // Every node must be reachable from the root at most once, or walking down the tree might never end
+    auto is_node_visited = std::vector<bool>(nodes.size(), false);
+    auto pending_nodes = std::vector{static_cast<uint16_t>(nodes.size() - 1)};
+    while (!pending_nodes.empty()) {
+        const auto node_index = pending_nodes.back();
+        pending_nodes.pop_back();
+
+        if (is_node_visited[node_index]) {
+            throw std::runtime_error{std::format("Node {} is in the node tree more than once", node_index)};
+        }
+        is_node_visited[node_index] = true;
+
+        for (const auto child : nodes[node_index].children) {
+            if (child & wad::Node::SubSectorChild) {
+                if ((child & ~wad::Node::SubSectorChild) >= subsectors.size()) {
+                    throw std::runtime_error{
+                        std::format("Node {} uses subsector {}, which doesn't exist", node_index,
+                            child & ~wad::Node::SubSectorChild)
+                    };
+                }
+            } else if (child >= nodes.size()) {
+                throw std::runtime_error{std::format("Node {} uses node {}, which doesn't exist", node_index, child)};
+            } else {
+                pending_nodes.emplace_back(child);
+            }
+        }
+    }
+
+    return locator;
+}
+
+SectorLocator SectorLocator::from_linedefs(const wad::MapData& map_data) {
+    auto locator = SectorLocator{};
+    if (map_data.linedefs.empty()) {
+        return locator;
+    }
+
+    const auto get_side_sector = [&](const uint16_t sidedef) {
+        return sidedef == wad::LineDef::NoSidedef ? NoSector : uint32_t{map_data.sidedefs[sidedef].sector_number};
+    };
+
+    auto max_x = std::numeric_limits<int32_t>::min();
+    auto max_y = std::numeric_limits<int32_t>::min();
+    locator.grid_min_x = std::numeric_limits<int32_t>::max();
+    locator.grid_min_y = std::numeric_limits<int32_t>::max();
+    locator.lines.reserve(map_data.linedefs.size());
+    for (const auto& linedef : map_data.linedefs) {
+        const auto& start = map_data.vertexes[linedef.start_vertex];
+        const auto& end = map_data.vertexes[linedef.end_vertex];
+        locator.lines.emplace_back(
+            GridLine{
+                .start_x = start.x, .start_y = start.y, .end_x = end.x, .end_y = end.y,
+                .front_sector = get_side_sector(linedef.front_sidedef),
+                .back_sector = get_side_sector(linedef.back_sidedef),
+            }
+        );
+
+        locator.grid_min_x = std::min({locator.grid_min_x, int32_t{start.x}, int32_t{end.x}});
+        locator.grid_min_y = std::min({locator.grid_min_y, int32_t{start.y}, int32_t{end.y}});
+        max_x = std::max({max_x, int32_t{start.x}, int32_t{end.x}});
+        max_y = std::max({max_y, int32_t{start.y}, int32_t{end.y}});
+    }
+
+    locator.num_columns = (max_x - locator.grid_min_x) / GridCellSize + 1;
+    locator.num_rows = (max_y - locator.grid_min_y) / GridCellSize + 1;
+
+    // Each line goes in every cell that its bounding box touches. Count them first, so the cells can share one array
+    const auto for_each_cell = [&](const GridLine& line, auto&& visitor) {
+        const auto min_column = (std::min(line.start_x, line.end_x) - locator.grid_min_x) / GridCellSize;
+        const auto max_column = (std::max(line.start_x, line.end_x) - locator.grid_min_x) / GridCellSize;
+        const auto min_row = (std::min(line.start_y, line.end_y) - locator.grid_min_y) / GridCellSize;
+        const auto max_row = (std::max(line.start_y, line.end_y) - locator.grid_min_y) / GridCellSize;
+        for (auto row = min_row; row <= max_row; row++) {
+            for (auto column = min_column; column <= max_column; column++) {
+                visitor(static_cast<size_t>(row) * locator.num_columns + column);
+            }
+        }
+    };
+
+    locator.cell_offsets.resize(static_cast<size_t>(locator.num_columns) * locator.num_rows + 1, 0);
+    for (const auto& line : locator.lines) {
+        for_each_cell(line, [&](const size_t cell) { locator.cell_offsets[cell + 1]++; });
+    }
+    for (auto cell = size_t{1}; cell < locator.cell_offsets.size(); cell++) {
+        locator.cell_offsets[cell] += locator.cell_offsets[cell - 1];
+    }
+
+    auto next_cell_line = std::vector<uint32_t>(locator.cell_offsets.begin(), locator.cell_offsets.end() - 1);
+    locator.cell_lines.resize(locator.cell_offsets.back());
+    for (auto line_index = 0u; line_index < locator.lines.size(); line_index++) {
+        for_each_cell(locator.lines[line_index], [&](const size_t cell) {
+            locator.cell_lines[next_cell_line[cell]++] = line_index;
+        });
+    }
+
+    return locator;
+}
+
+std::optional<uint32_t> SectorLocator::find_sector(const int32_t x, const int32_t y) const {
+    if (!subsector_sectors.empty()) {
+        return find_sector_in_tree(x, y);
+    }
+
+    return find_sector_in_grid(x, y);
+}
+
+uint32_t SectorLocator::find_sector_in_tree(const int32_t x, const int32_t y) const {
+    if (nodes.empty()) {
+        return subsector_sectors[0];
+    }
+
+    auto child = static_cast<uint16_t>(nodes.size() - 1);
+    while ((child & wad::Node::SubSectorChild) == 0) {
+        const auto& node = nodes[child];
+        child = node.children[is_on_back_side(node, x, y) ? 1 : 0];
+    }
+
+    return subsector_sectors[child & ~wad::Node::SubSectorChild];
+}
+
+std::optional<uint32_t> SectorLocator::find_sector_in_grid(const int32_t x, const int32_t y) const {
+    if (num_rows == 0 || y < grid_min_y || x >= grid_min_x + num_columns * GridCellSize) {
+        return std::nullopt;
+    }
+
+    const auto row = (y - grid_min_y) / GridCellSize;
+    if (row >= num_rows) {
+        return std::nullopt;
+    }
+
+    // Walk along the row until we've found a crossing that's closer than every line in the cells we haven't looked at
+    auto closest_x = std::numeric_limits<double>::max();
+    const GridLine* closest_line = nullptr;
+    for (auto column = std::max((x - grid_min_x) / GridCellSize, 0); column < num_columns; column++) {
+        const auto cell = static_cast<size_t>(row) * num_columns + column;
+        for (auto i = cell_offsets[cell]; i < cell_offsets[cell + 1]; i++) {
+            const auto& line = lines[cell_lines[i]];
+
+            // Each vertex counts as being above the ray if it's on it, so a ray through a vertex crosses one line
+            if ((line.start_y > y) == (line.end_y > y)) {
+                continue;
+            }
+
+            const auto crossing_x = line.start_x + static_cast<double>(y - line.start_y) * (line.end_x - line.start_x) /
+                                                       (line.end_y - line.start_y);
+            if (crossing_x >= x && crossing_x < closest_x) {
+                closest_x = crossing_x;
+                closest_line = &line;
+            }
+        }
+
+        if (closest_line != nullptr && closest_x < grid_min_x + (column + 1) * GridCellSize) {
+            break;
+        }
+    }
+
+    if (closest_line == nullptr) {
+        return std::nullopt;
+    }
+
+    // The point is on the -X side of the crossing, which is the left (back) side of a line that goes up
+    const auto sector = closest_line->end_y > closest_line->start_y ? closest_line->back_sector
+                                                                    : closest_line->front_sector;
+    if (sector == NoSector) {
+        return std::nullopt;
+    }
+
+    return sector;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "map_data.hpp"
+
+/**
+ * \file sector_locator.hpp
+ *
+ * Finds which sector a point of the map is in
+ */
+
+/**
+ * \brief Finds the sector at a point, the way the game's R_PointInSubsector does
+ *
+ * With nodes, we walk down the node tree to the subsector that holds the point, which takes O(log n) steps. Maps
+ * without nodes that we can use get a grid of linedefs instead: we cast a ray from the point along +X, and the point
+ * is in the sector on the near side of the first linedef that the ray crosses. Either way, a point in a hole of a
+ * sector is in the sector that fills the hole
+ */
+class SectorLocator {
+public:
+    /**
+     * \brief Uses the map's nodes if they're valid, or the linedef grid if not
+     */
+    static SectorLocator build(const wad::MapData& map_data);
+
+    /**
+     * \return The locator, or nullopt if the map has no nodes
+     * \throws std::runtime_error if the nodes refer to things that don't exist, or if the node tree has a cycle
+     */
+    static std::optional<SectorLocator> from_nodes(const wad::MapData& map_data);
+
+    static SectorLocator from_linedefs(const wad::MapData& map_data);
+
+    /**
+     * \brief Finds the sector at a point
+     *
+     * Like in the game, the node tree gives every point a sector, even points outside the map. The linedef grid only
+     * finds sectors for points inside the map
+     *
+     * \return The index of the sector, or nullopt if the point isn't in any sector
+     */
+    std::optional<uint32_t> find_sector(int32_t x, int32_t y) const;
+
+private:
+    /**
+     * The map's nodes, if we locate points with them. The MapData must outlive the locator
+     */
+    std::span<const wad::Node> nodes;
+
+    std::vector<uint32_t> subsector_sectors;
+
+    /**
+     * A linedef in the grid, with the sectors on its sides
+     */
+    struct GridLine {
+        int32_t start_x;
+        int32_t start_y;
+        int32_t end_x;
+        int32_t end_y;
+        uint32_t front_sector;
+        uint32_t back_sector;
+    };
+
+    std::vector<GridLine> lines;
+
+    int32_t grid_min_x = 0;
+    int32_t grid_min_y = 0;
+    int32_t num_columns = 0;
+    int32_t num_rows = 0;
+
+    /**
+     * Where each cell's lines start in cell_lines, row by row. Has one more element than there are cells
+     */
+    std::vector<uint32_t> cell_offsets;
+
+    std::vector<uint32_t> cell_lines;
+
+    uint32_t find_sector_in_tree(int32_t x, int32_t y) const;
+
+    std::optional<uint32_t> find_sector_in_grid(int32_t x, int32_t y) const;
+};
@@ -0,0 +1,397 @@
+#include "subsector_polygons.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <format>
+#include <stdexcept>
+#include <string_view>
+
+/**
+ * Subsectors whose polygon has less area than this, in square map units, don't cover anything that you could see
+ */
+constexpr auto MinPolygonArea = 0.01;
+
+/**
+ * How far outside a clipping line a point can be and still count as being on it, in map units. Regular nodes round
+ * the vertexes they add to whole map units, so segs and partition lines are often a little off from each other
+ */
+constexpr auto ClipEpsilon = 0.01;
+
+constexpr auto NoSector = UINT32_MAX;
+
+template <typename ValueType>
+ValueType read_value(const std::span<const uint8_t> bytes, const size_t offset) {
+    auto value = ValueType{};
+    std::memcpy(&value, bytes.data() + offset, sizeof(ValueType));
+    return value;
+}
+
+bool has_magic(const std::span<const uint8_t> bytes, const std::string_view magic) {
+    return bytes.size() >= magic.size() && std::memcmp(bytes.data(), magic.data(), magic.size()) == 0;
+}
+
+double get_signed_area(const std::vector<glm::dvec2>& polygon) {
+    auto area = 0.0;
+    for (auto i = 0u, j = static_cast<uint32_t>(polygon.size() - 1); i < polygon.size(); j = i++) {
+        area += (polygon[j].x - polygon[i].x) * (polygon[j].y + polygon[i].y);
+    }
+
+    return area / 2.0;
+}
+
+/**
+ * Clips a convex polygon by a line, keeping the part on the line's right. The line goes from origin in direction
+ */
+std::vector<glm::dvec2> clip_to_right_of(
+    const std::vector<glm::dvec2>& polygon, const glm::dvec2& origin, const glm::dvec2& direction
+) {
+    const auto direction_length = glm::length(direction);
+    if (direction_length == 0.0) {
+        return polygon;
+    }
+
+    // Positive distances are on the left of the line
+    const auto get_distance = [&](const glm::dvec2& point) {
+        const auto offset = point - origin;
+        return (direction.x * offset.y - direction.y * offset.x) / direction_length;
+    };
+
+    auto clipped = std::vector<glm::dvec2>{};
+    clipped.reserve(polygon.size() + 1);
+    for (auto i = 0u; i < polygon.size(); i++) {
+        const auto& current = polygon[i];
+        const auto& next = polygon[(i + 1) % polygon.size()];
+        const auto current_distance = get_distance(current);
+        const auto next_distance = get_distance(next);
+
+        const auto is_current_inside = current_distance <= ClipEpsilon;
+        const auto is_next_inside = next_distance <= ClipEpsilon;
+        if (is_current_inside) {
+            clipped.emplace_back(current);
+        }
+        if (is_current_inside != is_next_inside) {
+            const auto t = std::clamp(current_distance / (current_distance - next_distance), 0.0, 1.0);
+            clipped.emplace_back(current + (next - current) * t);
+        }
+    }
+
+    return clipped;
+}
+
+uint32_t get_seg_sector(
+    const wad::MapData& map_data, const uint32_t seg_index, const uint32_t linedef_index, const uint32_t side
+) {
+    if (linedef_index >= map_data.linedefs.size()) {
+        throw std::runtime_error{
+            std::format("Seg {} uses linedef {}, but the map only has {} linedefs", seg_index, linedef_index,
+                map_data.linedefs.size())
+        };
+    }
+
+    const auto& linedef = map_data.linedefs[linedef_index];
+    const auto sidedef = side == 0 ? linedef.front_sidedef : linedef.back_sidedef;
+    if (side > 1 || sidedef == wad::LineDef::NoSidedef) {
+        throw std::runtime_error{
+            std::format("Seg {} is on side {} of linedef {}, which has no sidedef there", seg_index, side,
+                linedef_index)
+        };
+    }
+
+    return map_data.sidedefs[sidedef].sector_number;
+}
+
+std::optional<SubsectorPolygons> SubsectorPolygons::from_gl_nodes(const wad::MapData& map_data) {
+    const auto gl_vertexes = map_data.gl_vertexes;
+    const auto gl_segs = map_data.gl_segs;
+    const auto gl_subsectors = map_data.gl_subsectors;
+    if (gl_vertexes.empty() || gl_segs.empty() || gl_subsectors.empty()) {
+        return std::nullopt;
+    }
+
+    /*
+     * glBSP's formats differ in how big the vertex, seg, and subsector records are, and in which bit of a seg's vertex
+     * index means that it's a GL vertex instead of a regular one. V1 has no magic. V2 and V3 put "gNd2" in GL_VERT
+     * for their fixed-point vertexes, and V3 puts "gNd3" in GL_SEGS and GL_SSECT for its 32-bit indices. V5 puts
+     * "gNd5" in GL_VERT and nowhere else. V4 is ZDoom-only and was never used much
+     */
+    auto vertex_data_offset = size_t{0};
+    auto has_fixed_point_vertexes = false;
+    auto seg_data_offset = size_t{0};
+    auto subsector_data_offset = size_t{0};
+    auto has_wide_indices = false;
+    auto gl_vertex_flag = uint32_t{0x8000};
+
+    if (has_magic(gl_vertexes, "gNd5")) {
+        vertex_data_offset = 4;
+        has_fixed_point_vertexes = true;
+        has_wide_indices = true;
+        gl_vertex_flag = 0x80000000;
+    } else if (has_magic(gl_vertexes, "gNd2")) {
+        vertex_data_offset = 4;
+        has_fixed_point_vertexes = true;
+        if (has_magic(gl_segs, "gNd3")) {
+            seg_data_offset = 4;
+            subsector_data_offset = has_magic(gl_subsectors, "gNd3") ? 4 : 0;
+            has_wide_indices = true;
+            gl_vertex_flag = 0x40000000;
+        }
+    } else if (has_magic(gl_vertexes, "gNd")) {
+        throw std::runtime_error{"The map's GL nodes are in a version that we can't read"};
+    }
+
+    auto vertices = std::vector<glm::dvec2>{};
+    const auto vertex_size = has_fixed_point_vertexes ? size_t{8} : size_t{4};
+    const auto num_gl_vertexes = (gl_vertexes.size() - vertex_data_offset) / vertex_size;
+    vertices.reserve(map_data.vertexes.size() + num_gl_vertexes);
+    for (const auto& vertex : map_data.vertexes) {
+        vertices.emplace_back(vertex.x, vertex.y);
+    }
+    for (auto i = size_t{0}; i < num_gl_vertexes; i++) {
+        const auto offset = vertex_data_offset + i * vertex_size;
+        if (has_fixed_point_vertexes) {
+            // 16.16 fixed point
+            vertices.emplace_back(
+                read_value<int32_t>(gl_vertexes, offset) / 65536.0,
+                read_value<int32_t>(gl_vertexes, offset + 4) / 65536.0
+            );
+        } else {
+            vertices.emplace_back(
+                read_value<int16_t>(gl_vertexes, offset), read_value<int16_t>(gl_vertexes, offset + 2)
+            );
+        }
+    }
+
+    const auto get_vertex_index = [&](const uint32_t seg_index, const uint32_t vertex) {
+        const auto vertex_index = (vertex & gl_vertex_flag) != 0
+                                      ? static_cast<uint32_t>(map_data.vertexes.size()) + (vertex & ~gl_vertex_flag)
+                                      : vertex;
+        if (vertex_index >= vertices.size()) {
+            throw std::runtime_error{std::format("GL seg {} uses a vertex that doesn't exist", seg_index)};
+        }
+
+        return vertex_index;
+    };
+
+    // Segs are start vertex, end vertex, linedef, side, and partner seg
+    const auto seg_size = has_wide_indices ? size_t{16} : size_t{10};
+    const auto num_segs = (gl_segs.size() - seg_data_offset) / seg_size;
+    const auto subsector_size = has_wide_indices ? size_t{8} : size_t{4};
+    const auto num_subsectors = (gl_subsectors.size() - subsector_data_offset) / subsector_size;
+
+    auto subsector_polygons = std::vector<std::vector<glm::dvec2>>(num_subsectors);
+    auto subsector_sectors = std::vector<uint32_t>(num_subsectors, NoSector);
+    for (auto subsector_index = size_t{0}; subsector_index < num_subsectors; subsector_index++) {
+        const auto subsector_offset = subsector_data_offset + subsector_index * subsector_size;
+        const auto seg_count = has_wide_indices
+                                   ? read_value<uint32_t>(gl_subsectors, subsector_offset)
+                                   : read_value<uint16_t>(gl_subsectors, subsector_offset);
+        const auto first_seg = has_wide_indices
+                                   ? read_value<uint32_t>(gl_subsectors, subsector_offset + 4)
+                                   : read_value<uint16_t>(gl_subsectors, subsector_offset + 2);
+        if (static_cast<size_t>(first_seg) + seg_count > num_segs) {
+            throw std::runtime_error{std::format("GL subsector {} uses segs that don't exist", subsector_index)};
+        }
+
+        auto& polygon = subsector_polygons[subsector_index];
+        polygon.reserve(seg_count);
+        auto previous_end_vertex = uint32_t{0};
+        for (auto seg_index = first_seg; seg_index < first_seg + seg_count; seg_index++) {
+            const auto seg_offset = seg_data_offset + seg_index * seg_size;
+            const auto start_vertex = get_vertex_index(
+                seg_index,
+                has_wide_indices ? read_value<uint32_t>(gl_segs, seg_offset) : read_value<uint16_t>(gl_segs, seg_offset)
+            );
+            const auto end_vertex = get_vertex_index(
+                seg_index,
+                has_wide_indices
+                    ? read_value<uint32_t>(gl_segs, seg_offset + 4)
+                    : read_value<uint16_t>(gl_segs, seg_offset + 2)
+            );
+            const auto linedef_offset = seg_offset + (has_wide_indices ? 8 : 4);
+            const auto linedef = read_value<uint16_t>(gl_segs, linedef_offset);
+            const auto side = read_value<uint16_t>(gl_segs, linedef_offset + 2);
+
+            if (seg_index != first_seg && start_vertex != previous_end_vertex) {
+                throw std::runtime_error{std::format("GL subsector {} isn't closed", subsector_index)};
+            }
+            previous_end_vertex = end_vertex;
+
+            // Minisegs run along partition lines and have no linedef
+            if (linedef != 0xFFFF && subsector_sectors[subsector_index] == NoSector) {
+                subsector_sectors[subsector_index] = get_seg_sector(map_data, seg_index, linedef, side);
+            }
+
+            polygon.emplace_back(vertices[start_vertex]);
+        }
+    }
+
+    return group_by_sector(subsector_polygons, subsector_sectors, map_data.sectors.size());
+}
+
+std::optional<SubsectorPolygons> SubsectorPolygons::from_nodes(const wad::MapData& map_data) {
+    const auto segs = map_data.segs;
+    const auto subsectors = map_data.subsectors;
+    const auto nodes = map_data.nodes;
+    if (segs.empty() || subsectors.empty() || map_data.vertexes.empty() || (nodes.empty() && subsectors.size() > 1)) {
+        return std::nullopt;
+    }
+
+    for (auto i = 0u; i < segs.size(); i++) {
+        if (segs[i].start_vertex >= map_data.vertexes.size() || segs[i].end_vertex >= map_data.vertexes.size()) {
+            throw std::runtime_error{std::format("Seg {} uses a vertex that doesn't exist", i)};
+        }
+    }
+
+    const auto to_point = [&](const uint16_t vertex_index) {
+        const auto& vertex = map_data.vertexes[vertex_index];
+        return glm::dvec2{vertex.x, vertex.y};
+    };
+
+    // Nothing in the map is outside the bounding box of its vertexes, so that's where the root node's area starts
+    auto min = to_point(0);
+    auto max = min;
+    for (const auto& vertex : map_data.vertexes) {
+        min = glm::dvec2{std::min<double>(min.x, vertex.x), std::min<double>(min.y, vertex.y)};
+        max = glm::dvec2{std::max<double>(max.x, vertex.x), std::max<double>(max.y, vertex.y)};
+    }
+
+    auto subsector_polygons = std::vector<std::vector<glm::dvec2>>(subsectors.size());
+    auto subsector_sectors = std::vector<uint32_t>(subsectors.size(), NoSector);
+
+    const auto clip_subsector = [&](const uint32_t subsector_index, std::vector<glm::dvec2> polygon) {
+        if (subsector_index >= subsectors.size()) {
+            throw std::runtime_error{std::format("A node uses subsector {}, which doesn't exist", subsector_index)};
+        }
+
+        const auto& subsector = subsectors[subsector_index];
+        if (static_cast<size_t>(subsector.first_seg) + subsector.seg_count > segs.size()) {
+            throw std::runtime_error{std::format("Subsector {} uses segs that don't exist", subsector_index)};
+        }
+
+        // Segs have their sector on their right, and a subsector is convex, so its area is on the right of all of them
+        for (auto seg_index = subsector.first_seg; seg_index < subsector.first_seg + subsector.seg_count; seg_index++) {
+            const auto& seg = segs[seg_index];
+            if (subsector_sectors[subsector_index] == NoSector) {
+                subsector_sectors[subsector_index] = get_seg_sector(
+                    map_data, seg_index, seg.linedef, static_cast<uint16_t>(seg.direction)
+                );
+            }
+
+            const auto start = to_point(seg.start_vertex);
+            polygon = clip_to_right_of(polygon, start, to_point(seg.end_vertex) - start);
+        }
+
+        subsector_polygons[subsector_index] = std::move(polygon);
+    };
+
+    const auto bounding_box = std::vector{min, glm::dvec2{max.x, min.y}, max, glm::dvec2{min.x, max.y}};
+    if (nodes.empty()) {
+        clip_subsector(0, bounding_box);
+        return group_by_sector(subsector_polygons, subsector_sectors, map_data.sectors.size());
+    }
+
+    // Each child of a node gets the part of the node's area on its side of the partition line
+    struct PendingChild {
+        uint16_t child;
+        std::vector<glm::dvec2> polygon;
+    };
+
+    auto is_node_visited = std::vector<bool>(nodes.size(), false);
+    auto pending_children = std::vector<PendingChild>{};
+    pending_children.emplace_back(PendingChild{static_cast<uint16_t>(nodes.size() - 1), bounding_box});
+    while (!pending_children.empty()) {
+        auto [child, polygon] = std::move(pending_children.back());
+        pending_children.pop_back();
+
+        if (child & wad::Node::SubSectorChild) {
+            clip_subsector(child & ~wad::Node::SubSectorChild, std::move(polygon));
+            continue;
+        }
+
+        if (child >= nodes.size()) {
+            throw std::runtime_error{std::format("A node uses node {}, which doesn't exist", child)};
+        }
+        if (is_node_visited[child]) {
+            throw std::runtime_error{std::format("Node {} is in the node tree more than once", child)};
+        }
+        is_node_visited[child] = true;
+
+        const auto& node = nodes[child];
+        const auto origin = glm::dvec2{node.x, node.y};
+        const auto direction = glm::dvec2{node.dx, node.dy};
+        pending_children.emplace_back(PendingChild{node.children[1], clip_to_right_of(polygon, origin, -direction)});
+        pending_children.emplace_back(PendingChild{node.children[0], clip_to_right_of(polygon, origin, direction)});
+    }
+
+    return group_by_sector(subsector_polygons, subsector_sectors, map_data.sectors.size());
+}
+
+uint32_t SubsectorPolygons::get_num_polygons(const uint32_t sector) const {
+    return sector_first_polygons[sector + 1] - sector_first_polygons[sector];
+}
+
+std::span<const glm::vec2> SubsectorPolygons::get_polygon(const uint32_t sector, const uint32_t polygon) const {
+    const auto polygon_index = sector_first_polygons[sector] + polygon;
+    const auto start = polygon_offsets[polygon_index];
+    return std::span{vertices}.subspan(start, polygon_offsets[polygon_index + 1] - start);
+}
+
+SubsectorPolygons SubsectorPolygons::group_by_sector(
+    const std::span<const std::vector<glm::dvec2>> subsector_polygons,
+    const std::span<const uint32_t> subsector_sectors, const size_t num_sectors
+) {
+    auto polygons = SubsectorPolygons{};
+
+    auto is_visible = std::vector<bool>(subsector_polygons.size(), false);
+    auto sector_counts = std::vector<uint32_t>(num_sectors + 1, 0);
+    auto num_vertices = size_t{0};
+    for (auto i = 0u; i < subsector_polygons.size(); i++) {
+        const auto sector = subsector_sectors[i];
+        if (sector == NoSector || sector >= num_sectors || subsector_polygons[i].size() < 3 ||
+            std::abs(get_signed_area(subsector_polygons[i])) < MinPolygonArea) {
+            continue;
+        }
+
+        is_visible[i] = true;
+        sector_counts[sector + 1]++;
+        num_vertices += subsector_polygons[i].size();
+    }
+
+    // Counting sort, so each sector's polygons stay in subsector order
+    polygons.sector_first_polygons.resize(num_sectors + 1, 0);
+    for (auto i = 0u; i < num_sectors; i++) {
+        polygons.sector_first_polygons[i + 1] = polygons.sector_first_polygons[i] + sector_counts[i + 1];
+    }
+
+    auto subsectors_by_sector = std::vector<uint32_t>(polygons.sector_first_polygons.back());
+    {
+        auto insert_positions = polygons.sector_first_polygons;
+        for (auto i = 0u; i < subsector_polygons.size(); i++) {
+            if (is_visible[i]) {
+                subsectors_by_sector[insert_positions[subsector_sectors[i]]++] = i;
+            }
+        }
+    }
+
+    polygons.vertices.reserve(num_vertices);
+    polygons.polygon_offsets.reserve(subsectors_by_sector.size() + 1);
+    for (const auto subsector : subsectors_by_sector) {
+        const auto& polygon = subsector_polygons[subsector];
+        polygons.polygon_offsets.emplace_back(static_cast<uint32_t>(polygons.vertices.size()));
+
+        // Counter-clockwise, like earcut's output, so both ways of making flats wind their triangles the same
+        if (get_signed_area(polygon) > 0) {
+            for (const auto& vertex : polygon) {
+                polygons.vertices.emplace_back(vertex);
+            }
+        } else {
+            for (auto itr = polygon.rbegin(); itr != polygon.rend(); ++itr) {
+                polygons.vertices.emplace_back(*itr);
+            }
+        }
+    }
+    polygons.polygon_offsets.emplace_back(static_cast<uint32_t>(polygons.vertices.size()));
+
+    return polygons;
+}
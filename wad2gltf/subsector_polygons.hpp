@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "map_data.hpp"
+
+/**
+ * \file subsector_polygons.hpp
+ *
+ * Convex polygons from a map's BSP, for building floors and ceilings without triangulating whole sectors
+ */
+
+/**
+ * \brief Gets the sector on one side of a seg's linedef
+ *
+ * \param side 0 for the linedef's front side, 1 for its back side
+ * \throws std::runtime_error if the linedef doesn't exist, or has no sidedef on that side
+ */
+uint32_t get_seg_sector(const wad::MapData& map_data, uint32_t seg_index, uint32_t linedef_index, uint32_t side);
+
+/**
+ * \brief The convex area of each subsector, grouped by sector
+ *
+ * Each polygon can be fan-triangulated as-is. Polygons are counter-clockwise, like earcut's triangles, and within a
+ * sector they're in subsector order
+ */
+class SubsectorPolygons {
+public:
+    /**
+     * \brief Gets the polygons from the map's GL nodes
+     *
+     * GL subsectors have minisegs along the partition lines, so each subsector's segs already form a closed convex
+     * polygon, and GL nodes keep the exact positions of the vertexes they add. We read glBSP's V1, V2, V3, and V5
+     * formats. The GL_NODES lump isn't needed
+     *
+     * \return The polygons, or nullopt if the map has no GL nodes
+     * \throws std::runtime_error if the GL nodes are in a format that we don't read, refer to things that don't exist,
+     * or have a subsector that isn't closed
+     */
+    static std::optional<SubsectorPolygons> from_gl_nodes(const wad::MapData& map_data);
+
+    /**
+     * \brief Gets the polygons from the map's regular nodes
+     *
+     * Regular subsectors only have segs along linedefs. We find their areas by walking down the node tree, clipping
+     * the map's bounding box by each partition line on the way, then clipping it by the subsector's segs
+     *
+     * \return The polygons, or nullopt if the map has no nodes
+     * \throws std::runtime_error if the nodes refer to things that don't exist, or if the node tree has a cycle
+     */
+    static std::optional<SubsectorPolygons> from_nodes(const wad::MapData& map_data);
+
+    uint32_t get_num_polygons(uint32_t sector) const;
+
+    std::span<const glm::vec2> get_polygon(uint32_t sector, uint32_t polygon) const;
+
+private:
+    std::vector<glm::vec2> vertices;
+
+    /**
+     * Where each polygon starts in vertices. Has one more element than there are polygons
+     */
+    std::vector<uint32_t> polygon_offsets;
+
+    /**
+     * Index of each sector's first polygon in polygon_offsets. Has one more element than there are sectors
+     */
+    std::vector<uint32_t> sector_first_polygons;
+
+    /**
+     * Sorts subsector polygons by sector and drops the ones that are too small to see
+     */
+    static SubsectorPolygons group_by_sector(
+        std::span<const std::vector<glm::dvec2>> subsector_polygons, std::span<const uint32_t> subsector_sectors,
+        size_t num_sectors
+    );
+};
@@ -7,17 +7,19 @@
 #include "glm/glm.hpp"
 
 void export_texture(
-    const DecodedTexture& texture, const std::filesystem::path& output_folder, const wad::WAD& wad,
+    const DecodedTexture& texture, const std::filesystem::path& output_folder, const wad::ResourceSet& resources,
     const MapExtractionOptions& options
 ) {
     // Apply the palette and colormap
     // We export the textures assuming the default palette at full brightness
 
-    const auto palettes_itr = wad.find_lump("PLAYPAL");
-    const auto palettes = wad.get_lump_data<std::array<glm::u8vec3, 256>>(*palettes_itr);
+    const auto lump_pins = wad::LumpPinScope{};
 
-    const auto colormaps_itr = wad.find_lump("COLORMAP");
-    const auto colormaps = wad.get_lump_data<std::array<uint8_t, 256>>(*colormaps_itr);
+    const auto palettes_itr = resources.find_lump("PLAYPAL");
+    const auto palettes = resources.get_lump_data<std::array<glm::u8vec3, 256>>(*palettes_itr);
+
+    const auto colormaps_itr = resources.find_lump("COLORMAP");
+    const auto colormaps = resources.get_lump_data<std::array<uint8_t, 256>>(*colormaps_itr);
 
     auto pixels = std::vector<glm::u8vec4>{};
     pixels.resize(texture.pixels.size());
@@ -6,6 +6,6 @@
 #include "texture_reader.hpp"
 
 void export_texture(
-    const DecodedTexture& texture, const std::filesystem::path& output_folder, const wad::WAD& wad,
+    const DecodedTexture& texture, const std::filesystem::path& output_folder, const wad::ResourceSet& resources,
     const MapExtractionOptions& options
 );
@@ -2,10 +2,11 @@
 
 #include <iostream>
 #include <map>
+#include <mutex>
 #include <stb_image_write.h>
 #include <unordered_map>
 
-#include "wad.hpp"
+#include "resource_set.hpp"
 #include "glm/detail/qualifier.hpp"
 
 struct DecodedPatch {
@@ -14,21 +15,62 @@ struct DecodedPatch {
     std::vector<uint8_t> transparency;
 };
 
+/**
+ * Decoded patches and textures are shared by every map we convert, so we only decode each of them once per process.
+ * Entries are never removed, so references to them stay valid
+ */
+static std::mutex cache_mutex;
 static std::unordered_map<wad::Name, DecodedPatch> patch_cache;
+static std::unordered_map<wad::Name, DecodedTexture> texture_cache;
+static std::unordered_map<wad::Name, DecodedTexture> flat_cache;
+static std::unordered_map<wad::Name, DecodedTexture> sprite_cache;
+
+/**
+ * Gets a decoded texture from one of the texture caches, or decodes it and adds it to the cache
+ *
+ * Decoding happens outside the lock. If two threads decode the same texture at once, the first one to finish wins
+ */
+template <typename DecoderType>
+DecodedTexture get_cached_texture(
+    std::unordered_map<wad::Name, DecodedTexture>& cache, const wad::Name& name, DecoderType&& decode
+) {
+    {
+        auto lock = std::lock_guard{cache_mutex};
+        if (const auto itr = cache.find(name); itr != cache.end()) {
+            return itr->second;
+        }
+    }
 
-const DecodedPatch& get_patch(const wad::Name& patch_name, const wad::WAD& wad) {
-    const auto patch_itr = wad.find_lump(patch_name);
-    const auto* patch_ptr = wad.raw_data.data() + patch_itr->filepos;
-    const auto* patch_header = reinterpret_cast<const wad::PatchHeader*>(patch_ptr);
-    const auto* column_offsets = &patch_header->column_offsets_start;
+    auto texture = DecodedTexture{};
+    {
+        // Keep every lump the decoder reads in memory until it's done
+        const auto lump_pins = wad::LumpPinScope{};
+        texture = decode();
+    }
 
-    if (const auto itr = patch_cache.find(patch_name); itr != patch_cache.end()) {
-        return itr->second;
+    auto lock = std::lock_guard{cache_mutex};
+    return cache.emplace(name, std::move(texture)).first->second;
+}
+
+const DecodedPatch& get_patch(const wad::Name& patch_name, const wad::ResourceSet& resources) {
+    {
+        auto lock = std::lock_guard{cache_mutex};
+        if (const auto itr = patch_cache.find(patch_name); itr != patch_cache.end()) {
+            return itr->second;
+        }
     }
 
-    auto patch = DecodedPatch{.header = *patch_header};
-    patch.pixel_data.resize(patch_header->width * patch_header->height);
-    patch.transparency.resize(patch.pixel_data.size(), 0);
+    const auto lump_pins = wad::LumpPinScope{};
+    const auto patch_itr = resources.find_lump(patch_name);
+    const auto* patch_ptr = resources.get_lump_data<uint8_t>(*patch_itr).data();
+    const auto* patch_header = reinterpret_cast<const wad::PatchHeader*>(patch_ptr);
+    const auto* column_offsets = &patch_header->column_offsets_start;
+
+    auto patch = DecodedPatch{
+        .header = *patch_header,
+        .pixel_data = std::vector<uint8_t>(patch_header->width * patch_header->height),
+        .transparency = std::vector<uint8_t>(patch_header->width * patch_header->height, 0),
+    };
 
     for (auto i = 0; i < patch_header->width; i++) {
         auto* read_ptr = patch_ptr + column_offsets[i];
@@ -62,21 +104,38 @@ const DecodedPatch& get_patch(const wad::Name& patch_name, const wad::WAD& wad)
         } while (*read_ptr != 255);
     }
 
-    const auto filename = std::format("textures/patches/{}.png", patch_name);
-    stbi_write_png(filename.c_str(), patch_header->width, patch_header->height, 1, patch.pixel_data.data(), 0);
+    const DecodedPatch* cached_patch = nullptr;
+    auto is_inserted = false;
+    {
+        auto lock = std::lock_guard{cache_mutex};
+        const auto [itr, inserted] = patch_cache.emplace(patch_name, std::move(patch));
+        cached_patch = &itr->second;
+        is_inserted = inserted;
+    }
+
+    // Only the thread that added the patch to the cache writes it out. Entries never change once they're added, so
+    // the PNG is encoded outside the lock and doesn't hold up the other workers
+    if (is_inserted) {
+        const auto filename = std::format("textures/patches/{}.png", patch_name);
+        stbi_write_png(
+            filename.c_str(), cached_patch->header.width, cached_patch->header.height, 1,
+            cached_patch->pixel_data.data(), 0
+        );
+    }
 
-    const auto itr = patch_cache.emplace(
-        patch_name, std::move(patch)
-    );
-    return itr.first->second;
+    return *cached_patch;
 }
 
+DecodedTexture decode_sprite(const wad::Name& sprite_name, const wad::ResourceSet& resources);
+
+DecodedTexture decode_texture(const wad::Name& texture_name, const wad::ResourceSet& resources);
+
 const wad::MapTexture* find_texture_in_texture_group(
-    const wad::Name& texture_name, const std::string_view group_name, const wad::WAD& wad
+    const wad::Name& texture_name, const std::string_view group_name, const wad::ResourceSet& resources
 ) {
-    const auto texture1_itr = wad.find_lump("TEXTURE1");
+    const auto texture1_itr = resources.find_lump("TEXTURE1");
 
-    const auto* texture1_ptr = wad.raw_data.data() + texture1_itr->filepos;
+    const auto* texture1_ptr = resources.get_lump_data<uint8_t>(*texture1_itr).data();
     const auto* texture1 = reinterpret_cast<const wad::Texture1*>(texture1_ptr);
 
     const auto* map_textures_offsets = &texture1->offset_array_start;
@@ -93,16 +152,22 @@ const wad::MapTexture* find_texture_in_texture_group(
     return nullptr;
 }
 
-DecodedTexture load_flat_from_wad(const wad::Name& flat_name, const wad::WAD& wad) {
-    const auto itr = wad.find_lump(flat_name);
-    const auto pixels = wad.get_lump_data<uint8_t>(*itr);
-    return DecodedTexture{
-        .name = flat_name, .size = {64, 64}, .pixels = std::vector(pixels.begin(), pixels.end()),
-        .alpha_mask = std::vector<uint8_t>(64 * 64, 0xFF)
-    };
+DecodedTexture load_flat_from_wad(const wad::Name& flat_name, const wad::ResourceSet& resources) {
+    return get_cached_texture(flat_cache, flat_name, [&]() {
+        const auto itr = resources.find_lump(flat_name);
+        const auto pixels = resources.get_lump_data<uint8_t>(*itr);
+        return DecodedTexture{
+            .name = flat_name, .size = {64, 64}, .pixels = std::vector(pixels.begin(), pixels.end()),
+            .alpha_mask = std::vector<uint8_t>(64 * 64, 0xFF)
+        };
+    });
+}
+
+DecodedTexture load_sprite_from_wad(const wad::Name& sprite_name, const wad::ResourceSet& resources) {
+    return get_cached_texture(sprite_cache, sprite_name, [&]() { return decode_sprite(sprite_name, resources); });
 }
 
-DecodedTexture load_sprite_from_wad(const wad::Name& sprite_name, const wad::WAD& wad) {
+DecodedTexture decode_sprite(const wad::Name& sprite_name, const wad::ResourceSet& resources) {
     // V0: Find the A0 sprite, load it
     // V1: Find all the sprites in a sequence, load them into one image
     // V2: Find all sprites in a sequence, and the sprites for different angles, and export those
@@ -113,11 +178,11 @@ DecodedTexture load_sprite_from_wad(const wad::Name& sprite_name, const wad::WAD
     auto full_sprite_name = wad::Name{};
     try {
         full_sprite_name = wad::Name::from_string(std::format("{}A0", sprite_name));
-        patch = get_patch(full_sprite_name, wad);
+        patch = get_patch(full_sprite_name, resources);
     } catch(const std::exception& e) {
         // Possibly no A0 - true A1?
         full_sprite_name = wad::Name::from_string(std::format("{}A1", sprite_name));
-        patch = get_patch(full_sprite_name, wad);
+        patch = get_patch(full_sprite_name, resources);
 
         // If this throws, we need a better interface for searching for sprites and probably fewer exceptions
     }
@@ -134,10 +199,14 @@ bool DecodedTexture::has_transparent_pixels() const {
     return std::find(alpha_mask.begin(), alpha_mask.end(), 0x00) != alpha_mask.end();
 }
 
-DecodedTexture load_texture_from_wad(const wad::Name& texture_name, const wad::WAD& wad) {
-    const auto* map_texture = find_texture_in_texture_group(texture_name, "TEXTURE1", wad);
+DecodedTexture load_texture_from_wad(const wad::Name& texture_name, const wad::ResourceSet& resources) {
+    return get_cached_texture(texture_cache, texture_name, [&]() { return decode_texture(texture_name, resources); });
+}
+
+DecodedTexture decode_texture(const wad::Name& texture_name, const wad::ResourceSet& resources) {
+    const auto* map_texture = find_texture_in_texture_group(texture_name, "TEXTURE1", resources);
     if (map_texture == nullptr) {
-        map_texture = find_texture_in_texture_group(texture_name, "TEXTURE2", wad);
+        map_texture = find_texture_in_texture_group(texture_name, "TEXTURE2", resources);
     }
 
     if (map_texture == nullptr) {
@@ -147,8 +216,8 @@ DecodedTexture load_texture_from_wad(const wad::Name& texture_name, const wad::W
     auto pixels = std::vector<uint8_t>(map_texture->width * map_texture->height);
     auto transparency = std::vector<uint8_t>(pixels.size());
 
-    const auto patch_names_itr = wad.find_lump("PNAMES");
-    auto* patch_names_ptr = wad.raw_data.data() + patch_names_itr->filepos;
+    const auto patch_names_itr = resources.find_lump("PNAMES");
+    auto* patch_names_ptr = resources.get_lump_data<uint8_t>(*patch_names_itr).data();
     const auto num_patches = *reinterpret_cast<const uint32_t*>(patch_names_ptr);
     patch_names_ptr += sizeof(uint32_t);
 
@@ -159,7 +228,7 @@ DecodedTexture load_texture_from_wad(const wad::Name& texture_name, const wad::W
         const auto& map_patch = patches[patch_index];
         const auto& patch_name = patch_names[map_patch.patch];
 
-        const auto patch = get_patch(patch_name, wad);
+        const auto& patch = get_patch(patch_name, resources);
 
         // Copy patch data to the map texture
         for (auto patch_y = 0; patch_y < patch.header.height; patch_y++) {
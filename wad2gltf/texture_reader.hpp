@@ -2,7 +2,7 @@
 
 #include <glm/glm.hpp>
 
-#include "wad.hpp"
+#include "resource_set.hpp"
 
 struct DecodedTexture {
     wad::Name name;
@@ -16,23 +16,26 @@ struct DecodedTexture {
 /**
  * Loads a specific texture from a WAD file
  *
- * This function may or may not have a static texture cache. Beware of threading!
+ * Decoded textures are kept in a static cache, so each texture is only decoded once per process. This function is
+ * thread-safe
  *
  * \param texture_name Name of the texture to load
- * \param wad The WAD file to load the texture from
+ * \param resources The WADs to load the texture from
  * \return The loaded texture, without the palette applied
  * \throws std::runtime_error if there's a runtime error
  */
-DecodedTexture load_texture_from_wad(const wad::Name& texture_name, const wad::WAD& wad);
+DecodedTexture load_texture_from_wad(const wad::Name& texture_name, const wad::ResourceSet& resources);
 
 /**
  * \brief Loads a floor or ceiling flat from the WAD file
  *
+ * Like textures, decoded flats are cached and this function is thread-safe
+ *
  * \param flat_name Name of the flat to load
- * \param wad WAD data to load the flat from
+ * \param resources WADs to load the flat from
  * \return The loaded flat, without the palette applied
  */
-DecodedTexture load_flat_from_wad(const wad::Name& flat_name, const wad::WAD& wad);
+DecodedTexture load_flat_from_wad(const wad::Name& flat_name, const wad::ResourceSet& resources);
 
 /**
  * \brief Loads a sprite from the WAD file
@@ -41,8 +44,10 @@ DecodedTexture load_flat_from_wad(const wad::Name& flat_name, const wad::WAD& wa
  * response to gameplay events, or different sprites for different viewing angles. Right now this function just loads
  * the base sprite, but eventually it'll load the whole spritesheet
  *
+ * Like textures, decoded sprites are cached and this function is thread-safe
+ *
  * \param sprite_name Base name of the sprite to load
- * \param wad WAD data that contains the sprite
+ * \param resources WADs that contain the sprite
  * \return The sprite, without the palette applied
  */
-DecodedTexture load_sprite_from_wad(const wad::Name& sprite_name, const wad::WAD& wad);
+DecodedTexture load_sprite_from_wad(const wad::Name& sprite_name, const wad::ResourceSet& resources);
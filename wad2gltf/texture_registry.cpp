@@ -0,0 +1,62 @@
+#include "texture_registry.hpp"
+
+#include <stdexcept>
+
+TextureRegistry::TextureRegistry(const wad::ResourceSet& resources) : resources{resources} {}
+
+uint32_t TextureRegistry::intern_texture(const wad::Name& texture_name) {
+    if (!texture_name.is_valid()) {
+        throw std::runtime_error{"Texture name is not valid"};
+    }
+
+    return intern(texture_name, [&]() { return load_texture_from_wad(texture_name, resources); });
+}
+
+uint32_t TextureRegistry::intern_flat(const wad::Name& flat_name) {
+    if (!flat_name.is_valid()) {
+        throw std::runtime_error{"Texture name is not valid"};
+    }
+    if (flat_name.is_none()) {
+        throw std::runtime_error{"Sector floor/ceiling name cannot be '-'."};
+    }
+
+    return intern(flat_name, [&]() { return load_flat_from_wad(flat_name, resources); });
+}
+
+const DecodedTexture& TextureRegistry::get_texture(const uint32_t index) const {
+    auto lock = std::lock_guard{mutex};
+    return textures[index];
+}
+
+std::vector<DecodedTexture> TextureRegistry::take_textures(const std::span<const uint32_t> order) {
+    auto lock = std::lock_guard{mutex};
+
+    auto ordered_textures = std::vector<DecodedTexture>{};
+    ordered_textures.reserve(order.size());
+    for (const auto index : order) {
+        ordered_textures.emplace_back(std::move(textures[index]));
+    }
+
+    return ordered_textures;
+}
+
+template <typename LoaderType>
+uint32_t TextureRegistry::intern(const wad::Name& name, LoaderType&& load) {
+    {
+        auto lock = std::lock_guard{mutex};
+        if (const auto itr = indices.find(name); itr != indices.end()) {
+            return itr->second;
+        }
+    }
+
+    // Load outside the lock, so that tasks that want textures we already have don't wait on the decode
+    auto texture = load();
+
+    auto lock = std::lock_guard{mutex};
+    const auto [itr, inserted] = indices.try_emplace(name, static_cast<uint32_t>(textures.size()));
+    if (inserted) {
+        textures.emplace_back(std::move(texture));
+    }
+
+    return itr->second;
+}
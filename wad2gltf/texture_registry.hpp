@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include "resource_set.hpp"
+#include "texture_reader.hpp"
+
+/**
+ * \brief Thread-safe table of the textures and flats that a map uses
+ *
+ * Geometry tasks that run in parallel intern textures by name, and get back an index that stays the same for the rest
+ * of the map's conversion. Which index a texture gets depends on which task asks for it first, so once all the tasks
+ * are done the map builder renumbers the textures in the order that a single-threaded run would have used them
+ */
+class TextureRegistry {
+public:
+    explicit TextureRegistry(const wad::ResourceSet& resources);
+
+    /**
+     * \brief Finds or loads a wall texture
+     *
+     * \throws std::runtime_error if the name isn't valid, or the texture can't be loaded
+     */
+    uint32_t intern_texture(const wad::Name& texture_name);
+
+    /**
+     * \brief Finds or loads a floor or ceiling flat
+     *
+     * \throws std::runtime_error if the name isn't valid or is "-", or the flat can't be loaded
+     */
+    uint32_t intern_flat(const wad::Name& flat_name);
+
+    /**
+     * Gets an interned texture. The reference stays valid for as long as the registry does
+     */
+    const DecodedTexture& get_texture(uint32_t index) const;
+
+    /**
+     * \brief Moves the textures out of the registry
+     *
+     * \param order The index of each texture to take, in the order they should be returned
+     */
+    std::vector<DecodedTexture> take_textures(std::span<const uint32_t> order);
+
+private:
+    const wad::ResourceSet& resources;
+
+    mutable std::mutex mutex;
+
+    std::unordered_map<wad::Name, uint32_t> indices;
+
+    /**
+     * Deque, so that references to textures stay valid while other threads add more
+     */
+    std::deque<DecodedTexture> textures;
+
+    template <typename LoaderType>
+    uint32_t intern(const wad::Name& name, LoaderType&& load);
+};
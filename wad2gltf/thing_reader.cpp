@@ -2,9 +2,11 @@
 
 #include <format>
 #include <iostream>
+#include <unordered_map>
 #include <stb_image.h>
 
 #include "map_reader.hpp"
+#include "sector_locator.hpp"
 #include "glm/ext/quaternion_trigonometric.hpp"
 
 /**
@@ -36,7 +38,8 @@ static inline std::vector all_things = {
     },
     ThingDef{
         .id = 72, .radius = 16, .height = 72, .sprite = {"KEEN"}, .sequence = {"A+"},
-        .class_flags = ThingFlags::Monster | ThingFlags::Obstacle | ThingFlags::Shootable | ThingFlags::HangsFromCeiling
+        .class_flags = ThingFlags::Monster | ThingFlags::Obstacle | ThingFlags::Shootable |
+                       ThingFlags::HangsFromCeiling | ThingFlags::SpawnsOnCeiling
     },
     ThingDef{
         .id = 16, .radius = 40, .height = 110, .sprite = {"CYBR"}, .sequence = {"AB+"},
@@ -287,48 +290,48 @@ static inline std::vector all_things = {
         .class_flags = ThingFlags::Obstacle
     },
     ThingDef{
-        .id = 53, .radius = 16, .height = 16, .sprite = {"GOR5"}, .sequence = {"A"},
-        .class_flags = ThingFlags::Obstacle | ThingFlags::HangsFromCeiling
+        .id = 53, .radius = 16, .height = 52, .sprite = {"GOR5"}, .sequence = {"A"},
+        .class_flags = ThingFlags::Obstacle | ThingFlags::HangsFromCeiling | ThingFlags::SpawnsOnCeiling
     },
     ThingDef{
-        .id = 52, .radius = 16, .height = 16, .sprite = {"GOR4"}, .sequence = {"A"},
-        .class_flags = ThingFlags::Obstacle | ThingFlags::HangsFromCeiling
+        .id = 52, .radius = 16, .height = 68, .sprite = {"GOR4"}, .sequence = {"A"},
+        .class_flags = ThingFlags::Obstacle | ThingFlags::HangsFromCeiling | ThingFlags::SpawnsOnCeiling
     },
     ThingDef{
-        .id = 78, .radius = 16, .height = 16, .sprite = {"HDB6"}, .sequence = {"A"},
-        .class_flags = ThingFlags::Obstacle | ThingFlags::HangsFromCeiling
+        .id = 78, .radius = 16, .height = 64, .sprite = {"HDB6"}, .sequence = {"A"},
+        .class_flags = ThingFlags::Obstacle | ThingFlags::HangsFromCeiling | ThingFlags::SpawnsOnCeiling
     },
     ThingDef{
-        .id = 75, .radius = 16, .height = 16, .sprite = {"HDB3"}, .sequence = {"A"},
-        .class_flags = ThingFlags::Obstacle | ThingFlags::HangsFromCeiling
+        .id = 75, .radius = 16, .height = 64, .sprite = {"HDB3"}, .sequence = {"A"},
+        .class_flags = ThingFlags::Obstacle | ThingFlags::HangsFromCeiling | ThingFlags::SpawnsOnCeiling
     },
     ThingDef{
-        .id = 77, .radius = 16, .height = 16, .sprite = {"HDB5"}, .sequence = {"A"},
-        .class_flags = ThingFlags::Obstacle | ThingFlags::HangsFromCeiling
+        .id = 77, .radius = 16, .height = 64, .sprite = {"HDB5"}, .sequence = {"A"},
+        .class_flags = ThingFlags::Obstacle | ThingFlags::HangsFromCeiling | ThingFlags::SpawnsOnCeiling
     },
     ThingDef{
-        .id = 76, .radius = 16, .height = 16, .sprite = {"HDB4"}, .sequence = {"A"},
-        .class_flags = ThingFlags::Obstacle | ThingFlags::HangsFromCeiling
+        .id = 76, .radius = 16, .height = 64, .sprite = {"HDB4"}, .sequence = {"A"},
+        .class_flags = ThingFlags::Obstacle | ThingFlags::HangsFromCeiling | ThingFlags::SpawnsOnCeiling
     },
     ThingDef{
-        .id = 50, .radius = 16, .height = 16, .sprite = {"GOR2"}, .sequence = {"A"},
-        .class_flags = ThingFlags::Obstacle | ThingFlags::HangsFromCeiling
+        .id = 50, .radius = 16, .height = 84, .sprite = {"GOR2"}, .sequence = {"A"},
+        .class_flags = ThingFlags::Obstacle | ThingFlags::HangsFromCeiling | ThingFlags::SpawnsOnCeiling
     },
     ThingDef{
-        .id = 74, .radius = 16, .height = 16, .sprite = {"HDB2"}, .sequence = {"A"},
-        .class_flags = ThingFlags::Obstacle | ThingFlags::HangsFromCeiling
+        .id = 74, .radius = 16, .height = 88, .sprite = {"HDB2"}, .sequence = {"A"},
+        .class_flags = ThingFlags::Obstacle | ThingFlags::HangsFromCeiling | ThingFlags::SpawnsOnCeiling
     },
     ThingDef{
-        .id = 73, .radius = 16, .height = 16, .sprite = {"HDB1"}, .sequence = {"A"},
-        .class_flags = ThingFlags::Obstacle | ThingFlags::HangsFromCeiling
+        .id = 73, .radius = 16, .height = 88, .sprite = {"HDB1"}, .sequence = {"A"},
+        .class_flags = ThingFlags::Obstacle | ThingFlags::HangsFromCeiling | ThingFlags::SpawnsOnCeiling
     },
     ThingDef{
-        .id = 51, .radius = 16, .height = 16, .sprite = {"GOR3"}, .sequence = {"A"},
-        .class_flags = ThingFlags::Obstacle | ThingFlags::HangsFromCeiling
+        .id = 51, .radius = 16, .height = 84, .sprite = {"GOR3"}, .sequence = {"A"},
+        .class_flags = ThingFlags::Obstacle | ThingFlags::HangsFromCeiling | ThingFlags::SpawnsOnCeiling
     },
     ThingDef{
-        .id = 49, .radius = 16, .height = 16, .sprite = {"GOR1"}, .sequence = {"ABCB"},
-        .class_flags = ThingFlags::Obstacle | ThingFlags::HangsFromCeiling
+        .id = 49, .radius = 16, .height = 68, .sprite = {"GOR1"}, .sequence = {"ABCB"},
+        .class_flags = ThingFlags::Obstacle | ThingFlags::HangsFromCeiling | ThingFlags::SpawnsOnCeiling
     },
     ThingDef{
         .id = 25, .radius = 16, .height = 16, .sprite = {"POL1"}, .sequence = {"A"},
@@ -454,23 +457,23 @@ static inline std::vector all_things = {
     },
     ThingDef{
         .id = 62, .radius = 20, .height = 52, .sprite = {"GOR5"}, .sequence = {"A"},
-        .class_flags = 0
+        .class_flags = ThingFlags::HangsFromCeiling | ThingFlags::SpawnsOnCeiling
     },
     ThingDef{
         .id = 60, .radius = 20, .height = 68, .sprite = {"GOR4"}, .sequence = {"A"},
-        .class_flags = 0
+        .class_flags = ThingFlags::HangsFromCeiling | ThingFlags::SpawnsOnCeiling
     },
     ThingDef{
         .id = 59, .radius = 20, .height = 84, .sprite = {"GOR2"}, .sequence = {"A"},
-        .class_flags = 0
+        .class_flags = ThingFlags::HangsFromCeiling | ThingFlags::SpawnsOnCeiling
     },
     ThingDef{
         .id = 61, .radius = 20, .height = 52, .sprite = {"GOR3"}, .sequence = {"A"},
-        .class_flags = 0
+        .class_flags = ThingFlags::HangsFromCeiling | ThingFlags::SpawnsOnCeiling
     },
     ThingDef{
         .id = 63, .radius = 20, .height = 68, .sprite = {"GOR1"}, .sequence = {"ABCB"},
-        .class_flags = 0
+        .class_flags = ThingFlags::HangsFromCeiling | ThingFlags::SpawnsOnCeiling
     },
     ThingDef{
         .id = 79, .radius = 20, .height = 16, .sprite = {"POB1"}, .sequence = {"A"},
@@ -533,45 +536,28 @@ bool ThingDef::is_spriteless() const {
     return id == 11 || id == 89 || id == 1 || id == 2 || id == 3 || id == 4 || id == 88 || id == 87 || id == 14;
 }
 
-void load_things_into_map(const wad::WAD& wad, const MapExtractionOptions& options, Map& map) {
+void load_things_into_map(
+    const wad::ResourceSet& resources, const wad::MapData& map_data, const MapExtractionOptions& options, Map& map
+) {
     if (!options.export_things) {
         return;
     }
 
-    auto itr = wad.find_lump(options.map_name);
-
-    const auto map_lump_itr = itr;
-    ++itr;
-    const auto things_itr = itr;
-
-    // There's some other lumps that don't seem important for this program
-
-    const auto wad_things = wad.get_lump_data<wad::Thing>(*things_itr);
+    const auto wad_things = map_data.things;
 
     map.things.reserve(wad_things.size());
 
-    // Copy the Things
-    for (const auto& thing : wad_things) {
-        const auto& thing_def = get_thing(thing.type);
+    const auto locator = SectorLocator::build(map_data);
 
-        if (thing_def.is_spriteless()) {
-            // Skip spriteless things because coding is h ard
-            continue;
+    // Things with the same sprite share its texture and its quad, so each sprite is only loaded and stored once
+    auto loaded_sprites = std::unordered_map<wad::Name, MeshRange>{};
+    const auto get_sprite = [&](const wad::Name& sprite_name) -> const MeshRange& {
+        if (const auto itr = loaded_sprites.find(sprite_name); itr != loaded_sprites.end()) {
+            return itr->second;
         }
 
-        auto sector_floor = float{0};
-        for (const auto& sector : map.sectors) {
-            for (const auto& polygon : sector.exterior_loops) {
-                if (is_point_in_polygon({ thing.x, thing.y }, polygon)) {
-                    sector_floor = sector.floor.vertices[0].z;
-                    break;
-                }
-            }
-        }
-
-        auto thing_sprite = load_sprite_from_wad(thing_def.sprite, wad);
-
-        auto face = Face{
+        auto thing_sprite = load_sprite_from_wad(sprite_name, resources);
+        const auto face = Face{
             .vertices = {
                 Vertex{
                     .position = {0, -thing_sprite.size.x / 2.f, thing_sprite.size.y},
@@ -595,13 +581,38 @@ void load_things_into_map(const wad::WAD& wad, const MapExtractionOptions& optio
         };
         map.textures.emplace_back(std::move(thing_sprite));
 
+        return loaded_sprites.emplace(sprite_name, map.geometry.append(face)).first->second;
+    };
+
+    // Copy the Things
+    for (const auto& thing : wad_things) {
+        const auto& thing_def = get_thing(thing.type);
+
+        if (thing_def.is_spriteless()) {
+            // Skip spriteless things because coding is h ard
+            continue;
+        }
+
+        const auto& sprite_quad = get_sprite(thing_def.sprite);
+
+        // Things stand on the floor of their sector, unless the game spawns them with their top at its ceiling.
+        // Floating monsters start on the floor too
+        auto height = float{0};
+        if (const auto sector_index = locator.find_sector(thing.x, thing.y)) {
+            const auto& sector = map.sectors[*sector_index];
+            height = thing_def.class_flags & ThingFlags::SpawnsOnCeiling
+                         ? static_cast<float>(sector.ceiling_height) - static_cast<float>(thing_def.height)
+                         : static_cast<float>(sector.floor_height);
+        } else {
+            std::cout << std::format("WARNING: Thing at {}, {} isn't in any sector\n", thing.x, thing.y);
+        }
+
         // DOOM rotation: https://doomwiki.org/wiki/Angle
 
         const auto radians_angle = glm::radians(static_cast<float>(thing.facing_angle));
 
         map.things.emplace_back(
-            glm::vec3{thing.x, thing.y, sector_floor}, radians_angle, face,
-            thing.type, thing.flags
+            glm::vec3{thing.x, thing.y, height}, radians_angle, sprite_quad, thing.type, thing.flags
         );
     }
 
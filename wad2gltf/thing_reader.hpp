@@ -2,6 +2,7 @@
 #include <cstdint>
 #include <vector>
 
+#include "map_data.hpp"
 #include "mesh.hpp"
 #include "wad_name.hpp"
 
@@ -10,6 +11,11 @@ struct MapExtractionOptions;
 namespace ThingFlags {
     enum Class : uint8_t {
         ArtifactItem = 1 << 0,
+        /**
+         * Spawned at the ceiling of its sector, like MF_SPAWNCEILING. Unlike HangsFromCeiling, which also marks the
+         * monsters that float, this is only the hanging decorations and Commander Keen
+         */
+        SpawnsOnCeiling = 1 << 1,
         Pickup = 1 << 2,
         Weapon = 1 << 3,
         Monster = 1 << 4,
@@ -29,6 +35,8 @@ struct ThingDef {
     bool is_spriteless() const;
 };
 
-void load_things_into_map(const wad::WAD& wad, const MapExtractionOptions& options, Map& map);
+void load_things_into_map(
+    const wad::ResourceSet& resources, const wad::MapData& map_data, const MapExtractionOptions& options, Map& map
+);
 
 const ThingDef& get_thing(uint16_t thing_id);
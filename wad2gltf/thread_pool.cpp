@@ -0,0 +1,139 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+
+ThreadPool::ThreadPool(uint32_t num_threads) {
+    if (num_threads == 0) {
+        num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    workers.reserve(num_threads);
+    for (auto i = 0u; i < num_threads; i++) {
+        workers.emplace_back([this]() { run_worker(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        auto lock = std::lock_guard{tasks_mutex};
+        stopping = true;
+    }
+    tasks_available.notify_all();
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+uint32_t ThreadPool::get_num_threads() const {
+    return static_cast<uint32_t>(workers.size());
+}
+
+void ThreadPool::enqueue(std::function<void()>&& task) {
+    {
+        auto lock = std::lock_guard{tasks_mutex};
+        tasks.emplace_back(std::move(task));
+    }
+    tasks_available.notify_one();
+}
+
+/**
+ * Shared between the thread that called parallel_for and the helper tasks. Helpers may start after the loop is done,
+ * so they hold a reference to this instead of pointing at the caller's stack
+ */
+struct ParallelForState {
+    size_t count = 0;
+
+    size_t chunk_size = 1;
+
+    std::function<void(size_t)> body;
+
+    std::atomic<size_t> next_item = 0;
+
+    std::atomic<size_t> finished_items = 0;
+
+    std::mutex mutex;
+
+    std::condition_variable all_finished;
+
+    std::exception_ptr exception;
+
+    /**
+     * Takes chunks until there are none left
+     */
+    void run_chunks() {
+        while (true) {
+            const auto begin = next_item.fetch_add(chunk_size);
+            if (begin >= count) {
+                return;
+            }
+
+            const auto end = std::min(begin + chunk_size, count);
+            for (auto i = begin; i < end; i++) {
+                try {
+                    body(i);
+                } catch (...) {
+                    auto lock = std::lock_guard{mutex};
+                    if (!exception) {
+                        exception = std::current_exception();
+                    }
+                }
+            }
+
+            if (finished_items.fetch_add(end - begin) + (end - begin) == count) {
+                auto lock = std::lock_guard{mutex};
+                all_finished.notify_all();
+            }
+        }
+    }
+};
+
+void ThreadPool::run_parallel_for(const size_t count, const std::function<void(size_t)>& body) {
+    if (count == 0) {
+        return;
+    }
+
+    auto state = std::make_shared<ParallelForState>();
+    state->count = count;
+    // A few chunks per thread, so that the threads even out when some items take longer than others
+    state->chunk_size = std::max(count / (workers.size() * 8 + 1), size_t{1});
+    state->body = body;
+
+    const auto num_chunks = (count + state->chunk_size - 1) / state->chunk_size;
+    const auto num_helpers = std::min(workers.size(), num_chunks - 1);
+    for (auto i = 0u; i < num_helpers; i++) {
+        enqueue([state]() { state->run_chunks(); });
+    }
+
+    state->run_chunks();
+
+    {
+        auto lock = std::unique_lock{state->mutex};
+        state->all_finished.wait(lock, [&]() { return state->finished_items == count; });
+    }
+
+    if (state->exception) {
+        std::rethrow_exception(state->exception);
+    }
+}
+
+void ThreadPool::run_worker() {
+    while (true) {
+        auto task = std::function<void()>{};
+        {
+            auto lock = std::unique_lock{tasks_mutex};
+            tasks_available.wait(lock, [&]() { return stopping || !tasks.empty(); });
+
+            // Drain the queue before stopping, so that every submitted task's future gets a result
+            if (tasks.empty()) {
+                return;
+            }
+
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+
+        task();
+    }
+}
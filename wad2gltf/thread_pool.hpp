@@ -0,0 +1,90 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/**
+ * \brief A fixed set of worker threads that run tasks from a shared queue
+ *
+ * Destroying the pool waits for all the queued tasks to finish
+ */
+class ThreadPool {
+public:
+    /**
+     * \param num_threads Number of worker threads. 0 means one thread per hardware thread
+     */
+    explicit ThreadPool(uint32_t num_threads);
+
+    ThreadPool(const ThreadPool& other) = delete;
+    ThreadPool& operator=(const ThreadPool& other) = delete;
+
+    ThreadPool(ThreadPool&& old) noexcept = delete;
+    ThreadPool& operator=(ThreadPool&& old) noexcept = delete;
+
+    ~ThreadPool();
+
+    /**
+     * \brief Queues a task to run on one of the worker threads
+     *
+     * \return A future with the result of the task. If the task throws, the future rethrows the exception
+     */
+    template <typename TaskType>
+    std::future<std::invoke_result_t<TaskType>> submit(TaskType&& task);
+
+    /**
+     * \brief Runs body(i) for every i in [0, count), spread over the worker threads and the calling thread
+     *
+     * Items are handed out in small chunks from a shared counter, so threads that finish early keep taking chunks
+     * until there are none left. The calling thread takes chunks too, and never waits for a chunk that nobody has
+     * started, so this can be called from a task that's running on this pool
+     *
+     * \throws The first exception that body threw, after all the other items have finished
+     */
+    template <typename BodyType>
+    void parallel_for(size_t count, BodyType&& body);
+
+    uint32_t get_num_threads() const;
+
+private:
+    std::vector<std::thread> workers;
+
+    std::deque<std::function<void()>> tasks;
+
+    std::mutex tasks_mutex;
+
+    std::condition_variable tasks_available;
+
+    bool stopping = false;
+
+    void enqueue(std::function<void()>&& task);
+
+    void run_parallel_for(size_t count, const std::function<void(size_t)>& body);
+
+    void run_worker();
+};
+
+template <typename TaskType>
+std::future<std::invoke_result_t<TaskType>> ThreadPool::submit(TaskType&& task) {
+    // std::function must be copyable, but packaged_task is move-only
+    auto packaged_task = std::make_shared<std::packaged_task<std::invoke_result_t<TaskType>()>>(
+        std::forward<TaskType>(task)
+    );
+    auto result = packaged_task->get_future();
+
+    enqueue([packaged_task]() { (*packaged_task)(); });
+
+    return result;
+}
+
+template <typename BodyType>
+void ThreadPool::parallel_for(const size_t count, BodyType&& body) {
+    run_parallel_for(count, [&body](const size_t i) { body(i); });
+}
@@ -0,0 +1,445 @@
+#include "udmf_parser.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <format>
+#include <limits>
+#include <stdexcept>
+
+namespace wad {
+    /**
+     * A value on the right side of an assignment. Strings don't include their quotes
+     */
+    struct TextMapValue {
+        std::string_view text;
+
+        bool is_string = false;
+    };
+
+    /**
+     * UDMF keys are case-insensitive. The expected key must be lower-case
+     */
+    static bool is_key(const std::string_view key, const std::string_view expected_key) {
+        if (key.size() != expected_key.size()) {
+            return false;
+        }
+
+        for (auto i = 0u; i < key.size(); i++) {
+            const auto c = key[i];
+            if ((c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c) != expected_key[i]) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    static bool is_identifier_start(const char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+    }
+
+    static bool is_identifier_char(const char c) {
+        return is_identifier_start(c) || (c >= '0' && c <= '9');
+    }
+
+    static bool is_whitespace(const char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+
+    /**
+     * Single-pass recursive-descent parser for TEXTMAP lumps. See https://doomwiki.org/wiki/UDMF for the grammar
+     */
+    class TextMapParser {
+    public:
+        explicit TextMapParser(const std::string_view text) : text{text} {}
+
+        TextMap parse() {
+            auto textmap = TextMap{};
+
+            while (skip_whitespace_and_comments()) {
+                const auto identifier = read_identifier();
+                skip_whitespace_and_comments();
+
+                if (peek() == '=') {
+                    // Global assignment, such as the namespace. We convert every namespace the same way
+                    position++;
+                    read_value();
+                    expect(';');
+                    continue;
+                }
+
+                if (is_key(identifier, "vertex")) {
+                    textmap.vertexes.emplace_back(parse_vertex());
+                } else if (is_key(identifier, "linedef")) {
+                    textmap.linedefs.emplace_back(parse_linedef());
+                } else if (is_key(identifier, "sidedef")) {
+                    textmap.sidedefs.emplace_back(parse_sidedef());
+                } else if (is_key(identifier, "sector")) {
+                    textmap.sectors.emplace_back(parse_sector());
+                } else if (is_key(identifier, "thing")) {
+                    textmap.things.emplace_back(parse_thing());
+                } else {
+                    parse_block([](std::string_view, const TextMapValue&) {});
+                }
+            }
+
+            return textmap;
+        }
+
+    private:
+        std::string_view text;
+
+        size_t position = 0;
+
+        [[noreturn]] void fail(const std::string_view message) const {
+            const auto line = std::count(text.begin(), text.begin() + std::min(position, text.size()), '\n') + 1;
+            throw std::runtime_error{std::format("TEXTMAP line {}: {}", line, message)};
+        }
+
+        char peek() const {
+            return position < text.size() ? text[position] : '\0';
+        }
+
+        void expect(const char c) {
+            skip_whitespace_and_comments();
+            if (peek() != c) {
+                fail(std::format("Expected '{}'", c));
+            }
+            position++;
+        }
+
+        /**
+         * \return True if there's any text left
+         */
+        bool skip_whitespace_and_comments() {
+            while (position < text.size()) {
+                const auto c = text[position];
+                if (is_whitespace(c)) {
+                    position++;
+                } else if (c == '/' && position + 1 < text.size() && text[position + 1] == '/') {
+                    const auto line_end = text.find('\n', position);
+                    position = line_end == std::string_view::npos ? text.size() : line_end + 1;
+                } else if (c == '/' && position + 1 < text.size() && text[position + 1] == '*') {
+                    const auto comment_end = text.find("*/", position + 2);
+                    if (comment_end == std::string_view::npos) {
+                        fail("Unterminated block comment");
+                    }
+                    position = comment_end + 2;
+                } else {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        std::string_view read_identifier() {
+            const auto start = position;
+            if (!is_identifier_start(peek())) {
+                fail("Expected an identifier");
+            }
+
+            while (position < text.size() && is_identifier_char(text[position])) {
+                position++;
+            }
+
+            return text.substr(start, position - start);
+        }
+
+        TextMapValue read_value() {
+            skip_whitespace_and_comments();
+
+            if (peek() == '"') {
+                const auto start = ++position;
+                while (position < text.size() && text[position] != '"') {
+                    // Skip escaped characters, so that \" doesn't end the string
+                    position += text[position] == '\\' ? 2 : 1;
+                }
+                if (position >= text.size()) {
+                    fail("Unterminated string");
+                }
+
+                return {.text = text.substr(start, position++ - start), .is_string = true};
+            }
+
+            // Numbers and keywords run until the semicolon
+            const auto start = position;
+            while (position < text.size() && text[position] != ';' && !is_whitespace(text[position])) {
+                position++;
+            }
+            if (position == start) {
+                fail("Expected a value");
+            }
+
+            return {.text = text.substr(start, position - start)};
+        }
+
+        /**
+         * Parses a block's assignments and passes each key and value to handle_field
+         */
+        template <typename FieldHandler>
+        void parse_block(FieldHandler&& handle_field) {
+            expect('{');
+
+            while (true) {
+                if (!skip_whitespace_and_comments()) {
+                    fail("Unterminated block");
+                }
+                if (peek() == '}') {
+                    position++;
+                    return;
+                }
+
+                const auto key = read_identifier();
+                expect('=');
+                const auto value = read_value();
+                expect(';');
+
+                handle_field(key, value);
+            }
+        }
+
+        int64_t to_integer(const TextMapValue& value) const {
+            auto digits = value.text;
+            auto is_negative = false;
+            if (!digits.empty() && (digits.front() == '-' || digits.front() == '+')) {
+                is_negative = digits.front() == '-';
+                digits.remove_prefix(1);
+            }
+
+            auto base = 10;
+            if (digits.size() > 2 && digits[0] == '0' && (digits[1] == 'x' || digits[1] == 'X')) {
+                base = 16;
+                digits.remove_prefix(2);
+            }
+
+            auto result = int64_t{0};
+            const auto [end, error] = std::from_chars(digits.data(), digits.data() + digits.size(), result, base);
+            if (value.is_string || error != std::errc{} || end != digits.data() + digits.size()) {
+                fail(std::format("Expected an integer, got '{}'", value.text));
+            }
+
+            return is_negative ? -result : result;
+        }
+
+        double to_float(const TextMapValue& value) const {
+            // Integers are valid wherever floats are, and they may be hexadecimal
+            if (value.text.find_first_of("xX") != std::string_view::npos) {
+                return static_cast<double>(to_integer(value));
+            }
+
+            auto digits = value.text;
+            if (!digits.empty() && digits.front() == '+') {
+                digits.remove_prefix(1);
+            }
+
+            auto result = 0.0;
+            const auto [end, error] = std::from_chars(digits.data(), digits.data() + digits.size(), result);
+            if (value.is_string || error != std::errc{} || end != digits.data() + digits.size()) {
+                fail(std::format("Expected a number, got '{}'", value.text));
+            }
+
+            return result;
+        }
+
+        bool to_bool(const TextMapValue& value) const {
+            if (!value.is_string && is_key(value.text, "true")) {
+                return true;
+            }
+            if (!value.is_string && is_key(value.text, "false")) {
+                return false;
+            }
+
+            fail(std::format("Expected true or false, got '{}'", value.text));
+        }
+
+        Name to_name(const TextMapValue& value) const {
+            if (!value.is_string) {
+                fail(std::format("Expected a string, got '{}'", value.text));
+            }
+
+            return Name::from_string(value.text);
+        }
+
+        /**
+         * Converts a value to one of the binary map structs' integer types, making sure that it fits
+         */
+        template <typename IntegerType>
+        IntegerType to_narrow_integer(const int64_t value, const std::string_view key) const {
+            if (value < std::numeric_limits<IntegerType>::min() || value > std::numeric_limits<IntegerType>::max()) {
+                fail(std::format("{} {} is out of range", key, value));
+            }
+
+            return static_cast<IntegerType>(value);
+        }
+
+        int16_t to_coordinate(const TextMapValue& value, const std::string_view key) const {
+            return to_narrow_integer<int16_t>(std::llround(to_float(value)), key);
+        }
+
+        /**
+         * Sidedef indices are -1 when there's no sidedef
+         */
+        uint16_t to_sidedef_index(const TextMapValue& value, const std::string_view key) const {
+            const auto index = to_integer(value);
+            if (index == -1) {
+                return LineDef::NoSidedef;
+            }
+
+            return to_narrow_integer<uint16_t>(index, key);
+        }
+
+        static void set_flag(uint16_t& flags, const uint16_t flag, const bool is_set) {
+            if (is_set) {
+                flags |= flag;
+            } else {
+                flags &= ~flag;
+            }
+        }
+
+        Vertex parse_vertex() {
+            auto vertex = Vertex{};
+            parse_block([&](const std::string_view key, const TextMapValue& value) {
+                if (is_key(key, "x")) {
+                    vertex.x = to_coordinate(value, key);
+                } else if (is_key(key, "y")) {
+                    vertex.y = to_coordinate(value, key);
+                }
+            });
+
+            return vertex;
+        }
+
+        LineDef parse_linedef() {
+            auto linedef = LineDef{};
+            auto flags = uint16_t{0};
+            parse_block([&](const std::string_view key, const TextMapValue& value) {
+                if (is_key(key, "v1")) {
+                    linedef.start_vertex = to_narrow_integer<uint16_t>(to_integer(value), key);
+                } else if (is_key(key, "v2")) {
+                    linedef.end_vertex = to_narrow_integer<uint16_t>(to_integer(value), key);
+                } else if (is_key(key, "sidefront")) {
+                    linedef.front_sidedef = to_sidedef_index(value, key);
+                } else if (is_key(key, "sideback")) {
+                    linedef.back_sidedef = to_sidedef_index(value, key);
+                } else if (is_key(key, "special")) {
+                    linedef.special_type = to_narrow_integer<int16_t>(to_integer(value), key);
+                } else if (is_key(key, "id")) {
+                    // Lines without an ID have -1, binary maps use 0 for no tag
+                    linedef.sector_tag = std::max(to_narrow_integer<int16_t>(to_integer(value), key), int16_t{0});
+                } else if (is_key(key, "blocking")) {
+                    set_flag(flags, LineDef::BlocksPlayersAndMonsters, to_bool(value));
+                } else if (is_key(key, "blockmonsters")) {
+                    set_flag(flags, LineDef::BlocksMonsters, to_bool(value));
+                } else if (is_key(key, "twosided")) {
+                    set_flag(flags, LineDef::TwoSided, to_bool(value));
+                } else if (is_key(key, "dontpegtop")) {
+                    set_flag(flags, LineDef::UpperTextureUnpegged, to_bool(value));
+                } else if (is_key(key, "dontpegbottom")) {
+                    set_flag(flags, LineDef::LowerTextureUnpegged, to_bool(value));
+                } else if (is_key(key, "secret")) {
+                    set_flag(flags, LineDef::Secret, to_bool(value));
+                } else if (is_key(key, "blocksound")) {
+                    set_flag(flags, LineDef::BlocksSound, to_bool(value));
+                } else if (is_key(key, "dontdraw")) {
+                    set_flag(flags, LineDef::NeverShowOnAutomap, to_bool(value));
+                } else if (is_key(key, "mapped")) {
+                    set_flag(flags, LineDef::AlwaysShowOnAutomap, to_bool(value));
+                }
+            });
+            linedef.flags = static_cast<int16_t>(flags);
+
+            return linedef;
+        }
+
+        SideDef parse_sidedef() {
+            auto sidedef = SideDef{
+                .upper_texture_name = Name::from_string(std::string_view{"-"}),
+                .lower_texture_name = Name::from_string(std::string_view{"-"}),
+                .middle_texture_name = Name::from_string(std::string_view{"-"}),
+            };
+            parse_block([&](const std::string_view key, const TextMapValue& value) {
+                if (is_key(key, "offsetx")) {
+                    sidedef.x_offset = to_narrow_integer<int16_t>(to_integer(value), key);
+                } else if (is_key(key, "offsety")) {
+                    sidedef.y_offset = to_narrow_integer<int16_t>(to_integer(value), key);
+                } else if (is_key(key, "texturetop")) {
+                    sidedef.upper_texture_name = to_name(value);
+                } else if (is_key(key, "texturebottom")) {
+                    sidedef.lower_texture_name = to_name(value);
+                } else if (is_key(key, "texturemiddle")) {
+                    sidedef.middle_texture_name = to_name(value);
+                } else if (is_key(key, "sector")) {
+                    sidedef.sector_number = to_narrow_integer<uint16_t>(to_integer(value), key);
+                }
+            });
+
+            return sidedef;
+        }
+
+        Sector parse_sector() {
+            // Unlike the other fields, a UDMF sector's light level doesn't default to 0
+            auto sector = Sector{};
+            sector.light_level = 160;
+            parse_block([&](const std::string_view key, const TextMapValue& value) {
+                if (is_key(key, "heightfloor")) {
+                    sector.floor_height = to_narrow_integer<int16_t>(to_integer(value), key);
+                } else if (is_key(key, "heightceiling")) {
+                    sector.ceiling_height = to_narrow_integer<int16_t>(to_integer(value), key);
+                } else if (is_key(key, "texturefloor")) {
+                    sector.floor_texture = to_name(value);
+                } else if (is_key(key, "textureceiling")) {
+                    sector.ceiling_texture = to_name(value);
+                } else if (is_key(key, "lightlevel")) {
+                    sector.light_level = to_narrow_integer<int16_t>(to_integer(value), key);
+                } else if (is_key(key, "special")) {
+                    sector.special_type = to_narrow_integer<int16_t>(to_integer(value), key);
+                } else if (is_key(key, "id")) {
+                    sector.tag_number = to_narrow_integer<int16_t>(to_integer(value), key);
+                }
+            });
+
+            return sector;
+        }
+
+        Thing parse_thing() {
+            auto thing = Thing{};
+            auto is_single_player = false;
+            parse_block([&](const std::string_view key, const TextMapValue& value) {
+                if (is_key(key, "x")) {
+                    thing.x = to_coordinate(value, key);
+                } else if (is_key(key, "y")) {
+                    thing.y = to_coordinate(value, key);
+                } else if (is_key(key, "angle")) {
+                    thing.facing_angle = to_narrow_integer<int16_t>(to_integer(value), key);
+                } else if (is_key(key, "type")) {
+                    thing.type = to_narrow_integer<int16_t>(to_integer(value), key);
+                } else if (is_key(key, "skill1") || is_key(key, "skill2")) {
+                    // Binary maps have one flag for both skill levels, so either one sets it
+                    if (to_bool(value)) {
+                        thing.flags |= Thing::SkillLevel1And2;
+                    }
+                } else if (is_key(key, "skill3")) {
+                    set_flag(thing.flags, Thing::SkillLevel3, to_bool(value));
+                } else if (is_key(key, "skill4") || is_key(key, "skill5")) {
+                    if (to_bool(value)) {
+                        thing.flags |= Thing::SkillLevel4And5;
+                    }
+                } else if (is_key(key, "ambush")) {
+                    set_flag(thing.flags, Thing::Ambush, to_bool(value));
+                } else if (is_key(key, "single")) {
+                    is_single_player = to_bool(value);
+                }
+            });
+
+            set_flag(thing.flags, Thing::MultiplayerOnly, !is_single_player);
+
+            return thing;
+        }
+    };
+
+    TextMap parse_textmap(const std::string_view textmap) {
+        return TextMapParser{textmap}.parse();
+    }
+}
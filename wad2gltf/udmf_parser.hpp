@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string_view>
+#include <vector>
+
+#include "wad.hpp"
+
+/**
+ * \file udmf_parser.hpp
+ *
+ * Reads the TEXTMAP lump of UDMF maps into the same structs that binary maps use
+ */
+
+namespace wad {
+    /**
+     * The contents of a TEXTMAP lump, converted to binary map structs
+     */
+    struct TextMap {
+        std::vector<Vertex> vertexes;
+        std::vector<LineDef> linedefs;
+        std::vector<SideDef> sidedefs;
+        std::vector<Sector> sectors;
+        std::vector<Thing> things;
+    };
+
+    /**
+     * \brief Parses a TEXTMAP lump
+     *
+     * Tokens are views into the lump's text, so parsing doesn't allocate anything except the output arrays. Keys
+     * that we don't use and blocks we don't know are skipped. UDMF allows fractional vertex and thing positions, but
+     * the rest of the converter works in map units, so they're rounded to the nearest unit. Texture names longer than
+     * eight characters are truncated
+     *
+     * \param textmap The text of the TEXTMAP lump
+     * \throws std::runtime_error if the text isn't valid UDMF, or if a value doesn't fit in the binary map structs
+     */
+    TextMap parse_textmap(std::string_view textmap);
+}
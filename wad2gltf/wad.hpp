@@ -2,13 +2,20 @@
 
 #define __STDC_WANT_LIB_EXT1__ 1
 #include <cstdint>
+#include <algorithm>
+#include <array>
 #include <cstring>
 #include <format>
+#include <memory>
 #include <vector>
 #include <span>
 #include <stdexcept>
 #include <unordered_map>
 
+#include "lump_cache.hpp"
+#include "lump_index.hpp"
+#include "map_index.hpp"
+#include "mapped_file.hpp"
 #include "wad_name.hpp"
 
 namespace wad {
@@ -56,18 +63,47 @@ namespace wad {
      *
      * Currently implements the DOOM file format, but not any successors. That might come later
      *
-     * All the pointers in this data structure refer to the raw data vector. Thus, copying this data
-     * structure is not allowed. Maybe one day I'll write a good copy constructor/operator
+     * All the pointers in this data structure refer to the raw data, which is either a memory mapping of the WAD file
+     * or a vector that we read the file into. Thus, copying this data structure is not allowed. Maybe one day I'll
+     * write a good copy constructor/operator
+     *
+     * Streamed WADs don't have any raw data. Instead, lump_cache reads their lumps on demand. Lumps from a streamed WAD
+     * must be read while a LumpPinScope is alive on the reading thread, and their data stays valid until it ends
      */
     struct WAD {
-        Header* header = nullptr;
+        const Header* header = nullptr;
+
+        std::span<const LumpInfo> lump_directory;
+
+        /**
+         * Raw data of the WAD file. Points into either mapped_data or owned_data
+         */
+        std::span<const uint8_t> raw_data;
 
-        std::span<LumpInfo> lump_directory;
+        /**
+         * Read-only mapping of the WAD file, if we loaded it with memory mapping
+         */
+        MappedFile mapped_data;
+
+        /**
+         * Copy of the WAD file, if we couldn't map it (such as when reading from a pipe)
+         */
+        std::vector<uint8_t> owned_data;
 
         /**
-         * Raw data read from the WAD file
+         * Reads lumps on demand, if we're streaming the WAD file. Also owns the header and lump directory
          */
-        std::vector<uint8_t> raw_data;
+        std::unique_ptr<LumpCache> lump_cache;
+
+        /**
+         * Hash index of the lump directory, built when the WAD is loaded
+         */
+        LumpIndex lump_index;
+
+        /**
+         * Table of the maps in this WAD, built when the WAD is loaded
+         */
+        MapIndex map_index;
 
         WAD() = default;
 
@@ -77,25 +113,63 @@ namespace wad {
         WAD(WAD&& old) noexcept = default;
         WAD& operator=(WAD&& old) noexcept = default;
 
+        /**
+         * Finds the lump with the requested name. If there's multiple lumps with that name, returns the last one, like
+         * DOOM does
+         *
+         * \throws std::runtime_error if there's no lump with the requested name
+         */
         template <typename NameType>
         auto find_lump(const NameType& lump_name) const {
-            const auto itr = std::ranges::find_if(
-                lump_directory, [&](const LumpInfo& lump) {
-                    return lump.name == lump_name;
-                }
-            );
-            if (itr == lump_directory.end()) {
+            const auto lump_index_in_directory = lump_index.find_last(to_name(lump_name));
+            if (!lump_index_in_directory) {
                 throw std::runtime_error{std::format("Could not find requested lump {}", lump_name)};
             }
 
-            return itr;
+            return lump_directory.begin() + *lump_index_in_directory;
         }
 
+        /**
+         * Finds all the lumps with the requested name, in directory order
+         */
+        template <typename NameType>
+        auto find_all(const NameType& lump_name) const {
+            auto lumps = std::vector<decltype(lump_directory.begin())>{};
+            for (const auto lump_index_in_directory : lump_index.find_all(to_name(lump_name))) {
+                lumps.emplace_back(lump_directory.begin() + lump_index_in_directory);
+            }
+
+            return lumps;
+        }
+
+        /**
+         * Gets a lump's data. PWADs sometimes have junk directory entries, so lumps are only checked against the end
+         * of the file when they're read
+         *
+         * \throws std::runtime_error if the lump isn't inside the WAD file
+         */
         template <typename LumpDataType>
         std::span<const LumpDataType> get_lump_data(const LumpInfo& lump) const {
-            const auto* lump_data_ptr = reinterpret_cast<const LumpDataType*>(raw_data.data() + lump.filepos);
+            if (lump_cache == nullptr && (lump.filepos < 0 || lump.size < 0 ||
+                static_cast<uint64_t>(lump.filepos) + static_cast<uint64_t>(lump.size) > raw_data.size())) {
+                throw std::runtime_error{std::format("Lump {} is out of bounds", lump.name)};
+            }
+
+            const auto* lump_bytes = lump_cache != nullptr
+                                         ? lump_cache->get_lump_data(lump).data()
+                                         : raw_data.data() + lump.filepos;
+            const auto* lump_data_ptr = reinterpret_cast<const LumpDataType*>(lump_bytes);
             return std::span{lump_data_ptr, static_cast<size_t>(lump.size) / sizeof(LumpDataType)};
         }
+
+        /**
+         * Reads the requested lumps ahead of time, in file order. Does nothing unless the WAD is streamed
+         */
+        void prefetch_lumps(const std::span<const LumpInfo* const> lumps) const {
+            if (lump_cache != nullptr) {
+                lump_cache->prefetch(lumps);
+            }
+        }
     };
 
     struct Vertex {
@@ -109,8 +183,20 @@ namespace wad {
         int16_t flags = 0;
         int16_t special_type = 0;
         int16_t sector_tag = 0;
-        int16_t front_sidedef = 0;
-        int16_t back_sidedef = 0;
+
+        /**
+         * Sidedef indices are unsigned, so that limit-removing maps can have up to 65535 sidedefs. Vanilla DOOM reads
+         * them as signed, so vanilla maps only use indices up to 32767. Both use 0xFFFF (-1 in vanilla) for "none"
+         */
+        uint16_t front_sidedef = 0;
+        uint16_t back_sidedef = NoSidedef;
+
+        constexpr static inline uint16_t NoSidedef = 0xFFFF;
+
+        /**
+         * Largest sidedef index that vanilla DOOM can use
+         */
+        constexpr static inline uint16_t MaxVanillaSidedef = 0x7FFF;
 
         constexpr static inline uint16_t BlocksPlayersAndMonsters = 0x0001;
         constexpr static inline uint16_t BlocksMonsters = 0x0002;
@@ -129,7 +215,7 @@ namespace wad {
         Name upper_texture_name;
         Name lower_texture_name;
         Name middle_texture_name;
-        int16_t sector_number = 0;
+        uint16_t sector_number = 0;
     };
 
     struct Sector {
@@ -142,6 +228,62 @@ namespace wad {
         int16_t tag_number = 0;
     };
 
+    /**
+     * A piece of a linedef side that the node builder put in a subsector. Node builders add the vertexes where they
+     * split linedefs to the end of VERTEXES, so segs can use vertexes that no linedef uses
+     */
+    struct Seg {
+        uint16_t start_vertex = 0;
+        uint16_t end_vertex = 0;
+        int16_t angle = 0;
+        uint16_t linedef = 0;
+
+        /**
+         * 0 if the seg is on its linedef's front side, 1 if it's on the back side
+         */
+        int16_t direction = 0;
+
+        /**
+         * Distance along the linedef to the start of the seg
+         */
+        int16_t offset = 0;
+    };
+
+    /**
+     * A convex piece of a sector. Its segs are consecutive in SEGS, and only cover the parts of its boundary that are
+     * on linedefs
+     */
+    struct SubSector {
+        uint16_t seg_count = 0;
+        uint16_t first_seg = 0;
+    };
+
+    /**
+     * A node of the BSP tree. The last node in NODES is the root
+     */
+    struct Node {
+        /**
+         * Start and direction of the partition line
+         */
+        int16_t x = 0;
+        int16_t y = 0;
+        int16_t dx = 0;
+        int16_t dy = 0;
+
+        /**
+         * Bounding box of each child, as top, bottom, left, right
+         */
+        std::array<std::array<int16_t, 4>, 2> bounding_boxes = {};
+
+        /**
+         * The child on the right of the partition line, then the one on the left. A child with SubSectorChild set is
+         * a subsector, otherwise it's a node
+         */
+        std::array<uint16_t, 2> children = {};
+
+        constexpr static inline uint16_t SubSectorChild = 0x8000;
+    };
+
     struct Texture1 {
         /**
          * Number of textures in this lump
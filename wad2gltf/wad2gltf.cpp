@@ -3,8 +3,12 @@
 
 #include <filesystem>
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <string>
 #include <ranges>
+#include <set>
+#include <unordered_set>
 
 #include <CLI/CLI.hpp>
 #include <fastgltf/core.hpp>
@@ -15,36 +19,244 @@
 #include "texture_exporter.hpp"
 #include "texture_reader.hpp"
 #include "thing_reader.hpp"
+#include "resource_set.hpp"
+#include "thread_pool.hpp"
 #include "wad_loader.hpp"
 
 std::optional<std::string> write_extras(const std::size_t object_index, const fastgltf::Category object_type, void* user_pointer) {
+    const auto* exported_wad = static_cast<const ExportedWad*>(user_pointer);
     if(object_type == fastgltf::Category::Nodes) {
-        auto* node_extras = static_cast<std::vector<std::optional<std::string>>*>(user_pointer);
-        return node_extras->at(object_index);
+        return exported_wad->node_extras.at(object_index);
+    }
+    if (object_type == fastgltf::Category::Scenes) {
+        return exported_wad->scene_extras.at(object_index);
     }
 
     return std::nullopt;
 }
 
+/**
+ * Texture files that have already been written. Maps converted into the same folder share most of their textures, so
+ * we only write each one once
+ */
+struct ExportedTextures {
+    std::mutex mutex;
+    std::set<std::filesystem::path> files;
+};
+
+bool is_glob_pattern(const std::string_view pattern) {
+    return pattern.find_first_of("*?") != std::string_view::npos;
+}
+
+/**
+ * Case-insensitive glob match. `*` matches any number of characters, `?` matches exactly one
+ */
+bool matches_glob(const std::string_view pattern, const std::string_view name) {
+    auto pattern_pos = size_t{0};
+    auto name_pos = size_t{0};
+    auto star_pos = std::string_view::npos;
+    auto star_name_pos = size_t{0};
+
+    while (name_pos < name.size()) {
+        if (pattern_pos < pattern.size() && (pattern[pattern_pos] == '?' ||
+            toupper(static_cast<unsigned char>(pattern[pattern_pos])) ==
+            toupper(static_cast<unsigned char>(name[name_pos])))) {
+            pattern_pos++;
+            name_pos++;
+        } else if (pattern_pos < pattern.size() && pattern[pattern_pos] == '*') {
+            star_pos = pattern_pos++;
+            star_name_pos = name_pos;
+        } else if (star_pos != std::string_view::npos) {
+            // Let the last star eat one more character and try again
+            pattern_pos = star_pos + 1;
+            name_pos = ++star_name_pos;
+        } else {
+            return false;
+        }
+    }
+
+    while (pattern_pos < pattern.size() && pattern[pattern_pos] == '*') {
+        pattern_pos++;
+    }
+
+    return pattern_pos == pattern.size();
+}
+
+/**
+ * Resolves the map names and glob patterns from the command line into a list of maps, in the order they were requested
+ */
+std::vector<std::string> select_maps(
+    const std::vector<std::string>& map_patterns, const bool convert_all_maps, const wad::ResourceSet& resources
+) {
+    const auto available_maps = find_map_names(resources);
+    if (convert_all_maps) {
+        return available_maps;
+    }
+
+    auto selected_maps = std::vector<std::string>{};
+    auto seen_maps = std::unordered_set<wad::Name>{};
+    for (const auto& pattern : map_patterns) {
+        if (!is_glob_pattern(pattern)) {
+            // Plain names go through as-is, so that a missing map is reported when we try to convert it
+            if (seen_maps.emplace(wad::Name::from_string(pattern)).second) {
+                selected_maps.emplace_back(pattern);
+            }
+            continue;
+        }
+
+        for (const auto& map_name : available_maps) {
+            if (matches_glob(pattern, map_name) && seen_maps.emplace(wad::Name::from_string(map_name)).second) {
+                selected_maps.emplace_back(map_name);
+            }
+        }
+    }
+
+    return selected_maps;
+}
+
+void convert_map(
+    const wad::ResourceSet& resources, const MapExtractionOptions& extraction_options,
+    ExportedTextures& exported_textures, ThreadPool& thread_pool
+) {
+    // Binary maps point straight at their lumps, so keep the lumps in memory until we're done with the map
+    const auto lump_pins = wad::LumpPinScope{};
+    const auto map_data = wad::load_map_data(resources, resources.find_map(extraction_options.map_name));
+
+    // Each thread that converts maps keeps its arena, so after the first map its blocks are already big enough. The
+    // thread only converts one map at a time, since it waits for the map's tasks without running other work
+    thread_local auto arena = MapArena{};
+    auto map = create_mesh_from_map(resources, map_data, extraction_options, thread_pool, arena);
+    arena.reset();
+
+    std::cout << std::format("Extracted map {} from WAD\n", extraction_options.map_name);
+
+    load_things_into_map(resources, map_data, extraction_options, map);
+
+    // Load all the textures for each sector
+
+    auto exported_wad = export_to_gltf(extraction_options.map_name, map, extraction_options);
+    std::cout << std::format("Generated glTF data for map {}\n", extraction_options.map_name);
+
+    auto exporter = fastgltf::FileExporter{};
+    exporter.setImagePath("textures");
+    exporter.setExtrasWriteCallback(write_extras);
+    exporter.setUserPointer(&exported_wad);
+
+    const auto result = exporter.writeGltfJson(
+        exported_wad.asset, extraction_options.output_file, fastgltf::ExportOptions::PrettyPrintJson
+    );
+
+    if (result != fastgltf::Error::None) {
+        std::cout << std::format("Could not write glTF file: {}\n", fastgltf::getErrorMessage(result));
+    } else {
+        std::cout << std::format("Wrote glTF to file {}\n", extraction_options.output_file.string());
+    }
+
+    if (!map.collision_bvh.empty()) {
+        const auto bvh_path = get_bvh_path(extraction_options.output_file);
+        map.collision_bvh.write(bvh_path);
+        std::cout << std::format("Wrote BVH to file {}\n", bvh_path.string());
+    }
+
+    const auto images_folder = extraction_options.output_file.parent_path() / "textures";
+    std::filesystem::create_directories(images_folder);
+    for (const auto& texture : map.textures) {
+        {
+            auto lock = std::lock_guard{exported_textures.mutex};
+            const auto image_file = images_folder / std::format("{}.png", texture.name.to_string());
+            if (!exported_textures.files.emplace(image_file).second) {
+                continue;
+            }
+        }
+
+        export_texture(texture, images_folder, resources, extraction_options);
+    }
+}
+
 int main(const int argc, const char** argv) {
     CLI::App app{
         R"(WAD to glTF converter. Extracts maps from a DOOM or DOOM 2 WAD file
 
-This program extracts a map from a DOOM or DOOM 2 IWAD or PWAD file. It generates one glTF Mesh for each sector in the 
-map, and one Mesh Primitive for each sector. It can optionally extract the Things from the map, although it places them all at z=0)"
+This program extracts maps from a DOOM or DOOM 2 IWAD or PWAD file. It generates one glTF Mesh for each sector in the 
+map, and one Mesh Primitive for each sector. It can optionally extract the Things from the map. Each Thing stands on 
+the floor of its sector, or hangs from the ceiling if the game spawns it there)"
     };
 
     auto wad_filename = std::filesystem::path{};
+    auto pwad_filenames = std::vector<std::filesystem::path>{};
     auto extraction_options = MapExtractionOptions{};
+    auto skip_memory_mapping = false;
+    auto map_patterns = std::vector<std::string>{};
+    auto convert_all_maps = false;
+    auto list_maps = false;
+    auto num_jobs = uint32_t{0};
+    auto stream_budget_mb = size_t{0};
 
     app.add_option("-f,--file", wad_filename, "Name of the WAD file to extract a map from")->required();
-    app.add_option("-m,--map", extraction_options.map_name, "Name of the map to extract")->required();
-    app.add_option("-o,--output", extraction_options.output_file, "Output the glTF data to this file")->required();
+    app.add_option(
+        "--pwad", pwad_filenames,
+        "PWAD files to load on top of the main WAD file, in order. Lumps in later files override lumps in earlier files"
+    );
+    auto* map_option = app.add_option(
+        "-m,--map", map_patterns,
+        "Name of the map to extract. May be given several times, and may be a glob pattern such as E1M*"
+    );
+    app.add_flag(
+        "--all-maps", convert_all_maps,
+        "Extract every map in the WAD files. The WAD files are only loaded once, and textures are shared between maps"
+    )->excludes(map_option);
+    app.add_flag(
+        "--list-maps", list_maps,
+        "List the names of the maps in the WAD files, then exit"
+    );
+    app.add_option(
+        "-o,--output", extraction_options.output_file,
+        "Output the glTF data to this file. When extracting more than one map, this is a folder that each map is written to"
+    );
+    app.add_option(
+        "-j,--jobs", num_jobs,
+        "Number of threads to use. Maps are converted in parallel, and so are the walls and flats of each map. Defaults to one per hardware thread"
+    );
     // app.add_flag("-e,--emission", export_emission_textures, "Generate emission textures by applying the palette for a dimly-lit room. This may or may not yield decent results");
     app.add_flag(
         "-t, --things", extraction_options.export_things,
         "Output the Things from the WAD file. Each Thing will be a Node in the glTF file, with some extras describing the type of Thing"
     );
+    app.add_flag(
+        "--instance-things", extraction_options.instance_things,
+        "Write one Node for each sprite, with the Things that use it as instances, using EXT_mesh_gpu_instancing. The instances' _THING attribute has each Thing's type and flags"
+    );
+    app.add_flag(
+        "--extended-limits", extraction_options.extended_limits,
+        "Convert limit-removing maps, such as maps with more than 32767 sidedefs. Without this, maps that go past vanilla limits are rejected"
+    );
+    app.add_flag(
+        "--earcut-flats", extraction_options.earcut_flats,
+        "Triangulate floors and ceilings from the sectors' linedefs instead of from the map's nodes. Maps without nodes always do this"
+    );
+    app.add_flag(
+        "--bvh", extraction_options.export_bvh,
+        "Write a BVH of the walls and flats next to each glTF file, for fast raycasts at runtime. The glTF scene's extras point to it"
+    );
+    app.add_flag(
+        "--quantize", extraction_options.quantize_meshes,
+        "Write positions, normals, and texcoords as 8- and 16-bit integers with KHR_mesh_quantization. This halves the size of the vertex data, but needs a loader that supports the extension"
+    );
+    app.add_option(
+        "--batch", extraction_options.mesh_batching,
+        "Merge faces that use the same texture into one primitive: per sector, per 1024x1024 chunk of the map, or for the whole map. Without this, each wall is its own primitive"
+    )->transform(
+        CLI::CheckedTransformer(
+            std::map<std::string, MeshBatching>{
+                {"sector", MeshBatching::Sector}, {"chunk", MeshBatching::Chunk}, {"map", MeshBatching::Map}
+            },
+            CLI::ignore_case
+        )
+    );
+    app.add_flag(
+        "--no-optimize-meshes", extraction_options.skip_mesh_optimization,
+        "Keep each sector's triangles and vertices in the order they were built in, instead of reordering them for the GPU's vertex cache"
+    );
     app.add_flag(
         "--no-apply-palette", extraction_options.skip_apply_palette,
         "Skip applying a palette to images. The exported images will contain indexes into a color palette, not the colors themselves"
@@ -61,6 +273,15 @@ map, and one Mesh Primitive for each sector. It can optionally extract the Thing
         "-c,--colormap", extraction_options.colormap_index,
         "Index of the colormap to use when exporting images. Defaults to 0"
     );
+    auto* no_mmap_flag = app.add_flag(
+        "--no-mmap", skip_memory_mapping,
+        "Read the whole WAD file into memory instead of memory-mapping it"
+    );
+    auto* stream_option = app.add_option(
+        "--stream", stream_budget_mb,
+        "Read lumps from the WAD files on demand, keeping at most this many megabytes of lumps in memory. Useful for huge WADs on machines with little memory"
+    );
+    stream_option->excludes(no_mmap_flag);
     app.positionals_at_end();
 
     try {
@@ -69,41 +290,88 @@ map, and one Mesh Primitive for each sector. It can optionally extract the Thing
         return app.exit(e);
     }
 
+    if (!list_maps && map_patterns.empty() && !convert_all_maps) {
+        std::cerr << "Either --map or --all-maps is required\n";
+        return -1;
+    }
+    if (!list_maps && extraction_options.output_file.empty()) {
+        std::cerr << "--output is required\n";
+        return -1;
+    }
+
     try {
-        const auto wad = load_wad_file(wad_filename);
+        auto load_mode = skip_memory_mapping ? WadLoadMode::Buffered : WadLoadMode::Auto;
+        if (stream_option->count() > 0) {
+            load_mode = WadLoadMode::Streamed;
+        }
+        const auto stream_budget_bytes = stream_budget_mb * 1024 * 1024;
 
+        auto resources = wad::ResourceSet{load_wad_file(wad_filename, load_mode, stream_budget_bytes)};
         std::cout << std::format("Loaded WAD file {}\n", wad_filename.string());
 
-        auto map = create_mesh_from_map(wad, extraction_options);
+        for (const auto& pwad_filename : pwad_filenames) {
+            resources.add_wad(load_wad_file(pwad_filename, load_mode, stream_budget_bytes));
+            std::cout << std::format("Loaded PWAD file {}\n", pwad_filename.string());
+        }
 
-        std::cout << std::format("Extracted map {} from WAD\n", extraction_options.map_name);
+        if (list_maps) {
+            for (const auto& map_name : find_map_names(resources)) {
+                std::cout << map_name << "\n";
+            }
+            return 0;
+        }
 
-        load_things_into_map(wad, extraction_options, map);
+        const auto map_names = select_maps(map_patterns, convert_all_maps, resources);
+        if (map_names.empty()) {
+            std::cerr << "No maps matched the requested names\n";
+            return -1;
+        }
 
-        // Load all the textures for each sector
+        auto exported_textures = ExportedTextures{};
+        auto thread_pool = ThreadPool{num_jobs};
 
-        auto [gltf_map, node_extras] = export_to_gltf(extraction_options.map_name, map, extraction_options);
-        std::cout << "Generated glTF data\n";
+        const auto is_batch = convert_all_maps || map_names.size() > 1 ||
+                              std::ranges::any_of(map_patterns, is_glob_pattern);
+        if (!is_batch) {
+            extraction_options.map_name = map_names.front();
+            convert_map(resources, extraction_options, exported_textures, thread_pool);
+            return 0;
+        }
 
-        auto exporter = fastgltf::FileExporter{};
-        exporter.setImagePath("textures");
-        exporter.setExtrasWriteCallback(write_extras);
-        exporter.setUserPointer(&node_extras);
+        const auto output_folder = extraction_options.output_file;
+        std::filesystem::create_directories(output_folder);
 
-        const auto result = exporter.writeGltfJson(
-            gltf_map, extraction_options.output_file, fastgltf::ExportOptions::PrettyPrintJson
-        );
+        auto conversions = std::vector<std::future<void>>{};
+        conversions.reserve(map_names.size());
+        for (const auto& map_name : map_names) {
+            auto map_options = extraction_options;
+            map_options.map_name = map_name;
+            map_options.output_file = output_folder / std::format("{}.gltf", map_name);
 
-        if (result != fastgltf::Error::None) {
-            std::cout << std::format("Could not write glTF file: {}\n", fastgltf::getErrorMessage(result));
-        } else {
-            std::cout << std::format("Wrote glTF to file {}\n", extraction_options.output_file.string());
+            conversions.emplace_back(
+                thread_pool.submit([&resources, map_options, &exported_textures, &thread_pool]() {
+                    convert_map(resources, map_options, exported_textures, thread_pool);
+                })
+            );
+        }
+
+        auto num_failed_maps = 0u;
+        for (auto i = 0u; i < conversions.size(); i++) {
+            try {
+                conversions[i].get();
+            } catch (const std::exception& e) {
+                std::cerr << std::format("Could not extract map {}: {}\n", map_names[i], e.what());
+                num_failed_maps++;
+            }
         }
 
-        const auto images_folder = extraction_options.output_file.parent_path() / "textures";
-        std::filesystem::create_directories(images_folder);
-        for (const auto& texture : map.textures) {
-            export_texture(texture, images_folder, wad, extraction_options);
+        std::cout << std::format(
+            "Extracted {} of {} maps to {}\n", map_names.size() - num_failed_maps, map_names.size(),
+            output_folder.string()
+        );
+
+        if (num_failed_maps > 0) {
+            return -1;
         }
     } catch (const std::exception& e) {
         std::cerr << e.what() << "\n";
@@ -1,6 +1,7 @@
 #include "wad_loader.hpp"
 
 #include <cstdint>
+#include <cstdio>
 #include <iostream>
 #include <optional>
 #include <vector>
@@ -12,40 +13,87 @@ std::optional<std::vector<uint8_t>> read_binary_file(const std::filesystem::path
         return std::nullopt;
     }
 
-    fseek(file, 0, SEEK_END);
-    const auto file_size = ftell(file);
-    fseek(file, 0, SEEK_SET);
-
-    auto file_content = std::vector<uint8_t>(file_size);
-    fread(file_content.data(), 1, file_size, file);
+    // Read in chunks rather than seeking to the end. Pipes and other non-regular files can't tell us their size
+    auto file_content = std::vector<uint8_t>{};
+    auto chunk_size = size_t{1024 * 1024};
+    while (true) {
+        const auto offset = file_content.size();
+        file_content.resize(offset + chunk_size);
+        const auto bytes_read = fread(file_content.data() + offset, 1, chunk_size, file);
+        if (bytes_read < chunk_size) {
+            file_content.resize(offset + bytes_read);
+            break;
+        }
+    }
 
+    const auto had_error = ferror(file) != 0;
     fclose(file);
 
+    if (had_error) {
+        return std::nullopt;
+    }
+
     return file_content;
 }
 
-wad::WAD load_wad_file(const std::filesystem::path& wad_path)
+wad::WAD load_wad_file(
+    const std::filesystem::path& wad_path, const WadLoadMode load_mode, const size_t cache_budget_bytes
+)
 {
     if(!exists(wad_path))
     {
         throw std::runtime_error{ "Requested WAD file does not exist" };
     }
 
-    // The DOOM and DOOM 2 WADs included in the DOOM 3 BFG edition are 12 and 14 MB, respectively. We can just load the whole thing into RAM without a care
-    auto wad_data = read_binary_file(wad_path);
-    if(!wad_data)
-    {
-        throw std::runtime_error{ "Could not read WAD file" };
+    auto wad = wad::WAD{};
+
+    if (load_mode == WadLoadMode::Streamed) {
+        wad.lump_cache = wad::LumpCache::open(wad_path, cache_budget_bytes);
+        wad.header = &wad.lump_cache->get_header();
+        wad.lump_directory = wad.lump_cache->get_lump_directory();
+        wad.lump_index.build(wad.lump_directory);
+        wad.map_index.build(wad.lump_directory);
+
+        return wad;
     }
 
-    auto wad = wad::WAD{};
-    wad.raw_data = std::move(*wad_data);
+    // Map regular files, so that we only pay for the lumps we actually read. Megawads can be a few hundred MB, and
+    // we often only want one map out of them
+    if (load_mode == WadLoadMode::Auto && is_regular_file(wad_path)) {
+        if (auto mapped_data = MappedFile::map(wad_path)) {
+            wad.mapped_data = std::move(*mapped_data);
+            wad.raw_data = wad.mapped_data.data();
+        }
+    }
+
+    if (wad.raw_data.empty()) {
+        auto wad_data = read_binary_file(wad_path);
+        if(!wad_data)
+        {
+            throw std::runtime_error{ "Could not read WAD file" };
+        }
+
+        wad.owned_data = std::move(*wad_data);
+        wad.raw_data = wad.owned_data;
+    }
 
-    auto* wad_data_ptr = wad.raw_data.data();
+    if (wad.raw_data.size() < sizeof(wad::Header)) {
+        throw std::runtime_error{ "WAD file is too small to contain a header" };
+    }
+
+    const auto* wad_data_ptr = wad.raw_data.data();
+
+    wad.header = reinterpret_cast<const wad::Header*>(wad_data_ptr);
+    const auto directory_end = static_cast<size_t>(wad.header->infotableofs) +
+                               static_cast<size_t>(wad.header->numlumps) * sizeof(wad::LumpInfo);
+    if (wad.header->infotableofs < 0 || wad.header->numlumps < 0 || directory_end > wad.raw_data.size()) {
+        throw std::runtime_error{ "WAD lump directory is out of bounds" };
+    }
 
-    wad.header = reinterpret_cast<wad::Header*>(wad_data_ptr);
-    auto* lump_directory_ptr = reinterpret_cast<wad::LumpInfo*>(wad_data_ptr + wad.header->infotableofs);
+    const auto* lump_directory_ptr = reinterpret_cast<const wad::LumpInfo*>(wad_data_ptr + wad.header->infotableofs);
     wad.lump_directory = std::span{ lump_directory_ptr, lump_directory_ptr + wad.header->numlumps };
+    wad.lump_index.build(wad.lump_directory);
+    wad.map_index.build(wad.lump_directory);
     
     return wad;
 }
@@ -4,5 +4,34 @@
 
 #include "wad.hpp"
 
+/**
+ * \brief How to get the WAD file's bytes into memory
+ */
+enum class WadLoadMode {
+    /**
+     * \brief Memory-map regular files, and read anything else (such as pipes) into a buffer
+     */
+    Auto,
+
+    /**
+     * \brief Always read the whole file into a buffer
+     */
+    Buffered,
+
+    /**
+     * \brief Only read the header and lump directory, and read lumps on demand into a byte-budgeted cache
+     */
+    Streamed,
+};
+
 // TODO: Return a std::expected with appropriate errors when I get a compiler that handles that well
-wad::WAD load_wad_file(const std::filesystem::path& wad_path);
+/**
+ * Loads a WAD file
+ *
+ * \param wad_path WAD file to load
+ * \param load_mode How to get the file's bytes into memory
+ * \param cache_budget_bytes How many bytes of lumps to keep in memory, if load_mode is Streamed
+ */
+wad::WAD load_wad_file(
+    const std::filesystem::path& wad_path, WadLoadMode load_mode = WadLoadMode::Auto, size_t cache_budget_bytes = 0
+);
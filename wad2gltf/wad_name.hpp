@@ -4,8 +4,10 @@
 #include <cstring>
 #include <cmath>
 #include <cctype>
+#include <cstdint>
 #include <format>
 #include <string_view>
+#include <type_traits>
 
 inline size_t strlen_s_wrapper(const char* str, size_t max_length) {
 #ifdef __STDC_LIB_EXT1__
@@ -39,6 +41,14 @@ namespace wad {
         bool is_none() const;
 
         bool starts_with(std::string_view prefix) const;
+
+        /**
+         * Canonical representation of this name: the eight characters packed into an integer, upper-cased, with
+         * everything after the null terminator zeroed. The first character is in the lowest byte
+         *
+         * Two names are equal if and only if their keys are equal, so this is what we compare and hash
+         */
+        uint64_t key() const;
     };
 
     template <typename StringType>
@@ -57,24 +67,24 @@ namespace wad {
         return name;
     }
 
+    /**
+     * Converts a string-like lump name to a Name. Names are passed through as-is
+     */
+    template <typename NameType>
+    Name to_name(const NameType& lump_name) {
+        if constexpr (std::is_same_v<NameType, Name>) {
+            return lump_name;
+        } else {
+            return Name::from_string(std::string_view{lump_name});
+        }
+    }
+
     inline bool Name::operator==(const std::string_view str) const {
-        return memcmp(val, str.data(), std::min(str.size(), static_cast<size_t>(8))) == 0;
+        return key() == from_string(str).key();
     }
 
     inline bool Name::operator==(const Name& other) const {
-        for (auto i = 0; i < 8; i++) {
-            if (toupper(static_cast<unsigned char>(val[i])) != toupper(static_cast<unsigned char>(other.val[i]))) {
-                return false;
-            }
-
-            if (val[i] == other.val[i] && val[i] == '\0') {
-                // We've iterated to the end of the string, and we've reached the null terminator. The names are equal
-                return true;
-            }
-        }
-
-        // We reached the end of the string without finding different characters. These are both eight-character names
-        return true;
+        return key() == other.key();
     }
 
     inline std::string Name::to_string() const {
@@ -96,7 +106,33 @@ namespace wad {
             return false;
         }
 
-        return memcmp(val, prefix.data(), prefix.size()) == 0;
+        // Keep one byte of the key for each character in the prefix
+        const auto prefix_mask = prefix.size() == 8 ? ~uint64_t{0} : (uint64_t{1} << (prefix.size() * 8)) - 1;
+        return (key() & prefix_mask) == from_string(prefix).key();
+    }
+
+    inline uint64_t Name::key() const {
+        // WADs are little-endian, and we already read every other field of them as native integers
+        auto word = uint64_t{0};
+        memcpy(&word, val, sizeof(word));
+
+        constexpr auto ones = uint64_t{0x0101010101010101};
+        constexpr auto high_bits = uint64_t{0x8080808080808080};
+
+        // Find the null terminator. This sets the high bit of every zero byte, plus maybe some bytes after the first
+        // zero byte. We only care about the first one, so that's fine
+        const auto zero_bytes = (word - ones) & ~word & high_bits;
+        const auto first_zero_byte = zero_bytes & (~zero_bytes + 1);
+        // If there's no terminator, first_zero_byte is 0 and this mask keeps all eight bytes
+        word &= (first_zero_byte >> 7) - 1;
+
+        // Upper-case the bytes in 'a'..'z'. Adding to the low seven bits of each byte can't carry into the next byte
+        const auto low_bits = word & ~high_bits;
+        const auto at_least_a = low_bits + ones * (0x80 - 'a');
+        const auto past_z = low_bits + ones * (0x80 - 'z' - 1);
+        const auto is_lower_case = at_least_a & ~past_z & ~word & high_bits;
+
+        return word - (is_lower_case >> 2);
     }
 }
 
@@ -112,6 +148,12 @@ struct std::formatter<wad::Name> : std::formatter<std::string> {
 template <>
 struct std::hash<wad::Name> {
     std::size_t operator()(const wad::Name& name) const noexcept {
-        return std::hash<std::string>{}(name.to_string());
+        // Names that share a prefix only differ in their high bytes, so mix those down before the hash table takes
+        // the low bits
+        auto key = name.key();
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccd;
+        key ^= key >> 33;
+        return static_cast<std::size_t>(key);
     }
 };
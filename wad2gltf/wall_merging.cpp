@@ -0,0 +1,170 @@
+#include "wall_merging.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+/**
+ * How far apart, in texels, two texture coordinates can be and still count as the same. Texture coordinates are
+ * divided by the texture size, so they aren't exact even when the walls line up perfectly
+ */
+constexpr auto TexelEpsilon = 1.0 / 1024.0;
+
+/**
+ * Where a wall starts or ends, and what it looks like there. Faces can only merge when these match
+ */
+struct WallEdge {
+    uint32_t texture_index = 0;
+    glm::vec3 bottom = {};
+    float top = 0;
+
+    bool operator==(const WallEdge& other) const {
+        return texture_index == other.texture_index && bottom.x == other.bottom.x && bottom.y == other.bottom.y &&
+               bottom.z == other.bottom.z && top == other.top;
+    }
+};
+
+struct WallEdgeHash {
+    std::size_t operator()(const WallEdge& edge) const noexcept {
+        auto key = uint64_t{edge.texture_index};
+        for (const auto value : {edge.bottom.x, edge.bottom.y, edge.bottom.z, edge.top}) {
+            auto bits = uint32_t{0};
+            std::memcpy(&bits, &value, sizeof(bits));
+            key = (key ^ bits) * 0x100000001b3;
+        }
+        key ^= key >> 33;
+        return static_cast<std::size_t>(key);
+    }
+};
+
+WallEdge get_start_edge(const Face& face) {
+    return WallEdge{
+        .texture_index = face.texture_index, .bottom = face.vertices[0].position, .top = face.vertices[2].position.z
+    };
+}
+
+WallEdge get_end_edge(const Face& face) {
+    return WallEdge{
+        .texture_index = face.texture_index, .bottom = face.vertices[1].position, .top = face.vertices[3].position.z
+    };
+}
+
+/**
+ * Checks whether the wall that starts at the end of first can be merged onto it. The faces' shared edge must already
+ * match
+ */
+bool can_merge(const Face& first, const Face& second, const DecodedTexture& texture) {
+    // Same direction. The positions are whole map units, so doubles multiply them exactly
+    const auto first_x = double{first.vertices[1].position.x} - first.vertices[0].position.x;
+    const auto first_y = double{first.vertices[1].position.y} - first.vertices[0].position.y;
+    const auto second_x = double{second.vertices[1].position.x} - second.vertices[0].position.x;
+    const auto second_y = double{second.vertices[1].position.y} - second.vertices[0].position.y;
+    if (first_x * second_y - first_y * second_x != 0 || first_x * second_x + first_y * second_y <= 0) {
+        return false;
+    }
+
+    // The texture's vertical alignment must be the same
+    if (first.vertices[1].texcoord.y != second.vertices[0].texcoord.y ||
+        first.vertices[3].texcoord.y != second.vertices[2].texcoord.y) {
+        return false;
+    }
+
+    // The texture must carry on across the seam, give or take whole repeats
+    const auto seam_texels = (double{first.vertices[1].texcoord.x} - second.vertices[0].texcoord.x) * texture.size.x;
+    const auto repeat_texels = std::round(seam_texels / texture.size.x) * texture.size.x;
+    return std::abs(seam_texels - repeat_texels) <= TexelEpsilon;
+}
+
+/**
+ * Moves second's far end onto first, so that first covers both faces
+ */
+void append_face(Face& first, const Face& second) {
+    // Shift second's texture coordinates by the whole repeats between the faces, so the texture stays continuous
+    const auto u_shift = first.vertices[1].texcoord.x - second.vertices[0].texcoord.x;
+
+    first.vertices[1] = second.vertices[1];
+    first.vertices[3] = second.vertices[3];
+    first.vertices[1].texcoord.x += u_shift;
+    first.vertices[3].texcoord.x += u_shift;
+}
+
+/**
+ * Moves first's near end onto second, so that second covers both faces
+ */
+void prepend_face(Face& second, const Face& first) {
+    const auto u_shift = second.vertices[0].texcoord.x - first.vertices[1].texcoord.x;
+
+    second.vertices[0] = first.vertices[0];
+    second.vertices[2] = first.vertices[2];
+    second.vertices[0].texcoord.x += u_shift;
+    second.vertices[2].texcoord.x += u_shift;
+}
+
+void merge_collinear_walls(
+    std::pmr::vector<Face>& faces, const std::span<const DecodedTexture> textures, std::pmr::memory_resource* memory
+) {
+    if (faces.size() < 2) {
+        return;
+    }
+
+    using FacesByEdge = std::pmr::unordered_map<WallEdge, std::pmr::vector<uint32_t>, WallEdgeHash>;
+    auto faces_by_start = FacesByEdge{memory};
+    auto faces_by_end = FacesByEdge{memory};
+    faces_by_start.reserve(faces.size());
+    faces_by_end.reserve(faces.size());
+    for (auto i = 0u; i < faces.size(); i++) {
+        faces_by_start[get_start_edge(faces[i])].emplace_back(i);
+        faces_by_end[get_end_edge(faces[i])].emplace_back(i);
+    }
+
+    auto is_merged = std::pmr::vector<bool>(faces.size(), false, memory);
+
+    // Finds the first face that hasn't been merged yet which continues the run at edge and can be merged onto it
+    const auto find_neighbor = [&](
+        const auto& faces_by_edge, const WallEdge& edge, const Face& run, const bool is_after_run
+    ) -> const Face* {
+        const auto itr = faces_by_edge.find(edge);
+        if (itr == faces_by_edge.end()) {
+            return nullptr;
+        }
+
+        const auto& texture = textures[run.texture_index];
+        for (const auto candidate : itr->second) {
+            if (is_merged[candidate]) {
+                continue;
+            }
+
+            const auto& candidate_face = faces[candidate];
+            const auto mergeable = is_after_run
+                                       ? can_merge(run, candidate_face, texture)
+                                       : can_merge(candidate_face, run, texture);
+            if (mergeable) {
+                is_merged[candidate] = true;
+                return &candidate_face;
+            }
+        }
+
+        return nullptr;
+    };
+
+    // Every face before i has been merged into a run by the time we get to i, so the runs can be written over them
+    auto num_merged_faces = size_t{0};
+    for (auto i = 0u; i < faces.size(); i++) {
+        if (is_merged[i]) {
+            continue;
+        }
+        is_merged[i] = true;
+
+        auto run = faces[i];
+        while (const auto* next = find_neighbor(faces_by_start, get_end_edge(run), run, true)) {
+            append_face(run, *next);
+        }
+        while (const auto* previous = find_neighbor(faces_by_end, get_start_edge(run), run, false)) {
+            prepend_face(run, *previous);
+        }
+
+        faces[num_merged_faces++] = run;
+    }
+
+    faces.erase(faces.begin() + static_cast<ptrdiff_t>(num_merged_faces), faces.end());
+}
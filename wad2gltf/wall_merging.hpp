@@ -0,0 +1,32 @@
+#pragma once
+
+#include <memory_resource>
+#include <span>
+#include <vector>
+
+#include "mesh.hpp"
+
+/**
+ * \file wall_merging.hpp
+ *
+ * Joins wall faces that line up into longer faces
+ */
+
+/**
+ * \brief Merges one sector's walls that continue each other
+ *
+ * Two faces are merged when one starts where the other ends, they go in the same direction, they have the same
+ * texture, bottom, and top, and the texture runs on from one to the other without a jump. A texture that jumps by a
+ * whole number of repeats doesn't jump at all, since it wraps. The merged face looks exactly the same as the faces it
+ * replaces, but it's one quad instead of many
+ *
+ * Merged faces are where the first face of their run was, so the result doesn't depend on anything but the input order
+ *
+ * \param faces The sector's faces. Replaced with the merged faces
+ * \param textures The map's textures, for converting texture coordinates to pixels
+ * \param memory Where the lookup tables and the other scratch data go. The merged faces don't use it
+ */
+void merge_collinear_walls(
+    std::pmr::vector<Face>& faces, std::span<const DecodedTexture> textures,
+    std::pmr::memory_resource* memory = std::pmr::get_default_resource()
+);